@@ -0,0 +1,89 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Об'єкти структури розміщуються в поточній арені компіляції. delete лише викликає
+// деструктор, пам'ять звільняється разом з ареною
+#define ARENA_ALLOCATED                                                                         \
+    static void* operator new(size_t size) { return ast::Arena::current()->allocate(size); }    \
+    static void operator delete(void*) noexcept {}
+
+namespace ast
+{
+    // Арена компіляції: вузли AST, текст токенів, області видимості та стан компілятора
+    // розміщуються послідовно у великих блоках пам'яті. Арена звільняє їх разом, без обходу
+    // дерева і без деструкторів, тому об'єкти в арені можуть володіти лише пам'яттю арени:
+    // рядками з copyString та контейнерами з ArenaAllocator.
+    // Нові об'єкти розміщуються в арені, поточній для потоку, див. ArenaScope
+    class Arena
+    {
+    private:
+        std::pmr::monotonic_buffer_resource resource;
+        size_t allocated = 0;
+        static thread_local Arena* currentArena;
+
+        friend class ArenaScope;
+    public:
+        // Поточна арена потоку. Розміщення поза ареною є помилкою компілятора
+        static Arena* current();
+        void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+        // Копіює рядок в арену
+        std::string_view copyString(std::string_view text);
+        // Кількість байтів, виділених в арені
+        size_t allocatedBytes() const;
+
+        // initialSize - розмір першого блоку, наступні блоки більші в рази
+        Arena(size_t initialSize = 64 * 1024);
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+    };
+
+    // Робить арену поточною для потоку до кінця області видимості. В режимі лінивої
+    // компіляції арена живе довше за компіляцію модуля і стає поточною знову
+    // для компіляції кожного тіла функції
+    class ArenaScope
+    {
+    private:
+        Arena* previous;
+    public:
+        ArenaScope(Arena* arena);
+        ArenaScope(const ArenaScope&) = delete;
+        ArenaScope& operator=(const ArenaScope&) = delete;
+        ~ArenaScope();
+    };
+
+    // Аллокатор для контейнерів, які живуть в арені. Пам'ять береться з поточної арени
+    // потоку і не повертається до її знищення
+    template<typename T>
+    struct ArenaAllocator
+    {
+        using value_type = T;
+
+        ArenaAllocator() = default;
+        template<typename U>
+        ArenaAllocator(const ArenaAllocator<U>&) {}
+
+        T* allocate(size_t n)
+        {
+            return static_cast<T*>(Arena::current()->allocate(n * sizeof(T), alignof(T)));
+        }
+        void deallocate(T*, size_t) {}
+
+        template<typename U>
+        bool operator==(const ArenaAllocator<U>&) const { return true; }
+    };
+
+    template<typename T>
+    using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+    template<typename Key, typename Value, typename Hash = std::hash<Key>>
+    using ArenaMap = std::unordered_map<Key, Value, Hash, std::equal_to<Key>,
+        ArenaAllocator<std::pair<const Key, Value>>>;
+}
+
+#endif
@@ -2,13 +2,15 @@
 #define NODE_H
 
 #include <string>
-#include <vector>
+#include <string_view>
+#include <span>
 #include <optional>
 #include <variant>
 #include <memory>
 
 #include "string_enum.hpp"
 #include "types.hpp"
+#include "arena.hpp"
 
 
 namespace ast
@@ -40,8 +42,11 @@ namespace ast
         CALL_EXPRESSION,
     )
 
+    // Вузли розміщуються в арені компіляції і звільняються разом з нею, тому дерево
+    // після компіляції не знищується
     struct Node
     {
+        ARENA_ALLOCATED
         NodeKind kind;
 
         Node(NodeKind kind) : kind(kind) {};
@@ -62,21 +67,16 @@ namespace ast
     {
         size_t lineno;
         size_t col;
-        std::string text;
+        // Вказує в текст програми, в рядкову константу або в арену компіляції
+        std::string_view text;
     };
 
     struct BlockStatement : Statement
     {
-        std::vector<Statement*> statements;
+        ArenaVector<Statement*> statements;
 
-        BlockStatement(std::vector<Statement*> statements)
-            : Statement(NodeKind::BLOCK_STATEMENT), statements(statements) {};
-
-        virtual ~BlockStatement()
-        {
-            for (auto node: statements)
-                delete node;
-        };
+        BlockStatement(std::span<Statement* const> statements)
+            : Statement(NodeKind::BLOCK_STATEMENT), statements(statements.begin(), statements.end()) {};
     };
 
     struct WhileStatement : Statement
@@ -135,10 +135,10 @@ namespace ast
 
     struct FunctionDeclaration : Statement
     {
-        using parameters_t = std::vector<Token>;
+        using parameters_t = ArenaVector<Token>;
         using variadicParameter_t = std::optional<Token>;
         using defaultParameter_t = std::pair<Token, Expression*>;
-        using defaultParameters_t = std::vector<defaultParameter_t>;
+        using defaultParameters_t = ArenaVector<defaultParameter_t>;
 
         Token id;
         parameters_t parameters;
@@ -147,11 +147,12 @@ namespace ast
         std::unique_ptr<BlockStatement> block;
 
         FunctionDeclaration(
-            Token id, parameters_t parameters, variadicParameter_t variadicParameter,
-            defaultParameters_t defaultParameters, BlockStatement* block)
+            Token id, std::span<const Token> parameters, variadicParameter_t variadicParameter,
+            std::span<const defaultParameter_t> defaultParameters, BlockStatement* block)
             :
-            Statement(NodeKind::FUNCTION_STATEMENT), id(id), parameters(parameters),
-            variadicParameter(variadicParameter), defaultParameters(defaultParameters), block(block) {};
+            Statement(NodeKind::FUNCTION_STATEMENT), id(id), parameters(parameters.begin(), parameters.end()),
+            variadicParameter(variadicParameter), defaultParameters(defaultParameters.begin(), defaultParameters.end()),
+            block(block) {};
     };
 
     struct ReturnStatement : Statement
@@ -178,6 +179,7 @@ namespace ast
 
     struct CatchBlock
     {
+        ARENA_ALLOCATED
         Token catch_;
         Token exceptionName;
         std::optional<Token> as;
@@ -187,6 +189,7 @@ namespace ast
 
     struct FinallyBlock
     {
+        ARENA_ALLOCATED
         Token finally_;
         std::unique_ptr<BlockStatement> block;
     };
@@ -195,20 +198,14 @@ namespace ast
     {
         Token try_;
         std::unique_ptr<BlockStatement> block;
-        std::vector<CatchBlock*> catchBlocks;
+        ArenaVector<CatchBlock*> catchBlocks;
         std::optional<std::unique_ptr<FinallyBlock>> finallyBlock;
 
-        TryCatchStatement(Token try_, BlockStatement* block, std::vector<CatchBlock*> catchBlocks,
+        TryCatchStatement(Token try_, BlockStatement* block, std::span<CatchBlock* const> catchBlocks,
             std::optional<FinallyBlock*> finallyBlock)
             :
             Statement(NodeKind::TRY_CATCH_STATEMENT), try_(try_), block(block),
-            catchBlocks(catchBlocks), finallyBlock(finallyBlock) {};
-
-        virtual ~TryCatchStatement()
-        {
-            for (auto node: catchBlocks)
-                delete node;
-        };
+            catchBlocks(catchBlocks.begin(), catchBlocks.end()), finallyBlock(finallyBlock) {};
     };
 
     struct RaiseStatement : Statement
@@ -276,8 +273,9 @@ namespace ast
 
     struct LiteralString
     {
+        ARENA_ALLOCATED
         Token token;
-        std::string str;
+        std::string_view str; // Вказує в текст програми або в арену компіляції
     };
 
     struct LiteralExpression : Expression
@@ -289,42 +287,28 @@ namespace ast
 
         Token literalToken;
         Type literalType;
-        using stringType = std::vector<LiteralString*>;
+        using stringType = ArenaVector<LiteralString*>;
         std::variant<i64, double, bool, stringType> value;
 
         LiteralExpression(Token literalToken, Type literalType, std::variant<i64, double, bool, stringType> value)
             : Expression(NodeKind::LITERAL_EXPRESSION), literalToken(literalToken), literalType(literalType), value(value) {};
-
-        ~LiteralExpression()
-        {
-            if (literalType == Type::STRING)
-            {
-                for (auto literal : std::get<stringType>(value))
-                    delete literal;
-            }
-        }
     };
 
     struct CallExpression : Expression
     {
-        using arguments_t = std::vector<Expression*>;
+        using arguments_t = ArenaVector<Expression*>;
         using namedArgument_t = std::pair<Token, Expression*>;
-        using namedArguments_t = std::vector<namedArgument_t>;
+        using namedArguments_t = ArenaVector<namedArgument_t>;
 
         std::unique_ptr<Expression> callable;
         arguments_t arguments;
         namedArguments_t namedArguments;
 
-        CallExpression(Expression* callable, arguments_t arguments, namedArguments_t namedArguments)
-            : Expression(NodeKind::CALL_EXPRESSION), callable(callable), arguments(arguments), namedArguments(namedArguments) {};
-
-        virtual ~CallExpression()
-        {
-            for (auto node: arguments)
-                delete node;
-            for (auto node: namedArguments)
-                delete node.second;
-        };
+        CallExpression(Expression* callable, std::span<Expression* const> arguments,
+            std::span<const namedArgument_t> namedArguments)
+            :
+            Expression(NodeKind::CALL_EXPRESSION), callable(callable),
+            arguments(arguments.begin(), arguments.end()), namedArguments(namedArguments.begin(), namedArguments.end()) {};
     };
 }
 
@@ -0,0 +1,66 @@
+#ifndef BYTECODE_CACHE_H
+#define BYTECODE_CACHE_H
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "code_object.hpp"
+#include "program_source.hpp"
+
+namespace compiler
+{
+    // Версія формату кешу. Збільшується при зміні опкодів, їх операндів або самого формату
+    constexpr const vm::WORD BYTECODE_CACHE_VERSION = 3;
+
+    // Хеш FNV-1a тексту програми або даних кешу чи образу. Не залежить від реалізації
+    // std::hash, тому однаковий між запусками
+    u64 fnv1aHash(std::string_view data);
+
+    // Об'єкти модуля для запису в кеш або образ: константи всіх CodeObject і самі CodeObject.
+    // Кожен об'єкт додається один раз, а CodeObject - після своїх констант, тому кореневий
+    // CodeObject йде останнім
+    struct ModuleObjects
+    {
+        std::vector<vm::Object*> objects;
+        std::unordered_map<vm::Object*, u32> indexes;
+
+        // Повертає false, якщо серед констант є об'єкт типу, який не зберігається,
+        // або CodeObject з ще не скомпільованим тілом
+        bool add(vm::Object* object);
+    };
+
+    // Записує CodeObject модуля разом з вкладеними CodeObject і константами в масив байтів.
+    // Константи, спільні для кількох CodeObject, записуються один раз. Повертає std::nullopt,
+    // якщо серед констант є об'єкт типу, який не зберігається
+    std::optional<std::string> serializeCodeObject(vm::CodeObject* codeObject, std::string_view sourceText);
+    // Відновлює CodeObject з data. Константи та CodeObject створюються безсмертними, як
+    // в компіляторі. Повертає nullptr, якщо дані пошкоджені (не збігається хеш або байткод
+    // не проходить верифікацію) або записані для іншого тексту програми, іншої версії
+    // інтерпретатора чи формату
+    vm::CodeObject* deserializeCodeObject(std::string_view data, periwinkle::ProgramSource* source);
+
+    // Кеш скомпільованого коду програми з файлу. Файл кешу перезаписується, коли змінюється
+    // текст програми або версія інтерпретатора
+    class BytecodeCache
+    {
+    private:
+        periwinkle::ProgramSource* source;
+        std::filesystem::path path;
+    public:
+        // Повертає CodeObject з кешу, або nullptr, якщо кешу немає або він не відповідає програмі
+        vm::CodeObject* load();
+        // Повертає false, якщо кеш не вдалося записати
+        bool store(vm::CodeObject* codeObject);
+
+        // Кеш зберігається в cacheDirectory, а якщо вона не задана - в теці "__кеш__" поруч
+        // з файлом програми. Ім'я файлу кешу - ім'я файлу програми з розширенням ".бк".
+        // В cacheDirectory перед розширенням додається хеш повного шляху до програми
+        BytecodeCache(periwinkle::ProgramSource* source, const std::filesystem::path& cacheDirectory = {});
+    };
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef BYTECODE_IMAGE_H
+#define BYTECODE_IMAGE_H
+
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+#include "code_object.hpp"
+#include "program_source.hpp"
+
+namespace compiler
+{
+    // Версія формату образу. Збільшується при зміні опкодів, їх операндів або самого формату
+    constexpr const vm::WORD BYTECODE_IMAGE_VERSION = 4;
+
+    // Записує в файл образ програми: CodeObject модуля з вкладеними CodeObject, константи
+    // та текст програми для повідомлень про помилки. Посилання всередині образу - зміщення
+    // від його початку, тому образ можна відобразити за будь-якою адресою. Повертає false,
+    // якщо серед констант є об'єкт типу, який не зберігається, або файл не вдалося записати
+    bool writeBytecodeImage(vm::CodeObject* codeObject, periwinkle::ProgramSource* source,
+        const std::filesystem::path& path);
+
+    // Образ програми, відображений в пам'ять лише для читання. Байткод та таблиці рядків
+    // завантажених CodeObject посилаються на пам'ять образу, тому процеси, які запускають
+    // один образ, поділяють її фізичні сторінки. Образ повинен жити довше за CodeObject
+    class BytecodeImage
+    {
+    private:
+        const char* data = nullptr;
+        size_t size = 0;
+        periwinkle::ProgramSource* source = nullptr;
+        // Об'єкти таблиці образу, створені при першому зверненні до них
+        std::vector<vm::Object*> objects;
+
+        BytecodeImage() = default;
+        // Створює об'єкт запису index таблиці. CodeObject створюється без тіла
+        vm::Object* getObject(u64 index);
+        // Перевіряє хеш даних CodeObject, створеного getObject, і читає його байткод,
+        // константи та імена
+        bool readBody(vm::CodeObject* codeObject);
+
+        friend bool loadImageBody(vm::CodeObject* codeObject);
+    public:
+        // Чи починається файл з сигнатури образу
+        static bool isImage(const std::filesystem::path& path);
+        // Відображає образ в пам'ять. Повертає nullptr, якщо файл не вдалося відобразити
+        // або образ записаний іншою версією інтерпретатора
+        static BytecodeImage* open(const std::filesystem::path& path);
+
+        // Ім'я та текст програми, з якої записано образ
+        std::string_view getSourceName() const;
+        std::string_view getSourceText() const;
+        // Створює CodeObject модуля, перевіряє хеш його даних і верифікує байткод. Вкладені
+        // функції отримують лише параметри, а їх тіла так само перевіряються при першому
+        // виклику, тому час завантаження не залежить від розміру програми. Власними копіями отримують лише імена
+        // та константи, байткод і таблиці рядків позичаються з образу. Повертає nullptr,
+        // якщо образ пошкоджений
+        vm::CodeObject* load(periwinkle::ProgramSource* source);
+
+        BytecodeImage(const BytecodeImage&) = delete;
+        BytecodeImage& operator=(const BytecodeImage&) = delete;
+        ~BytecodeImage();
+    };
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef CFG_OPTIMIZER_H
+#define CFG_OPTIMIZER_H
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "control_flow_graph.hpp"
+
+namespace compiler
+{
+    // Оптимізує CodeObject на графі потоку керування: прибирає присвоєння локальним змінним,
+    // значення яких більше не читаються, виносить з циклів завантаження глобальних змінних,
+    // які в циклі не змінюються, та розміщує умову циклу "поки" після його тіла
+    class CfgOptimizer
+    {
+    private:
+        ControlFlowGraph graph;
+        vm::CodeObject* codeObject = nullptr;
+        // Глобальні імена, які змінюють або видаляють функції модуля. Код модуля поза функціями
+        // не виконується під час циклу в іншому місці, тому його присвоєння не враховуються
+        std::unordered_set<std::string> storedInFunctions;
+        // Хибне, якщо тіла деяких функцій ще не скомпільовані (лінива компіляція). Тоді
+        // будь-який виклик у циклі може змінити будь-яку глобальну змінну
+        bool storedGlobalsKnown = true;
+        // Локальні змінні поточного codeObject, створені для винесених із циклів значень
+        std::unordered_map<std::string, vm::WORD> hoistedLocals;
+
+        void collectStoredGlobals(vm::CodeObject* function);
+        // Замінює STORE_LOCAL на POP, якщо значення змінної не читається на жодному
+        // шляху далі, включно з переходами в обробники винятків
+        void eliminateDeadStores();
+        // Завантажує незмінні в циклі глобальні змінні один раз перед циклом в локальну змінну
+        void hoistGlobalLoads();
+        void hoistLoopGlobals(const Loop& loop);
+        // Повертає локальну змінну для значення глобальної змінної name, або std::nullopt,
+        // якщо в codeObject вже є власна локальна змінна з таким ім'ям
+        std::optional<vm::WORD> hoistedLocal(const std::string& name);
+        // Переносить умову циклу "поки" за його тіло: перехід на початок циклу в кінці тіла
+        // та умовний вихід з циклу замінюються одним умовним переходом на початок тіла
+        void rotateLoops();
+        bool rotateLoop(const Loop& loop);
+        void optimizeCodeObject(vm::CodeObject* codeObject);
+        void optimizeNested(vm::CodeObject* codeObject);
+    public:
+        // Оптимізує codeObject і всі вкладені в нього CodeObject. Виконується перед
+        // PeepholeOptimizer, який прибирає залишені проходами недосяжні блоки та пари інструкцій
+        void optimize(vm::CodeObject* codeObject);
+        // Оптимізує тіло функції, скомпільоване при першому виклику. Присвоєння глобальним
+        // змінним в інших функціях невідомі, тому з циклів з викликами глобальні змінні
+        // не виносяться
+        void optimizeDeferred(vm::CodeObject* function);
+    };
+}
+
+#endif
@@ -1,9 +1,13 @@
 #ifndef  COMPILATOR_H
 #define  COMPILATOR_H
 
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include "ast.hpp"
+#include "arena.hpp"
 #include "vm.hpp"
 #include "scope.hpp"
 #include "program_source.hpp"
@@ -15,16 +19,52 @@ namespace compiler
         LOOP, FUNCTION
     };
 
+    // Стан циклів та функцій, які компілюються, розміщується в арені компіляції
     struct CompilerState
     {
+        ARENA_ALLOCATED
         CompilerStateType type;
     };
 
+    // Хеш для пошуку в таблицях імен за std::string_view, без створення тимчасового рядка
+    struct NameHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const noexcept
+        {
+            return std::hash<std::string_view>{}(name);
+        }
+    };
+    using name_index_t = std::unordered_map<std::string, vm::WORD, NameHash, std::equal_to<>>;
+
+    // Індекси констант та імен CodeObject, який компілюється, щоб не шукати їх перебором векторів.
+    // Значення - позиції у відповідних векторах CodeObject, порядок яких не змінюється
+    struct CodeObjectIndexes
+    {
+        std::unordered_map<vm::Object*, vm::WORD> constants;
+        name_index_t names;
+        name_index_t locals;
+        name_index_t freevars; // Спочатку комірки, потім вільні змінні
+    };
+
+    class Compiler;
+
+    // Тіло функції, компіляцію якого відкладено до першого виклику. Живе в арені компіляції
+    struct DeferredBody
+    {
+        ARENA_ALLOCATED
+        Compiler* compiler;
+        ast::FunctionDeclaration* declaration;
+    };
+
     class Compiler
     {
     private:
         ast::BlockStatement* root;
         periwinkle::ProgramSource* source;
+        // Арена з AST та областями видимості. Якщо задана, тіла функцій компілюються
+        // при першому виклику, тому арена і компілятор живуть, доки виконується програма
+        ast::Arena* deferredArena;
         vm::CodeObject* codeObject;
         std::vector<CompilerState*> stateStack;
         vm::WORD currentLineno = 0; // Номер лінії коду, який зараз компілюється
@@ -33,6 +73,15 @@ namespace compiler
         bool isRootBlock = false;
         bool isLastStatementInBlock = false;
         bool isRootBlockHasReturn = false;
+        // Локальні змінні поточної функції, яким гарантовано присвоєно значення
+        // в місці, що зараз компілюється. Завантаження таких змінних не перевіряється
+        std::vector<bool> assignedLocals;
+        CodeObjectIndexes* indexes = nullptr; // Індекси поточного codeObject
+        // Незмінні константи, спільні для всіх CodeObject модуля
+        std::unordered_map<i64, vm::Object*> integerConstants;
+        std::unordered_map<u64, vm::Object*> realConstants; // Ключ - біти значення
+        std::unordered_map<std::u32string, vm::Object*> stringConstants;
+        std::unordered_map<std::string, vm::Object*> stringVectorConstants; // Ключ - рядки, розділені '\0'
 
         void compileBlock(ast::BlockStatement* block);
         void compileStatement(ast::Statement* statement);
@@ -42,6 +91,14 @@ namespace compiler
         void compileContinueStatement(ast::ContinueStatement* statement);
         void compileIfStatement(ast::IfStatement* statement);
         void compileFunctionDeclaration(ast::FunctionDeclaration* statement);
+        void checkParameters(ast::FunctionDeclaration* statement);
+        void checkNamedArguments(ast::CallExpression* expression);
+        // Перевіряє відкладене тіло функції на помилки, які не залежать від генерації коду:
+        // керувальні послідовності в рядках, "завершити" та "пропустити" поза циклом,
+        // повторені параметри та іменовані аргументи
+        void checkDeferredBody(ast::Node* node, bool isInLoop);
+        // Генерує байткод тіла функції в fnCodeObject, розмітка якого вже заповнена
+        void compileFunctionBody(ast::FunctionDeclaration* statement, vm::CodeObject* fnCodeObject);
         void compileReturnStatement(ast::ReturnStatement* statement);
         void compileForEachStatement(ast::ForEachStatement* statement);
         void compileTryCatchStatement(ast::TryCatchStatement* statement);
@@ -52,27 +109,34 @@ namespace compiler
         std::u32string parseString(ast::LiteralString* str);
         void compileLiteralExpression(ast::LiteralExpression* expression);
         void compileVariableExpression(ast::VariableExpression* expression);
-        void compileCallExpression(ast::CallExpression* expression);
+        // isTailCall - виклик є значенням "повернути" і завершує функцію інструкцією TAIL_CALL або TAIL_CALL_NA
+        void compileCallExpression(ast::CallExpression* expression, bool isTailCall=false);
         void compileBinaryExpression(ast::BinaryExpression* expression);
         void compileUnaryExpression(ast::UnaryExpression* expression);
         void compileParenthesizedExpression(ast::ParenthesizedExpression* expression);
         void compileAttributeExpression(
             ast::AttributeExpression* expression, bool isMethod=false);
 
-        void compileNameGet(const std::string& name);
-        void compileNameSet(const std::string& name);
-        void compileNameDelete(const std::string& name);
+        void compileNameGet(std::string_view name);
+        void compileNameSet(std::string_view name);
+        void compileNameDelete(std::string_view name);
+        // Знімає гарантію присвоєння з локальних змінних, які видаляються всередині node
+        void forgetDeletedLocals(ast::Node* node);
+        // Код після переходу недосяжний, тому для нього всі змінні вважаються присвоєними
+        void markUnreachable();
 
         CompilerState* unwindStateStack(CompilerStateType type);
+        // Повертає індекс константи в поточному codeObject, додаючи її при першому використанні
+        vm::WORD constantIdx(vm::Object* constant);
         vm::WORD booleanConstIdx(bool value);
         vm::WORD realConstIdx(double value);
         vm::WORD integerConstIdx(i64 value);
         vm::WORD stringVectorIdx(const std::vector<std::string>& value);
         vm::WORD stringConstIdx(const std::u32string& value);
         vm::WORD nullConstIdx();
-        vm::WORD freeIdx(const std::string& name); // Повертає індекс для Frame->freevars
-        vm::WORD localIdx(const std::string& name); // Повертає індекс з CodeObject->locals
-        vm::WORD nameIdx(const std::string& name); // Повертає індекс з CodeObject->names
+        vm::WORD freeIdx(std::string_view name); // Повертає індекс для Frame->freevars
+        vm::WORD localIdx(std::string_view name); // Повертає індекс з CodeObject->locals
+        vm::WORD nameIdx(std::string_view name); // Повертає індекс з CodeObject->names
         void throwCompileError(std::string message, ast::Token token);
         // Встановлює номер рядка в коді, який зараз компілюється.
         // !!!Викликати перед компіляцією рядка!!!
@@ -83,7 +147,12 @@ namespace compiler
         inline void patchJumpAddress(int offset, vm::WORD newAddress, bool isOp=true);
     public:
         vm::Frame* compile();
-        Compiler(ast::BlockStatement* root, periwinkle::ProgramSource* source);
+        // Компілює відкладене тіло функції, оптимізує та перевіряє його байткод
+        void compileDeferred(ast::FunctionDeclaration* declaration, vm::CodeObject* fnCodeObject);
+        // Якщо deferredArena задана, тіла функцій компілюються при першому виклику. Арена
+        // повинна містити AST root і жити разом з компілятором до кінця виконання програми
+        Compiler(ast::BlockStatement* root, periwinkle::ProgramSource* source,
+            ast::Arena* deferredArena = nullptr);
     };
 }
 
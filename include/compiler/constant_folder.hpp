@@ -0,0 +1,34 @@
+#ifndef CONSTANT_FOLDER_H
+#define CONSTANT_FOLDER_H
+
+#include <memory>
+
+#include "ast.hpp"
+
+namespace compiler
+{
+    // Обчислює вирази з літералів до генерації коду за семантикою операторів середовища виконання
+    // та прибирає гілки "якщо" і цикли "поки" зі сталою умовою. Вирази, обчислення яких
+    // завершується помилкою (наприклад, ділення на нуль), залишаються для виконання
+    class ConstantFolder
+    {
+    private:
+        ast::BlockStatement* root;
+
+        void foldBlock(ast::BlockStatement* block);
+        // Повертає інструкцію, якою замінюється statement, або nullptr, якщо її потрібно
+        // видалити. Замінена інструкція залишається в арені до кінця компіляції
+        ast::Statement* foldStatement(ast::Statement* statement);
+        // Повертає вираз, яким замінюється expression. Замінений вираз залишається в арені
+        ast::Expression* foldExpression(ast::Expression* expression);
+        ast::Expression* foldBinaryExpression(ast::BinaryExpression* expression);
+        ast::Expression* foldUnaryExpression(ast::UnaryExpression* expression);
+        void fold(std::unique_ptr<ast::Expression>& expression);
+    public:
+        void foldConstants();
+
+        ConstantFolder(ast::BlockStatement* root);
+    };
+}
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef CONTROL_FLOW_GRAPH_H
+#define CONTROL_FLOW_GRAPH_H
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "code_object.hpp"
+
+namespace compiler
+{
+    struct BasicBlock;
+
+    // Інструкція проміжного представлення. Переходи посилаються на блоки, а не на адреси
+    struct IrInstruction
+    {
+        vm::OpCode op;
+        vm::WORD operand = 0;
+        std::optional<vm::WORD> argument; // Додаткове слово CALL_NA, CALL_METHOD_NA та TAIL_CALL_NA
+        std::optional<vm::WORD> lineno; // Рядок коду, з якого згенеровано інструкцію
+        BasicBlock* target = nullptr; // Ціль переходу
+    };
+
+    // Частини діапазону обробника винятків
+    enum class HandlerSection
+    {
+        TRY_BODY, HANDLERS, FINALLY
+    };
+
+    struct BasicBlock
+    {
+        // Перехід можливий лише в останній інструкції. Безумовні переходи не зберігаються
+        // як інструкції, їх ціль - next
+        std::vector<IrInstruction> instructions;
+        // Блок, в який виконання переходить після останньої інструкції, якщо вона не перейшла.
+        // nullptr, якщо блок завершується RETURN, хвостовим викликом або RAISE
+        BasicBlock* next = nullptr;
+        size_t position = 0; // Індекс в ControlFlowGraph::layout
+
+        // Заповнюються ControlFlowGraph::analyze
+        std::vector<BasicBlock*> predecessors; // Разом з блоками, з яких сюди веде виняток
+        BasicBlock* exceptionTarget = nullptr; // Куди переходить виконання при винятку в блоці
+        // Найглибший обробник, діапазон якого містить блок, та частина цього діапазону.
+        // Блоки з однаковою областю можна переставляти між собою без зміни обробки винятків
+        std::optional<std::pair<size_t, HandlerSection>> region;
+        // Блок починає чи завершує частину діапазону обробника: його адреса записується
+        // в ExceptionHandler, тому перед ним не можна розміщувати інші блоки
+        bool isHandlerBoundary = false;
+        bool isReachable = false;
+        BasicBlock* immediateDominator = nullptr;
+        size_t postorder = 0;
+    };
+
+    // Обробник винятків, межі діапазону якого задаються блоками
+    struct IrExceptionHandler
+    {
+        BasicBlock* start; // Блок, що завершується TRY
+        BasicBlock* firstHandler;
+        BasicBlock* end; // Блок, що починається з END_TRY
+        BasicBlock* finally = nullptr;
+    };
+
+    // Цикл, знайдений за зворотними дугами графа
+    struct Loop
+    {
+        BasicBlock* header;
+        std::vector<BasicBlock*> blocks; // Разом з header
+    };
+
+    // Граф потоку керування CodeObject з базових блоків інструкцій стекової машини.
+    // Будується з байткоду, згенерованого компілятором, і записується назад після оптимізацій
+    class ControlFlowGraph
+    {
+    private:
+        std::vector<std::unique_ptr<BasicBlock>> blocks;
+    public:
+        // Порядок розміщення блоків у коді. Перший блок - вхід
+        std::vector<BasicBlock*> layout;
+        // В порядку CodeObject::exceptionHandlers: вкладені обробники перед зовнішніми
+        std::vector<IrExceptionHandler> handlers;
+
+        BasicBlock* createBlock();
+        // Оновлює BasicBlock::position після зміни layout
+        void updatePositions();
+        // Цілі переходів з блоку без урахування винятків
+        static std::vector<BasicBlock*> successors(BasicBlock* block);
+        // Заповнює аналітичні поля BasicBlock. Викликається після зміни графа
+        void analyze();
+        bool dominates(BasicBlock* dominator, BasicBlock* block) const;
+        // Цикли з досяжними заголовками. Цикли з одним заголовком об'єднуються
+        std::vector<Loop> findLoops() const;
+
+        // Ділить байткод CodeObject на блоки. Переходи в JMP та порожні блоки
+        // спрямовуються одразу в їх ціль
+        void build(vm::CodeObject* codeObject);
+        // Записує граф в code, ipToLineno та exceptionHandlers. Якщо після блоку в layout
+        // розміщено не його next, додається JMP
+        void linearize(vm::CodeObject* codeObject);
+    };
+}
+
+#endif
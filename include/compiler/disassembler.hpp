@@ -1,16 +1,48 @@
 #ifndef DISASSEMBLER_H
 #define DISASSEMBLER_H
 
+#include <optional>
+#include <vector>
+
 #include "code_object.hpp"
 
 namespace compiler
 {
+    // Інструкція, прочитана з байткоду CodeObject
+    struct DecodedInstruction
+    {
+        vm::OpCode op;
+        vm::WORD operand; // Для переходів - адреса цілі
+        std::optional<vm::WORD> argument; // Додаткове слово CALL_NA, CALL_METHOD_NA та TAIL_CALL_NA
+        std::optional<vm::WORD> lineno; // Заданий, якщо з інструкції починається новий рядок коду
+    };
+
+    // Інструкції CodeObject в порядку адрес
+    struct DecodedCode
+    {
+        vm::CodeObject* codeObject;
+        std::vector<DecodedInstruction> instructions;
+        // Індекс інструкції для кожної адреси, з якої вона починається
+        std::vector<size_t> indexByAddress;
+
+        // Індекс інструкції за адресою переходу або обробника винятків. Адреса, яка не є
+        // початком інструкції, завершує процес
+        size_t toIndex(vm::WORD address) const;
+    };
+
     class Disassembler
     {
     private:
-        int opCodeLenArguments(vm::OpCode code);
         std::string getValueAsString(vm::Object* object);
     public:
+        // Кількість аргументів опкоду. Аргументи, крім першого, займають окремі слова коду
+        static int opCodeLenArguments(vm::OpCode code);
+        // Інструкції, операнд яких є адресою переходу
+        static bool isJump(vm::OpCode code);
+        // Після цих інструкцій виконання не переходить до наступної
+        static bool isTerminator(vm::OpCode code);
+        // Читає інструкції з байткоду, згенерованого компілятором
+        static DecodedCode decode(vm::CodeObject* codeObject);
         std::string disassemble(vm::CodeObject* codeObject);
     };
 }
@@ -0,0 +1,58 @@
+#ifndef PEEPHOLE_OPTIMIZER_H
+#define PEEPHOLE_OPTIMIZER_H
+
+#include <optional>
+#include <vector>
+
+#include "code_object.hpp"
+
+namespace compiler
+{
+    // Оптимізує згенерований байткод: спрямовує переходи на JMP одразу в їх ціль, видаляє
+    // недосяжний код та переходи на наступну інструкцію, замінює STORE_LOCAL x; LOAD_LOCAL x
+    // на DUP; STORE_LOCAL x і видаляє пари LOAD_CONST; POP. Адреси переходів, номери рядків
+    // та адреси обробників винятків переносяться на нові позиції інструкцій
+    class PeepholeOptimizer
+    {
+    private:
+        struct Instruction
+        {
+            vm::OpCode op;
+            // Для переходів - індекс цільової інструкції, а не адреса
+            vm::WORD operand;
+            std::optional<vm::WORD> argument; // Додаткове слово CALL_NA, CALL_METHOD_NA та TAIL_CALL_NA
+            std::optional<vm::WORD> lineno;
+            bool removed = false;
+        };
+
+        // Адреси ExceptionHandler як індекси інструкцій
+        struct Handler
+        {
+            size_t start;
+            size_t firstHandler;
+            size_t end;
+            std::optional<size_t> finally;
+            bool removed = false;
+        };
+
+        std::vector<Instruction> instructions;
+        std::vector<Handler> handlers;
+
+        void decode(vm::CodeObject* codeObject);
+        void encode(vm::CodeObject* codeObject);
+        // Прибирає інструкції, позначені removed. Переходи на них спрямовуються
+        // на наступну інструкцію, що залишилась
+        void compact();
+        // Кожен прохід повертає true, якщо змінив код
+        bool threadJumps();
+        bool removeUnreachable();
+        bool combinePairs();
+        void optimizeCodeObject(vm::CodeObject* codeObject);
+    public:
+        // Оптимізує codeObject і всі вкладені в нього CodeObject. Виконується до верифікації,
+        // яка обчислює глибину стеку вже для оптимізованого коду
+        void optimize(vm::CodeObject* codeObject);
+    };
+}
+
+#endif
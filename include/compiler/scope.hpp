@@ -3,11 +3,12 @@
 
 #include <iostream>
 #include <unordered_map>
-#include <map>
 #include <vector>
 #include <string>
+#include <string_view>
 
 #include "ast.hpp"
+#include "arena.hpp"
 #include "vm.hpp"
 
 namespace compiler
@@ -22,33 +23,36 @@ namespace compiler
         GLOBAL, LOCAL, CELL,
     };
 
+    // Області видимості живуть в арені компіляції разом з AST, імена змінних вказують
+    // на текст токенів
     struct Scope
     {
+        ARENA_ALLOCATED
         ScopeType type;
         Scope* parent;
-        std::unordered_map<std::string, VariableType> variableInfo;
-        std::vector<std::string> locals;
-        std::vector<std::string> cells;
-        std::vector<std::string> freeVariables;
+        ast::ArenaMap<std::string_view, VariableType> variableInfo;
+        ast::ArenaVector<std::string_view> locals;
+        ast::ArenaVector<std::string_view> cells;
+        ast::ArenaVector<std::string_view> freeVariables;
 
-        void addLocal(const std::string& name);
-        void addCell(const std::string& name);
-        void addFree(const std::string& name);
+        void addLocal(std::string_view name);
+        void addCell(std::string_view name);
+        void addFree(std::string_view name);
 
         // Переносить змінну з LOCAL до CELL
-        void promote(const std::string& name, Scope* owner);
-        void maybePromote(const std::string& name);
-        std::pair<Scope*, VariableType> resolve(const std::string& name, VariableType type);
+        void promote(std::string_view name, Scope* owner);
+        void maybePromote(std::string_view name);
+        std::pair<Scope*, VariableType> resolve(std::string_view name, VariableType type);
 
-        vm::OpCode getVarGetter(const std::string& name);
-        vm::OpCode getVarSetter(const std::string& name);
-        vm::OpCode getVarDeleter(const std::string& name);
+        vm::OpCode getVarGetter(std::string_view name);
+        vm::OpCode getVarSetter(std::string_view name);
+        vm::OpCode getVarDeleter(std::string_view name);
     };
 
     class ScopeAnalyzer
     {
     public:
-        using scope_info_t = std::map<const ast::Node*, Scope*>;
+        using scope_info_t = ast::ArenaMap<const ast::Node*, Scope*>;
     private:
         scope_info_t scopeInfo;
         ast::BlockStatement* rootNode;
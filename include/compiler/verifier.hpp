@@ -0,0 +1,34 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include <string>
+
+#include "code_object.hpp"
+
+namespace compiler
+{
+    // Обходить граф переходів байткоду, обчислює найбільшу глибину стеку операндів
+    // та перевіряє, що в кожну інструкцію всі шляхи приходять з однаковою глибиною стеку.
+    // Також перевіряє опкоди, межі операндів та розмітку фрейму, тому використовується
+    // і для байткоду, прочитаного з кешу або образу
+    class Verifier
+    {
+    private:
+        std::string error;
+
+        bool verifyCodeObject(vm::CodeObject* codeObject, bool isFunction);
+        bool verifyNested(vm::CodeObject* codeObject, bool isFunction);
+        // Запам'ятовує першу помилку
+        void fail(std::string message);
+    public:
+        // Заповнює maxStackDepth та глибини обробників винятків для CodeObject модуля
+        // і всіх вкладених в нього CodeObject. Повертає false, якщо байткод некоректний
+        bool verify(vm::CodeObject* codeObject);
+        // Те саме для CodeObject функції, тіло якої скомпільоване окремо від модуля
+        bool verifyFunction(vm::CodeObject* codeObject);
+        // Опис першої знайденої помилки
+        const std::string& getError() const;
+    };
+}
+
+#endif
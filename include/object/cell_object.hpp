@@ -10,7 +10,7 @@ namespace vm
     // Допоміжний об'єкт для зберігання вільних змінних в замиканнях
     struct CellObject : Object
     {
-        Object* value;
+        ObjectRef value;
 
         static CellObject* create(Object* value);
     };
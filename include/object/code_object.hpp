@@ -6,24 +6,51 @@
 #include <map>
 #include <optional>
 #include <functional>
+#include <span>
 
 #include "object.hpp"
 #include "vm.hpp"
 #include "program_source.hpp"
 
+namespace compiler
+{
+    struct DeferredBody;
+    struct ImageBody;
+}
+
 namespace vm
 {
     extern TypeObject codeObjectType;
 
     struct ExceptionHandler
     {
-        Object** stackTop; // Для відновлення стеку опкод TRY записує його вершину
+        WORD stackDepth; // Глибина стеку операндів на опкоді TRY, до неї стек відновлюється
         WORD startAddress; // Адрес опкоду TRY
         WORD firstHandlerAddress; // Адрес першого обробника
         WORD endAddress; // Адрес END_TRY
         WORD finallyAddress; // Адрес початку блоку "наприкінці", якщо 0, то блок відсутній
     };
 
+    // Запис таблиці рядків образу байткоду
+    struct LinenoEntry
+    {
+        WORD ip;
+        WORD lineno;
+    };
+
+    // Розмітка фрейму функції, обчислюється компілятором один раз для кожного CodeObject.
+    // Фрейм: [функція, аргументи, варіативний аргумент, аргументи за замовчуванням,
+    //  інші локальні змінні, комірки, вільні змінні]
+    struct FrameLayout
+    {
+        WORD argumentSlots = 0; // Слоти, заповнені при виклику, разом зі слотом функції
+        WORD localCount = 0;
+        WORD cellCount = 0;
+        WORD freevarCount = 0;
+        // Пари (індекс комірки, індекс локальної змінної) для аргументів, які є комірками
+        std::vector<std::pair<WORD, WORD>> argumentCells;
+    };
+
     struct CodeObject : Object
     {
         std::string name;
@@ -36,18 +63,56 @@ namespace vm
         std::vector<std::string> locals;
         std::vector<std::string> cells;
         std::vector<std::string> freevars;
-        std::vector<std::string> argsAsCells; // Імена аргументів, які є комірками
         std::vector<std::string> defaults; // Імена параметрів за замовчуванням
         // Ключ - номер опкода, значення - номер лінії в коді
         std::map<WORD, WORD> ipToLineno;
+        // Байткод та таблиця рядків, позичені з відображеного в пам'ять образу байткоду.
+        // Якщо вони задані, code та ipToLineno порожні. Пам'ять належить образу
+        std::span<const WORD> borrowedCode;
+        std::span<const LinenoEntry> borrowedLinenos; // Впорядкована за ip
         std::vector<ExceptionHandler> exceptionHandlers;
+        FrameLayout frameLayout;
+        // Найбільша кількість слотів стеку операндів, обчислюється верифікатором байткоду
+        WORD maxStackDepth = 0;
+        // Тіло функції, компіляцію якого відкладено до першого виклику (лінива компіляція).
+        // Розмітка фрейму, імена змінних та параметри вже заповнені, а байткоду ще немає.
+        // nullptr, якщо тіло скомпільоване
+        compiler::DeferredBody* deferredBody = nullptr;
+        // Тіло функції з образу байткоду, яке читається та верифікується при першому виклику.
+        // Як і у відкладеного тіла, заповнені лише параметри та розмітка фрейму.
+        // nullptr, якщо тіло прочитане
+        compiler::ImageBody* imageBody = nullptr;
 
+        // Байткод для виконання: власний або позичений з образу
+        inline const WORD* instructions() const
+        {
+            return borrowedCode.empty() ? code.data() : borrowedCode.data();
+        }
+        // Номер рядка коду, з якого згенеровано інструкцію за адресою ip
+        WORD getLineno(WORD ip) const;
         std::optional<ExceptionHandler*> getExceptionHandler(WORD ip);
         ExceptionHandler* getHandlerByStartIp(WORD ip);
         ExceptionHandler* getHandlerByEndIp(WORD ip);
+        // Заповнює frameLayout, викликається після встановлення arity, locals, cells та freevars
+        void computeFrameLayout();
+        // Кількість слотів стеку, потрібних фрейму, починаючи з bp
+        inline WORD frameSize() const
+        {
+            return frameLayout.localCount + frameLayout.cellCount + frameLayout.freevarCount + maxStackDepth;
+        }
 
         static CodeObject* create(std::string name);
     };
 }
 
+namespace compiler
+{
+    // Компілює відкладене тіло codeObject. Синтаксичні помилки в тілі завершують процес,
+    // як і при компіляції модуля
+    void compileDeferredBody(vm::CodeObject* codeObject);
+    // Читає з образу тіло codeObject і верифікує його. Якщо образ пошкоджений,
+    // встановлює виняток і повертає false
+    bool loadImageBody(vm::CodeObject* codeObject);
+}
+
 #endif
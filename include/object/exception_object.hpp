@@ -18,6 +18,7 @@ namespace vm
     extern TypeObject DivisionByZeroErrorObjectType;
     extern TypeObject ValueErrorObjectType;
     extern TypeObject InternalErrorObjectType;
+    extern TypeObject MemoryErrorObjectType;
 
     struct StackTraceItem
     {
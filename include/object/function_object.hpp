@@ -9,6 +9,8 @@
 
 namespace vm
 {
+    struct Frame;
+
     extern TypeObject functionObjectType;
 
     struct FunctionObject : Object
@@ -19,6 +21,14 @@ namespace vm
 
         static FunctionObject* create(CodeObject* code);
     };
+
+    // Готує frame до виконання fn: викликана функція та аргументи вже розміщені
+    // в стеку, починаючи з frame->bp. Решта полів frame не змінюється
+    void initFunctionFrame(Frame* frame, FunctionObject* fn);
+    // Компілює або читає з образу тіло fn, відкладене до першого виклику, і оновлює розмір
+    // її фрейму. Викликається перед перевіркою місця в стеку, якщо в fn встановлено
+    // IS_DEFERRED. Повертає false з встановленим винятком, якщо тіло з образу пошкоджене
+    bool compileDeferredFunction(FunctionObject* fn);
 }
 
 #endif
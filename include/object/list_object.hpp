@@ -11,7 +11,7 @@ namespace vm
 
     struct ListObject : Object
     {
-        std::vector<Object*> items;
+        std::vector<ObjectRef> items;
 
         static ListObject* create();
     };
@@ -20,9 +20,9 @@ namespace vm
     {
         size_t position = 0;
         size_t length;
-        std::vector<Object*> iterable;
+        std::vector<ObjectRef> iterable;
 
-        static ListIterObject* create(const std::vector<Object*> iterable);
+        static ListIterObject* create(const std::vector<ObjectRef> iterable);
     };
 }
 
@@ -1,26 +1,33 @@
 #ifndef OBJECT_H
 #define OBJECT_H
 
+#include <new>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include <span>
 #include <optional>
+#include <type_traits>
 
 #include "types.hpp"
+#include "object_ref.hpp"
 
-#define DEFAULT_ALLOC(objectStruct)        \
-    []()                                   \
-    {                                      \
-        auto newObject = new objectStruct; \
-        return (vm::Object*)newObject;     \
+#define DEFAULT_ALLOC(objectStruct)                                                       \
+    []()                                                                                  \
+    {                                                                                     \
+        auto newObject = new (vm::allocObjectMemory(sizeof(objectStruct))) objectStruct; \
+        return (vm::Object*)newObject;                                                    \
     }
 
-#define DEFAULT_DEALLOC(objectStruct) \
-    [](vm::Object* o)                 \
-    {                                 \
-        delete (objectStruct*)o;      \
-    }
+// Лише викликає деструктор, пам'ять об'єкта звільняє збирач сміття.
+// Для типів з тривіальним деструктором dealloc не встановлюється
+#define DEFAULT_DEALLOC(objectStruct)                                \
+    (std::is_trivially_destructible_v<objectStruct>                  \
+        ? nullptr                                                    \
+        : static_cast<vm::deallocFunction>([](vm::Object* o)         \
+        {                                                            \
+            ((objectStruct*)o)->~objectStruct();                     \
+        }))
 
 #define OBJECT_STATIC_METHOD(func, name, arity, variadic, defaults) \
     static const char* func##__methodName = name;                   \
@@ -90,6 +97,7 @@ namespace vm
     using deallocFunction    = void (*)(Object*);
     using comparisonFunction = vm::Object* (*)(Object*, Object*, ObjectCompOperator);
     using traverseFunction   = void (*)(Object*);
+    using sizeFunction       = u64 (*)(Object*);
 
     struct ObjectOperators
     {
@@ -129,7 +137,14 @@ namespace vm
     struct Object
     {
         TypeObject* objectType = &typeObjectType;
-        bool marked = false;
+        // Об'єкт може бути звільнений збирачем сміття. Статичні, безсмертні та заморожені
+        // об'єкти не позначаються і не прибираються. Позначки інших об'єктів зберігаються
+        // в бітових мапах сторінок купи
+        bool collectable = false;
+#ifdef COMPRESSED_REFERENCES
+        // Індекс в compressed::externalObjects для об'єктів поза купою, 0 - ще не зареєстрований
+        u32 externalIndex = 0;
+#endif
 
         // Викликає об'єкт
         Object* call(std::span<Object*>, NamedArgs* na=nullptr);
@@ -138,6 +153,10 @@ namespace vm
         // Також очищає стек від аргументів
         Object* stackCall(Object**& sp, u64 argc, NamedArgs* na=nullptr);
 
+        // Перевіряє виклик об'єкта з підтримкою stackCall і доповнює аргументи в стеку
+        // варіативним аргументом та значеннями за замовчуванням
+        bool prepareStackCall(Object**& sp, u64 argc, NamedArgs* na=nullptr);
+
         // Викликає операції порівяння для вхідних об'єктів
         Object* compare(Object* o, ObjectCompOperator op);
 
@@ -198,6 +217,9 @@ namespace vm
         WORD arity = 0;
         std::string name;
         DefaultParameters* defaults = nullptr;
+        // Слоти стеку, потрібні фрейму разом зі слотом функції та аргументами.
+        // Для функцій, які не використовують стек віртуальної машини, 0
+        WORD frameSize = 0;
         u8 flags = 0;
 
         enum Flags : u8
@@ -205,6 +227,8 @@ namespace vm
             IS_VARIADIC = 1 << 0,
             IS_METHOD = 1 << 1,
             HAS_DEFAULTS = 1 << 2,
+            // Тіло функції ще не скомпільоване, frameSize не враховує стек операндів
+            IS_DEFERRED = 1 << 3,
         };
     };
 
@@ -214,7 +238,9 @@ namespace vm
         std::string name;
         u32 size = 0;
         size_t callableInfoOffset = 0; // offsetof для поля, де зберігається CallableInfo
-        allocFunction alloc = nullptr; // Створення нового екземпляра
+        // Створення нового екземпляра, пам'ять повинна виділятись через vm::allocObjectMemory
+        allocFunction alloc = nullptr;
+        // Знищення екземпляра без звільнення його пам'яті
         deallocFunction dealloc = nullptr;
         CallableInfo callableInfo;
         callFunction constructor = nullptr; // Ініціалізація екземпляра
@@ -226,6 +252,10 @@ namespace vm
         // Потрібно використати метод mark(Object*) до кожного об'єкту
         traverseFunction traverse = nullptr;
 
+        // Повертає розмір пам'яті, яку об'єкт виділив поза своєю структурою.
+        // Використовується для знімків купи
+        sizeFunction payloadSize = nullptr;
+
         // Зберігає методи та поля
         std::unordered_map<std::string, Object*> attributes;
     };
@@ -234,6 +264,8 @@ namespace vm
     extern const char* constructorName;
 
     void mark(Object* o);
+    // Виділяє пам'ять для об'єкта в купі поточного інтерпретатора
+    void* allocObjectMemory(size_t size);
     Object* allocObject(TypeObject* objectType);
     bool isInstance(const Object* o, const TypeObject& type);
 
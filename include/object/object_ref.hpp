@@ -0,0 +1,82 @@
+#ifndef OBJECT_REF_HPP
+#define OBJECT_REF_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "types.hpp"
+#include "exports.hpp"
+
+#ifdef COMPRESSED_REFERENCES
+// Розмір діапазону адрес, в якому розміщуються сторінки всіх куп процесу.
+// Об'єкти вирівняні на 16 байт, тому зміщення, поділене на 8, парне і вміщається в 32 біти
+constexpr const size_t COMPRESSED_HEAP_SIZE = size_t(8) << 32;
+#endif
+
+namespace vm
+{
+    struct Object;
+
+#ifdef COMPRESSED_REFERENCES
+    namespace compressed
+    {
+        // Початок діапазону COMPRESSED_HEAP_SIZE. Резервується при створенні першої купи,
+        // тому до цього стиснені посилання не створюються
+        API extern std::byte* heapBase;
+        // Об'єкти поза купою (статичні), на які є стиснені посилання. Елемент 0 - nullptr
+        API extern std::vector<Object*> externalObjects;
+
+        // Реєструє об'єкт поза купою і повертає його посилання
+        API u32 encodeExternal(Object* o);
+
+        inline u32 encode(Object* o)
+        {
+            auto offset = reinterpret_cast<uintptr_t>(o) - reinterpret_cast<uintptr_t>(heapBase);
+            if (offset < COMPRESSED_HEAP_SIZE)
+            {
+                return static_cast<u32>(offset >> 3);
+            }
+            return encodeExternal(o);
+        }
+
+        inline Object* decode(u32 value)
+        {
+            // Непарні значення - індекси в externalObjects
+            if (value & 1)
+            {
+                return externalObjects[value >> 1];
+            }
+            return reinterpret_cast<Object*>(heapBase + (static_cast<uintptr_t>(value) << 3));
+        }
+    }
+#endif
+
+    // Посилання на об'єкт в елементах контейнерів. В звичайній збірці це вказівник,
+    // а зі стисненими посиланнями (COMPRESSED_REFERENCES) - 32-бітне значення: зміщення
+    // об'єкта від початку купи або індекс статичного об'єкта
+    class ObjectRef
+    {
+    private:
+#ifdef COMPRESSED_REFERENCES
+        u32 value = 1;
+#else
+        Object* value = nullptr;
+#endif
+    public:
+        ObjectRef() = default;
+
+#ifdef COMPRESSED_REFERENCES
+        ObjectRef(Object* o) : value(compressed::encode(o)) {}
+        inline Object* get() const { return compressed::decode(value); }
+#else
+        ObjectRef(Object* o) : value(o) {}
+        inline Object* get() const { return value; }
+#endif
+
+        inline operator Object*() const { return get(); }
+        inline Object* operator->() const { return get(); }
+    };
+}
+
+#endif
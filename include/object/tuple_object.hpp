@@ -11,7 +11,7 @@ namespace vm
 
     struct TupleObject : Object
     {
-        std::vector<Object*> items;
+        std::vector<ObjectRef> items;
 
         static TupleObject* create();
     };
@@ -0,0 +1,67 @@
+#ifndef LEXER_HPP
+#define LEXER_HPP
+
+#include <string_view>
+#include <vector>
+
+#include "string_enum.hpp"
+#include "types.hpp"
+
+namespace parser
+{
+    STRING_ENUM(TokenKind,
+        END, ERROR,
+        IDENTIFIER, INTEGER, REAL, STRING, APOSTROPHE,
+
+        // Ключові слова
+        K_IF, K_OR, K_ELSE, K_END, K_WHILE, K_CONTINUE, K_BREAK, K_LESS, K_GREATER,
+        K_EQUAL, K_NOT_EQUAL, K_IS, K_NOT, K_AND, K_FUNCTION, K_RETURN, K_FOR_EACH,
+        K_TRY, K_CATCH, K_AS, K_FINALLY, K_RAISE,
+
+        // Розділові знаки
+        LPAREN, RPAREN, COMMA, DOT, ELLIPSIS, SEMICOLON,
+
+        // Оператори
+        PLUS, MINUS, STAR, SLASH, SLASH_SLASH, PERCENT,
+        EQUAL, PLUS_EQUAL, MINUS_EQUAL, STAR_EQUAL, SLASH_EQUAL, SLASH_SLASH_EQUAL, PERCENT_EQUAL
+    )
+
+    struct LexToken
+    {
+        TokenKind kind;
+        u32 start; // Зсув початку токена в байтах
+        u32 end; // Зсув кінця токена в байтах
+        u32 lineno;
+        u32 col; // Позиція в рядку в байтах, починаючи з 1
+        bool spaceBefore; // Перед токеном є пробільні символи або коментар
+    };
+
+    // Розбиває UTF-8 текст програми на токени за один прохід.
+    // Ключові слова розпізнаються за допомогою досконалої хеш-функції.
+    class Lexer
+    {
+    private:
+        std::string_view text;
+        size_t position = 0;
+        u32 lineno = 1;
+        size_t lineStart = 0;
+
+        // Пропускає пробільні символи та коментарі, повертає істину, якщо щось було пропущено
+        bool skipTrivia();
+        void skipPrologue();
+        void lexWord(LexToken& token);
+        void lexNumber(LexToken& token);
+        void lexString(LexToken& token);
+        void lexPunctuation(LexToken& token);
+        LexToken next();
+    public:
+        std::vector<LexToken> tokenize();
+
+        Lexer(std::string_view text);
+    };
+
+    // Повертає тип ключового слова або TokenKind::IDENTIFIER, якщо слово не є ключовим
+    TokenKind keywordKind(std::string_view word);
+}
+
+#endif
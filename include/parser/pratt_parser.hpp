@@ -0,0 +1,84 @@
+#ifndef PRATT_PARSER_HPP
+#define PRATT_PARSER_HPP
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.hpp"
+#include "lexer.hpp"
+
+namespace parser
+{
+    // Рукописний парсер: інструкції розбираються рекурсивним спуском,
+    // вирази - методом Пратта. Будує ті самі вузли ast::, що й парсер,
+    // згенерований з граматики барвінок.граматика, та видає ті самі повідомлення про помилки.
+    class PrattParser
+    {
+    public:
+        using error_handler_t = std::function<void(std::string, size_t)>;
+    private:
+        // Пріоритети бінарних операторів, від найменшого
+        enum class Precedence
+        {
+            LOWEST, DISJUNCTION, CONJUNCTION, INVERSION, COMPARISON, SUM, TERM,
+        };
+
+        std::string_view text;
+        std::vector<LexToken> tokens;
+        size_t current = 0;
+        // Найдальша позиція, на якій розбір не вдався, для повідомлення про помилку
+        size_t furthestFailure = 0;
+        error_handler_t errorHandler;
+
+        const LexToken& peek(size_t offset = 0) const;
+        const LexToken& advance();
+        bool check(TokenKind kind) const;
+        bool match(TokenKind kind);
+        const LexToken& expect(TokenKind kind);
+        // Перевіряє, що перед поточним токеном є пробільні символи
+        void expectSpace();
+        bool separatedBySingleSpace(const LexToken& a, const LexToken& b) const;
+        std::string_view tokenText(const LexToken& token) const;
+        ast::Token makeToken(const LexToken& token) const;
+        // Текст токенів вказує в текст програми, тому він повинен жити довше за AST
+        ast::Token makeToken(std::string_view text, const LexToken& token) const;
+        ast::Token expectIdentifier();
+
+        // Розбір не вдався, парсер може повернутись на збережену позицію
+        [[noreturn]] void fail();
+        // Помилка з власним повідомленням, розбір припиняється
+        [[noreturn]] void error(const std::string& message, size_t position);
+
+        ast::BlockStatement* parseProgram();
+        ast::BlockStatement* parseBlock();
+        ast::Statement* parseStatement();
+        ast::IfStatement* parseIfStatement();
+        // Розбирає "якщо" разом з гілками "або якщо" та "інакше", без завершального "кінець"
+        ast::IfStatement* parseIfChain();
+        ast::WhileStatement* parseWhileStatement();
+        ast::ForEachStatement* parseForEachStatement();
+        ast::ReturnStatement* parseReturnStatement();
+        ast::FunctionDeclaration* parseFunctionDeclaration();
+        ast::TryCatchStatement* parseTryCatchStatement();
+        ast::RaiseStatement* parseRaiseStatement();
+
+        ast::Expression* parseExpression();
+        ast::Expression* parseRhs(Precedence precedence = Precedence::LOWEST);
+        ast::Expression* parseFactor();
+        ast::Expression* parsePrimary();
+        ast::Expression* parseNumber(const LexToken* sign);
+        ast::Expression* parseStrings();
+        ast::CallExpression* parseCall(ast::Expression* callable);
+        std::optional<std::pair<Precedence, std::string_view>> binaryOperator(size_t& length) const;
+    public:
+        void setErrorHandler(error_handler_t handler);
+        std::optional<ast::BlockStatement*> parse();
+
+        PrattParser(std::string_view text);
+    };
+}
+
+#endif
@@ -3,12 +3,30 @@
 
 #include <string>
 #include <filesystem>
+#include <functional>
 
 #include "object.hpp"
 #include "exception_object.hpp"
 #include "exports.hpp"
 #include "program_source.hpp"
 #include "gc.hpp"
+#include "phase_timer.hpp"
+
+namespace vm
+{
+    struct Frame;
+}
+
+namespace ast
+{
+    class Arena;
+}
+
+namespace compiler
+{
+    class BytecodeImage;
+    class Compiler;
+}
 
 namespace periwinkle
 {
@@ -18,6 +36,25 @@ namespace periwinkle
         ProgramSource* source;
         vm::ExceptionObject* currentException = nullptr;
         vm::GC* gc = nullptr;
+        bool useBytecodeCache = true;
+        std::filesystem::path cacheDirectory;
+        // Образ, з якого запускається програма, якщо інтерпретатор створено з файлу образу
+        compiler::BytecodeImage* image = nullptr;
+        // Завантаження програми вимірюється завжди, бо відбувається в конструкторі,
+        // решта етапів - лише після enablePhaseReport
+        PhaseTimer* phaseTimer = nullptr;
+        std::function<void(const PhaseReport&)> phaseReportHandler;
+
+        bool lazyCompilation = false;
+        // Компілятор та арена з AST програми, які потрібні для тіл функцій, відкладених
+        // до першого виклику
+        compiler::Compiler* deferredCompiler = nullptr;
+        ast::Arena* deferredArena = nullptr;
+
+        // Розбирає та компілює текст програми, при помилці синтаксису завершує процес.
+        // Якщо lazy істинне, тіла функцій компілюються при першому виклику
+        vm::Frame* compileSource(bool lazy);
+        void deleteDeferredCompiler();
     public:
         // Повертає версію як число, 2 цифри на значення.
         //  Наприклад: версія 1.10.2, то повернеться чило 11002
@@ -40,6 +77,48 @@ namespace periwinkle
         void exceptionClear();
         void printException() const;
         vm::GC* getGC();
+        // Статистика збирача сміття, включно з кількістю живих об'єктів кожного типу
+        vm::GCStats getGCStats() const;
+        // Встановлює налаштування розміру купи для цього інтерпретатора
+        void setGCPolicy(const vm::GCPolicy& policy);
+        vm::GCPolicy getGCPolicy() const;
+        // Записує знімок купи у файл. Формат описаний в heap_dump.hpp,
+        // для аналізу знімка є скрипт tools/heap_dump/summarize.py
+        bool dumpHeap(const std::filesystem::path& path);
+        // Переносить всі живі об'єкти в постійне покоління. Потрібно викликати перед fork(),
+        // щоб збирання сміття в дочірніх процесах не робили спільні сторінки пам'яті приватними
+        void freezeHeap();
+        // Вмикає режим арени для коротких запусків: збирач сміття не працює, а всі об'єкти
+        // звільняються разом зі сторінками купи в деструкторі інтерпретатора без обходу
+        // кожного об'єкта. Поодинці знищуються лише об'єкти типів з деструктором.
+        // Викликається перед execute. Результат execute живе лише до знищення інтерпретатора,
+        // тому потрібні дані слід скопіювати до цього
+        void enableArena();
+        // Вмикає або вимикає кеш скомпільованого коду для програм з файлу. Кеш ввімкнено
+        // за замовчуванням і зберігається в directory, а якщо вона порожня - в теці "__кеш__"
+        // поруч з файлом програми. Викликається перед execute
+        void setBytecodeCache(bool enabled, const std::filesystem::path& directory = {});
+        // Компілює програму та записує її образ, який можна запустити замість файлу програми.
+        // Образ відображається в пам'ять без розбору та компіляції, а процеси, які запускають
+        // один образ, поділяють сторінки з байткодом. Програма не виконується
+        bool writeImage(const std::filesystem::path& path);
+        // Вмикає ліниву компіляцію: тіло функції компілюється при її першому виклику, тому
+        // час запуску залежить лише від коду, який виконується. Області видимості, замикання
+        // та розмітка фреймів все одно визначаються для всієї програми, а тіла функцій
+        // перевіряються без генерації коду, тому помилки компіляції знаходяться до запуску,
+        // як і без лінивої компіляції.
+        // Програма, скомпільована ліниво, не записується в кеш. Викликається перед execute
+        void setLazyCompilation(bool enabled);
+        // Вмикає вимірювання етапів запуску: завантаження програми, розбору, аналізу областей
+        // видимості, компіляції, виконання та прибирання купи, а також читання і запису кешу
+        // чи образу, якщо вони використовуються. Для кожного етапу записується час, пік RSS
+        // та кількість створених і живих об'єктів. Звіт передається в handler в деструкторі
+        // інтерпретатора, коли всі етапи завершені. Викликається перед execute
+        void enablePhaseReport(std::function<void(const PhaseReport&)> handler);
+        // Звіт про вже завершені етапи
+        const PhaseReport& getPhaseReport() const;
+        // Повертає nullptr, якщо вимірювання етапів не ввімкнене
+        PhaseTimer* getPhaseTimer();
 
 #ifdef DEV_TOOLS
         void printDisassemble();
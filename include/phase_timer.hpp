@@ -0,0 +1,73 @@
+#ifndef PHASE_TIMER_HPP
+#define PHASE_TIMER_HPP
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+#include "exports.hpp"
+
+namespace vm
+{
+    class GC;
+}
+
+namespace periwinkle
+{
+    // Вимірювання одного етапу запуску програми
+    struct PhaseStats
+    {
+        std::string name;
+        u64 durationUs = 0;
+        // Найбільший RSS процесу на кінець етапу. Пік не зменшується, тому етап,
+        // після якого він виріс, і є етапом, який його підняв
+        u64 peakRssBytes = 0;
+        u64 allocatedObjects = 0; // Об'єкти купи, створені під час етапу
+        u64 allocatedBytes = 0;
+        u64 permanentObjects = 0; // Безсмертні об'єкти (константи, CodeObject), створені під час етапу
+        u64 liveObjects = 0; // Живі об'єкти купи на кінець етапу
+    };
+
+    struct API PhaseReport
+    {
+        // Етапи в порядку виконання
+        std::vector<PhaseStats> phases;
+
+        // Таблиця етапів для виводу в термінал
+        std::string format() const;
+    };
+
+    // Записує час, пік RSS та лічильники збирача сміття для етапів запуску. Етапи не можуть
+    // бути вкладеними. Лічильники збирача беруться без обходу купи, тому вимірювання
+    // не змінює час самих етапів
+    class PhaseTimer
+    {
+    private:
+        vm::GC* gc;
+        PhaseReport report;
+        PhaseStats current;
+        std::chrono::steady_clock::time_point start;
+        bool running = false;
+    public:
+        void begin(const char* name);
+        void end();
+        const PhaseReport& getReport() const;
+
+        PhaseTimer(vm::GC* gc);
+    };
+
+    // Вимірює етап до кінця області видимості. Якщо timer - nullptr, нічого не робить
+    class PhaseScope
+    {
+    private:
+        PhaseTimer* timer;
+    public:
+        PhaseScope(PhaseTimer* timer, const char* name);
+        PhaseScope(const PhaseScope&) = delete;
+        PhaseScope& operator=(const PhaseScope&) = delete;
+        ~PhaseScope();
+    };
+}
+
+#endif
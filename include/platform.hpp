@@ -1,11 +1,38 @@
 #ifndef PLATFORM_HPP
 #define PLATFORM_HPP
 
+#include <cstddef>
+#include <filesystem>
 #include <string>
 
 namespace platform
 {
     std::string readline();
+    int processId();
+    // Встановлює обробник сигналу SIGUSR1. На Windows такого сигналу немає, тому нічого не робить
+    void setUserSignalHandler(void (*handler)());
+    // Найбільший обсяг фізичної пам'яті процесу (peak RSS) з моменту запуску, в байтах
+    size_t peakResidentBytes();
+
+    // Резервує діапазон адрес без виділення фізичної пам'яті. Повертає nullptr у разі невдачі
+    void* reserveMemory(size_t size);
+    // Робить частину зарезервованого діапазону доступною для читання і запису
+    bool commitMemory(void* address, size_t size);
+    // Повертає фізичну пам'ять системі, діапазон залишається зарезервованим і перед повторним
+    // використанням передається в commitMemory. Вміст пам'яті після цього невизначений.
+    // Якщо lazy істинне, система забирає пам'ять лише при її нестачі
+    void decommitMemory(void* address, size_t size, bool lazy);
+    // Звільняє весь діапазон, отриманий від reserveMemory
+    void releaseMemory(void* address, size_t size);
+    // Просить систему розміщувати діапазон на великих сторінках. Повертає false, якщо це не підтримується
+    bool adviseHugePages(void* address, size_t size);
+
+    // Відображає файл в пам'ять лише для читання і записує його розмір в size. Фізичні
+    // сторінки спільні для всіх процесів, які відобразили файл. Повертає nullptr, якщо файл
+    // не вдалося відкрити або він порожній
+    const void* mapFile(const std::filesystem::path& path, size_t& size);
+    // Звільняє відображення, отримане від mapFile
+    void unmapFile(const void* address, size_t size);
 }
 
 #endif
@@ -40,6 +40,8 @@ namespace unicode
 
     // Повертає кількість символів в utf8 рядку
     size_t utf8Size(std::string_view str);
+    // Чи є рядок правильним utf8: кожен символ має всі байти продовження
+    bool isValidUtf8(std::string_view str);
     // Повертає кількість символів в utf16 рядку
     size_t utf16Size(std::u16string_view str);
 
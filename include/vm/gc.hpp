@@ -1,35 +1,218 @@
 #ifndef GC_HPP
 #define GC_HPP
 
+#include <array>
+#include <chrono>
+#include <filesystem>
 #include <forward_list>
+#include <map>
+#include <string>
+#include <vector>
 
+#include "exports.hpp"
 #include "vm.hpp"
+#include "heap.hpp"
+#include "parallel_mark.hpp"
+#include "mark_stack.hpp"
 
-constexpr const i32 GC_THRESHOLD = 16384; // В байтах
+// Крок, з яким змінюється поріг збирання, в байтах
+constexpr const i32 GC_THRESHOLD = 16384;
+// Мінімальна кількість об'єктів, з якої позначення виконується паралельно
+constexpr const u64 PARALLEL_MARK_MIN_OBJECTS = 10000;
+// Кількість об'єктів, які прибираються при кожному виділенні пам'яті в режимі лінивого прибирання
+constexpr const size_t LAZY_SWEEP_STEP = 32;
 
 namespace vm
 {
+    struct GCStats
+    {
+        // Кошик i містить паузи тривалістю [2^(i-1), 2^i) мікросекунд, кошик 0 - менше 1 мкс
+        static constexpr const size_t PAUSE_BUCKETS = 32;
+
+        u64 collections = 0;
+        u64 totalPauseUs = 0;
+        u64 maxPauseUs = 0;
+        std::array<u64, PAUSE_BUCKETS> pauseHistogram{};
+        u64 allocatedBytes = 0; // Всього виділено за час роботи
+        u64 reclaimedBytes = 0; // Всього звільнено за час роботи
+        u64 allocatedObjects = 0; // Всього створено об'єктів, крім безсмертних
+        u64 heapBytes = 0;
+        u64 pageBytes = 0; // Пам'ять сторінок з об'єктами
+        u64 retainedBytes = 0; // Пам'ять вільних сторінок, не повернута системі
+        u64 threshold = 0;
+        u64 liveObjects = 0;
+        // Безсмертні та заморожені об'єкти, не враховані в heapBytes і liveObjects
+        u64 permanentObjects = 0;
+        // Збирання, під час яких стек позначення переповнювався і позначені об'єкти
+        // обходились повторно
+        u64 markStackOverflows = 0;
+        // Кількість об'єктів в купі за назвою типу. В режимі арени враховуються
+        // лише об'єкти з деструктором
+        std::map<std::string, u64> liveObjectsByType;
+
+        // Повертає верхню межу кошика, в який потрапляє перцентиль p (від 0 до 1), в мікросекундах.
+        // Межа не перевищує найдовшої паузи
+        u64 pausePercentileUs(double p) const;
+    };
+
+    // Налаштування розміру купи. Розміри задаються в байтах, значення 0 означає відсутність обмеження
+    struct API GCPolicy
+    {
+        // Поріг першого збирання
+        u64 initialHeap = 4096;
+        // Наступне збирання запускається, коли купа виросте в growthFactor разів
+        // від обсягу живих об'єктів після збирання
+        double growthFactor = 1.0;
+        // Поріг збирання не опускається нижче minHeap
+        u64 minHeap = 0;
+        // Поріг збирання не піднімається вище maxHeap, якщо живі об'єкти вміщаються в цей розмір
+        u64 maxHeap = 0;
+        // Якщо після збирання купа більша за hardLimit, викидається "ПомилкаПам'яті"
+        u64 hardLimit = 0;
+        // Скільки пам'яті вільних сторінок залишається для повторного використання після прибирання,
+        // решта повертається системі
+        u64 retainedBytes = 4 * 1024 * 1024;
+        // Коли сторінки купи займуть більше цього розміру, для неї вмикаються великі сторінки
+        // (transparent huge pages). Значення 0 вимикає великі сторінки
+        u64 hugePageThreshold = 0;
+        // Повертати пам'ять ліниво (MADV_FREE): система забирає її лише при нестачі пам'яті,
+        // тому повторне використання дешевше, але RSS процесу зменшується не одразу
+        bool lazyReturn = false;
+        // Кількість потоків для позначення об'єктів, враховуючи потік віртуальної машини.
+        // Значення 0 або 1 вимикає паралельне позначення, а більше за кількість ядер
+        // процесора зменшується до неї
+        u64 markThreads = 1;
+        // Найбільша кількість об'єктів в стеку позначення кожного потоку. Об'єкти, які
+        // не вмістились, знаходяться повторним обходом позначених об'єктів. Значення 0 ігнорується
+        u64 markStackLimit = MARK_STACK_LIMIT;
+        // Мертві об'єкти звільняються поступово під час наступних виділень пам'яті,
+        // а не всі одразу після позначення
+        bool lazySweep = false;
+
+        // Повертає налаштування за замовчуванням, змінені змінними середовища
+        // PERIWINKLE_GC_INITIAL_HEAP, PERIWINKLE_GC_GROWTH, PERIWINKLE_GC_MIN_HEAP,
+        // PERIWINKLE_GC_MAX_HEAP, PERIWINKLE_GC_HARD_LIMIT, PERIWINKLE_GC_RETAIN,
+        // PERIWINKLE_GC_HUGE_PAGES, PERIWINKLE_GC_LAZY_RETURN, PERIWINKLE_GC_MARK_THREADS,
+        // PERIWINKLE_GC_MARK_STACK та PERIWINKLE_GC_LAZY_SWEEP
+        static GCPolicy fromEnvironment();
+    };
+
     class GC
     {
     private:
+        Heap heap;
         std::forward_list<Object*> objects;
+        // Об'єкти, які залишились після позначення і ще не перевірені прибиранням
+        std::forward_list<Object*> unswept;
+        // Об'єкти, перенесені в постійне покоління викликом freeze. Вони не позначаються
+        // і не прибираються, але об'єкти, на які вони посилаються, є коренями
+        std::forward_list<Object*> frozen;
+        // Об'єкти, створені в ImmortalScope. Зберігаються лише для виклику деструкторів в clean
+        std::vector<Object*> immortals;
+        bool immortalAllocation = false;
+        // В режимі арени збирання не виконується, а в objects зберігаються лише об'єкти,
+        // яким потрібен деструктор. Решта звільняється разом зі сторінками в clean
+        bool arena = false;
         u64 allocated = 0; // Розмір виділеної пам'яті в байтах
+        u64 objectCount = 0;
+        u64 frozenCount = 0;
 
-        // Поріг, після якого запускається очищення пам'яті.
-        // Початковий поріг виставлений в 4 кібібайти.
+        GCPolicy policy;
+        // Поріг, після якого запускається очищення пам'яті
         u64 threshold = 4096;
+        // Кількість незавершених викликів disable
+        u64 disabledDepth = 0;
+        // Збирання, запитане поза безпечною точкою, виконується в наступному виклику gc
+        bool collectionRequested = false;
+        // Помилка про перевищення hardLimit викидається один раз, доки купа не зменшиться
+        bool hardLimitReported = false;
 
+        GCStats stats;
+        // Виводити рядок в stderr після кожного збирання, вмикається змінною середовища PERIWINKLE_GC_LOG
+        bool logCollections = false;
+        u64 reclaimedAtLastLog = 0;
+
+        std::vector<Object*> roots;
+        MarkStack markStack;
+        ParallelMarker* parallelMarker = nullptr;
+
+        void collectRoots(Frame* frame);
         void mark(Frame* frame);
+        // Повторно обходить позначені об'єкти після переповнення стеку позначення
+        void rescanMarked();
+        void releaseObject(Object* o);
+        // Прибирає до count об'єктів з unswept
+        void sweepStep(size_t count);
         void sweep();
+        void recordCollection(std::chrono::steady_clock::duration pause);
+        // Обчислює поріг наступного збирання за поточною політикою
+        u64 nextThreshold() const;
+        // Встановлює "ПомилкаПам'яті", якщо купа перевищує hardLimit
+        bool checkHardLimit();
     public:
-        // Приймає поточний фрейм
-        void gc(Frame* frame);
+        // Приймає поточний фрейм. Повертає false, якщо була викинута помилка
+        bool gc(Frame* frame);
+        // Виконує збирання сміття незалежно від порогу
+        void collect(Frame* frame);
         void addObject(Object* o);
+        // Виділяє пам'ять для об'єкта на звичайній або, в ImmortalScope, на постійній сторінці
+        void* allocateMemory(size_t size);
+        // Вмикає розміщення нових об'єктів в безсмертній області, повертає попереднє значення
+        bool setImmortalAllocation(bool enabled);
+        Heap& getHeap();
+        // Записує знімок купи у файл path, формат описаний в heap_dump.hpp.
+        // frame може бути nullptr, якщо програма не виконується. Повертає false, якщо файл не вдалося записати
+        bool dumpHeap(Frame* frame, const std::filesystem::path& path);
+        // Після повного збирання переносить всі живі об'єкти в постійне покоління.
+        // Викликається перед fork(), щоб збирання в дочірніх процесах не змінювали
+        // сторінки з цими об'єктами і вони залишались спільними
+        void freeze(Frame* frame);
+        // Запитує збирання в наступній безпечній точці, незалежно від порогу
+        void requestCollection();
+        // Вимикає збирання за порогом, наприклад, на час масового створення об'єктів.
+        // Виклики можуть бути вкладеними, кожен disable потребує відповідного enable
+        void disable();
+        void enable();
+        bool isEnabled() const;
 
         // Видялає всі об'єкти
         void clean();
+        // Вмикає режим арени до кінця роботи збирача. Викликається до створення об'єктів
+        void enableArena();
+        bool isArena() const;
+
+        // Встановлює кількість потоків для позначення об'єктів, як GCPolicy::markThreads
+        void setMarkThreads(size_t count);
+        size_t getMarkThreads() const;
+        // Вмикає ліниве прибирання, як GCPolicy::lazySweep. Вимкнення завершує незакінчене прибирання
+        void setLazySweep(bool enabled);
+        bool isLazySweep() const;
+        void setPolicy(const GCPolicy& newPolicy);
+        const GCPolicy& getPolicy() const;
+        // Обходить всі об'єкти в купі для підрахунку кількості об'єктів кожного типу
+        GCStats getStats() const;
+        // Статистика без обходу купи: liveObjectsByType не заповнюється
+        GCStats getCounters() const;
 
         GC();
+        ~GC();
+    };
+
+    // Об'єкти, створені під час існування ImmortalScope, розміщуються в безсмертній
+    // області: вони не позначаються, не прибираються і живуть до виклику GC::clean.
+    // Збирач не обходить їх вміст, тому вони можуть посилатись лише на інші безсмертні
+    // або статичні об'єкти. Так створюються константи компілятора та CodeObject
+    class ImmortalScope
+    {
+    private:
+        GC* gc;
+        bool previous;
+    public:
+        ImmortalScope(GC* gc);
+        ~ImmortalScope();
+
+        ImmortalScope(const ImmortalScope&) = delete;
+        ImmortalScope& operator=(const ImmortalScope&) = delete;
     };
 }
 
@@ -0,0 +1,195 @@
+#ifndef HEAP_HPP
+#define HEAP_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include "object.hpp"
+
+// Розмір сторінки купи. Сторінки вирівняні на свій розмір, тому сторінку об'єкта
+// можна знайти, відкинувши молодші біти його адреси
+constexpr const size_t HEAP_PAGE_SIZE = 64 * 1024;
+// Розміри комірок кратні цьому значенню
+constexpr const size_t HEAP_CELL_ALIGNMENT = 16;
+// Більші об'єкти отримують окрему сторінку
+constexpr const size_t HEAP_MAX_CELL_SIZE = 2048;
+// Звичайні сторінки виділяються з регіонів такого розміру, зарезервованих у системи
+constexpr const size_t HEAP_REGION_SIZE = 32 * 1024 * 1024;
+// Регіони вирівнюються на розмір великої сторінки x86-64, щоб система могла їх використати
+constexpr const size_t HEAP_REGION_ALIGNMENT = 2 * 1024 * 1024;
+
+namespace vm
+{
+    struct HeapPage;
+
+    // Заголовок на початку пам'яті кожної сторінки. Записується лише при створенні сторінки
+    struct alignas(HEAP_CELL_ALIGNMENT) HeapPageHeader
+    {
+        HeapPage* page;
+    };
+
+    // Опис сторінки. Зберігається окремо від пам'яті об'єктів, тому позначення
+    // та прибирання не змінюють сторінки з об'єктами, і після fork() вони
+    // залишаються спільними з батьківським процесом
+    struct HeapPage
+    {
+        std::byte* memory;
+        size_t memorySize;
+        // Окреме резервування великої сторінки, з якого вирівняно memory. Для звичайних сторінок nullptr
+        std::byte* reservation = nullptr;
+        size_t cellSize;
+        size_t cellCount;
+        size_t sizeClass;
+        size_t index; // Позиція в Heap::pages
+        size_t bumpIndex = 0; // Комірки з цим і більшими індексами ще не використовувались
+        size_t liveCount = 0;
+        std::vector<u32> freeCells;
+        std::vector<u64> markBits;
+        // Сторінка є в списку сторінок з вільними комірками свого класу
+        bool available = false;
+        // На сторінці розміщені безсмертні або заморожені об'єкти. Комірки такої сторінки
+        // не звільняються, а нові об'єкти на ній не розміщуються після заморожування
+        bool permanent = false;
+
+        inline size_t cellIndex(const Object* o) const
+        {
+            return static_cast<size_t>(reinterpret_cast<const std::byte*>(o) - memory - sizeof(HeapPageHeader))
+                / cellSize;
+        }
+
+        inline bool isFull() const
+        {
+            return freeCells.empty() && bumpIndex == cellCount;
+        }
+    };
+
+    inline HeapPage* pageOf(const Object* o)
+    {
+        auto address = reinterpret_cast<uintptr_t>(o) & ~(HEAP_PAGE_SIZE - 1);
+        return reinterpret_cast<const HeapPageHeader*>(address)->page;
+    }
+
+    inline u64& markWord(const Object* o, u64& bit)
+    {
+        auto page = pageOf(o);
+        auto index = page->cellIndex(o);
+        bit = u64(1) << (index % 64);
+        return page->markBits[index / 64];
+    }
+
+    // Об'єкти, які не можуть бути звільнені, вважаються завжди позначеними
+    inline bool isMarked(const Object* o)
+    {
+        if (!o->collectable)
+        {
+            return true;
+        }
+        u64 bit;
+        return markWord(o, bit) & bit;
+    }
+
+    // Позначає об'єкт, повертає false, якщо він вже був позначений
+    inline bool setMarked(Object* o)
+    {
+        if (!o->collectable)
+        {
+            return false;
+        }
+        u64 bit;
+        auto& word = markWord(o, bit);
+        if (word & bit)
+        {
+            return false;
+        }
+        word |= bit;
+        return true;
+    }
+
+    // Варіанти для паралельного позначення
+    inline bool isMarkedAtomic(const Object* o)
+    {
+        if (!o->collectable)
+        {
+            return true;
+        }
+        u64 bit;
+        return std::atomic_ref<u64>(markWord(o, bit)).load(std::memory_order_relaxed) & bit;
+    }
+
+    inline bool setMarkedAtomic(Object* o)
+    {
+        if (!o->collectable)
+        {
+            return false;
+        }
+        u64 bit;
+        std::atomic_ref<u64> word(markWord(o, bit));
+        return !(word.load(std::memory_order_relaxed) & bit)
+            && !(word.fetch_or(bit, std::memory_order_relaxed) & bit);
+    }
+
+    // Розподіляє пам'ять для об'єктів сторінками з комірками однакового розміру
+    class Heap
+    {
+    private:
+        struct SizeClass
+        {
+            HeapPage* current = nullptr; // Сторінка, з якої зараз виділяються комірки
+            std::vector<HeapPage*> available; // Інші сторінки з вільними комірками
+        };
+
+        std::vector<SizeClass> sizeClasses;
+        // Окремі сторінки для безсмертних об'єктів, щоб звичайні сторінки могли звільнятись
+        std::vector<SizeClass> permanentSizeClasses;
+        std::vector<HeapPage*> pages;
+
+        struct Region
+        {
+            std::byte* reservation;
+            std::byte* start; // Початок першої сторінки, вирівняний на HEAP_REGION_ALIGNMENT
+            size_t bumpIndex; // Сторінки з цим і більшими індексами ще не використовувались
+        };
+        std::vector<Region> regions;
+        // Пам'ять звільнених сторінок, ще не повернута системі. Останні звільнені використовуються першими
+        std::deque<std::byte*> retainedPages;
+        // Звільнені сторінки, пам'ять яких повернута системі
+        std::vector<std::byte*> returnedPages;
+        size_t usedBytes = 0; // Пам'ять сторінок з об'єктами
+        size_t hugePageThreshold = 0;
+        bool hugePages = false;
+
+        HeapPage* createPage(size_t sizeClass, size_t cellSize, size_t memorySize, bool permanent);
+        void releasePage(HeapPage* page);
+        void resetSizeClasses();
+        std::byte* acquirePageMemory();
+        std::byte* acquireLargeMemory(size_t size, std::byte*& reservation);
+        void useHugePages(const Region& region);
+    public:
+        void* allocate(size_t size, bool permanent = false);
+        void free(void* memory);
+
+        // Очищує бітові мапи позначень всіх звичайних сторінок
+        void clearMarks();
+        // Робить всі наявні сторінки постійними, нові об'єкти будуть виділятись на нових сторінках
+        void freeze();
+        // Звільняє всі сторінки. Деструктори об'єктів потрібно викликати до цього
+        void releaseAll();
+        // Повертає системі пам'ять вільних сторінок, залишаючи для повторного використання
+        // не більше retainBytes. Якщо lazy істинне, система забере пам'ять лише при її нестачі
+        void trim(size_t retainBytes, bool lazy);
+        // Коли сторінки купи займуть більше bytes, для регіонів вмикаються великі сторінки.
+        // Значення 0 вимикає великі сторінки
+        void setHugePageThreshold(size_t bytes);
+        // Розмір пам'яті, зайнятої сторінками, в байтах
+        size_t pageBytes() const;
+        // Розмір пам'яті вільних сторінок, ще не повернутої системі, в байтах
+        size_t retainedBytes() const;
+
+        Heap();
+        ~Heap();
+    };
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef HEAP_DUMP_HPP
+#define HEAP_DUMP_HPP
+
+#include <filesystem>
+#include <ostream>
+#include <vector>
+
+#include "object.hpp"
+
+namespace vm
+{
+    // Записує в out знімок всіх об'єктів, досяжних з roots, у форматі JSON:
+    //  {"roots": [індекси], "objects": [{"type", "size", "payload", "permanent", "refs"}]}
+    // Індекс об'єкта - його позиція в масиві objects, refs містить індекси об'єктів,
+    // на які він посилається. Поле permanent істинне для статичних,
+    // безсмертних та заморожених об'єктів, які збирач сміття не звільняє.
+    void writeHeapDump(std::ostream& out, const std::vector<Object*>& roots);
+
+    // Запитує знімок купи в наступній безпечній точці. Можна викликати з обробника сигналу
+    void requestHeapDump();
+    // Повертає істину, якщо знімок був запитаний, і скидає запит
+    bool takeHeapDumpRequest();
+    // Шлях для знімка, запитаного сигналом: "periwinkle-<pid>-<номер>.heap.json" в поточній теці
+    std::filesystem::path nextHeapDumpPath();
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef MARK_STACK_HPP
+#define MARK_STACK_HPP
+
+#include <atomic>
+#include <deque>
+#include <new>
+#include <vector>
+
+#include "object.hpp"
+#include "heap.hpp"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address)
+#endif
+
+// Максимальна кількість елементів в стеку позначення за замовчуванням
+constexpr const size_t MARK_STACK_LIMIT = 1 << 20;
+
+namespace vm
+{
+    // Стек об'єктів, які ще потрібно обійти під час позначення.
+    // Об'єкт позначається не при додаванні, а при вийманні зі стеку,
+    // тому при додаванні пам'ять об'єкта лише попередньо завантажується в кеш.
+    class MarkStack
+    {
+    private:
+        std::vector<Object*> items;
+        size_t limit = MARK_STACK_LIMIT;
+        // Об'єкт не вмістився в стек. Його батько вже позначений,
+        // тому об'єкт буде знайдено повторним обходом позначених об'єктів
+        bool overflowed = false;
+
+        // Видаляє зі стеку вже позначені об'єкти, повертає істину, якщо з'явилось місце
+        bool compact();
+
+        inline void overflow(Object* o)
+        {
+            // Вже позначений об'єкт можна пропустити без повторного обходу.
+            // Під час паралельного позначення ознаку можуть змінювати інші потоки
+            if (!isMarkedAtomic(o))
+            {
+                overflowed = true;
+            }
+        }
+    public:
+        // Стек, в який додає об'єкти vm::mark в поточному потоці, або nullptr
+        static thread_local MarkStack* current;
+
+        inline void push(Object* o)
+        {
+            PREFETCH(o);
+            if (items.size() >= limit && !compact())
+            {
+                overflow(o);
+                return;
+            }
+            try
+            {
+                items.push_back(o);
+            }
+            catch (const std::bad_alloc&)
+            {
+                overflow(o);
+            }
+        }
+
+        inline Object* pop()
+        {
+            auto o = items.back();
+            items.pop_back();
+            return o;
+        }
+
+        inline bool empty() const { return items.empty(); }
+        inline size_t size() const { return items.size(); }
+        inline bool hasOverflowed() const { return overflowed; }
+        inline void clearOverflow() { overflowed = false; }
+        inline size_t getLimit() const { return limit; }
+        // Ліміт повинен бути не меншим за 1, інакше повторний обхід не позначить жодного кореня
+        inline void setLimit(size_t value) { limit = value; }
+
+        // Переносить count найстаріших об'єктів в out
+        void takeBottom(size_t count, std::deque<Object*>& out);
+        // Позначає та обходить всі об'єкти зі стеку
+        void drain();
+    };
+
+    // Додає в out об'єкти, на які посилається o, не позначаючи їх
+    void collectReferences(Object* o, std::vector<Object*>& out);
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef PARALLEL_MARK_HPP
+#define PARALLEL_MARK_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "object.hpp"
+#include "mark_stack.hpp"
+
+namespace vm
+{
+    // Черга позначення одного потоку. Власник працює з локальним стеком без блокувань,
+    // а надлишок переносить в спільну чергу, з якої можуть красти інші потоки.
+    class MarkWorker
+    {
+    private:
+        MarkStack local;
+        std::deque<Object*> shared;
+        std::mutex sharedMutex;
+        std::atomic<size_t> sharedSize = 0;
+
+        void share();
+    public:
+        void setStackLimit(size_t limit);
+        void push(Object* o);
+        // Позначає атомарно та обходить всі об'єкти з локального стеку
+        void drain();
+        // Переносить половину спільної черги цього потоку в локальний стек thief
+        bool stealInto(MarkWorker& thief);
+        bool hasSharedWork() const;
+        // Повертає істину, якщо локальний стек переповнювався, і скидає цю ознаку
+        bool takeOverflow();
+    };
+
+    // Паралельне позначення досяжних об'єктів пулом потоків.
+    // Виконується, поки потік віртуальної машини зупинений в GC::gc.
+    class ParallelMarker
+    {
+    private:
+        // Нульовий потік позначення - потік, що викликав mark
+        std::vector<MarkWorker> workers;
+        std::vector<std::thread> threads;
+
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        std::condition_variable done;
+        u64 generation = 0; // Номер запуску позначення
+        size_t finished = 0;
+        bool stopping = false;
+        std::atomic<size_t> idle = 0;
+
+        void workerLoop(size_t index);
+        void run(size_t index);
+        bool steal(size_t index);
+        bool hasSharedWork() const;
+    public:
+        // Позначає всі об'єкти, досяжні з roots. Корені розподіляються між потоками порівну.
+        // Повертає істину, якщо стек позначення хоча б одного потоку переповнювався
+        bool mark(const std::vector<Object*>& roots);
+        size_t threadCount() const;
+
+        // stackLimit - найбільша кількість об'єктів в локальному стеку кожного потоку
+        ParallelMarker(size_t threadCount, size_t stackLimit);
+        ~ParallelMarker();
+    };
+}
+
+#endif
@@ -28,11 +28,15 @@ namespace vm
         // Операції контролю потоку виконання
         JMP, JMP_IF_TRUE, JMP_IF_FALSE, JMP_IF_TRUE_OR_POP, JMP_IF_FALSE_OR_POP,
         CALL, CALL_NA, RETURN, FOR_EACH,
+        TAIL_CALL, // CALL в "повернути", функція Барвінку виконується у фреймі, який її викликав
+        TAIL_CALL_NA, // CALL_NA в "повернути"
 
         // Операції для роботи з пам'яттю
         LOAD_CONST,
         LOAD_GLOBAL, STORE_GLOBAL, DELETE_GLOBAL,
         LOAD_LOCAL, STORE_LOCAL, DELETE_LOCAL,
+        LOAD_LOCAL_FAST, // LOAD_LOCAL без перевірки, змінній гарантовано присвоєно значення
+        LOAD_GLOBAL_OR_NULL, // LOAD_GLOBAL, який для невизначеної змінної завантажує nullptr
         GET_CELL, LOAD_CELL, STORE_CELL, GET_ATTR,
 
         LOAD_METHOD, CALL_METHOD, CALL_METHOD_NA,
@@ -43,6 +47,8 @@ namespace vm
     )
 
     constexpr const WORD OPCODE_MASK = 0xff;
+    // Кількість слотів стеку віртуальної машини, спільного для всіх фреймів
+    constexpr const size_t VM_STACK_SIZE = 8 * 1024;
 
     struct CodeObject;
 
@@ -51,10 +57,11 @@ namespace vm
         Frame* previous = nullptr;
         CodeObject* codeObject;
         using object_map_t = std::unordered_map<std::string, Object*>;
-        object_map_t* globals; // Глобальні змінні
+        object_map_t* globals; // Глобальні змінні, належать кореневому фрейму
 
         Object** sp; // stack pointer. Посилається на вершину стека
         Object** bp; // base pointer. Посилається на початок стека для даного фрейма
+        Object** stackEnd; // Кінець пам'яті стеку
 
         // Посилається на стек після локальних змінних, те саме що й
         //  bp + кількість_локальних_змінних.
@@ -63,7 +70,11 @@ namespace vm
 
         ~Frame()
         {
-            delete globals;
+            // Фрейми функцій використовують глобальні змінні кореневого фрейму
+            if (previous == nullptr)
+            {
+                delete globals;
+            }
         };
     };
 
@@ -71,12 +82,12 @@ namespace vm
     {
     private:
         Frame* frame;
-        WORD* ip;
+        const WORD* ip;
         Object**& sp;
         Object**& bp;
         Object**& freevars;
 
-        i64 getLineno(WORD* ip) const;
+        i64 getLineno(const WORD* ip) const;
     public:
         Object* execute();
         Frame* getFrame() const;
@@ -84,5 +95,9 @@ namespace vm
         static VirtualMachine* currentVm;
         VirtualMachine(Frame* frame);
     };
+
+    // Перевіряє, що в стеку поточної віртуальної машини є size слотів, починаючи з base.
+    // Якщо місця немає, встановлює виняток і повертає false
+    bool checkStackSpace(Object** base, size_t size);
 }
 #endif
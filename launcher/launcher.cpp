@@ -1,3 +1,4 @@
+#include <charconv>
 #include <iostream>
 #include <sstream>
 
@@ -12,6 +13,21 @@ static std::string usage(std::string_view programName)
     ss << "Використання: " << programName << " [опції] <файл>\n";
     ss << "Опції:\n";
     ss << "\t" << "-д, --допомога     Виводить це повідомлення.\n";
+    ss << "\t" << "--купа-початкова <байти>  Поріг першого збирання сміття.\n";
+    ss << "\t" << "--купа-зростання <число>  У скільки разів купа може вирости після збирання.\n";
+    ss << "\t" << "--купа-мінімум <байти>    Мінімальний поріг збирання сміття.\n";
+    ss << "\t" << "--купа-максимум <байти>   Максимальний поріг збирання сміття.\n";
+    ss << "\t" << "--купа-межа <байти>       Розмір купи, після якого викидається \"ПомилкаПам'яті\".\n";
+    ss << "\t" << "--купа-утримання <байти>  Скільки вільної пам'яті купи не повертати системі.\n";
+    ss << "\t" << "--купа-великі-сторінки <байти>  Розмір купи, з якого використовуються великі сторінки.\n";
+    ss << "\t" << "--купа-потоки <число>    Кількість потоків для позначення об'єктів під час збирання сміття, не більше кількості ядер.\n";
+    ss << "\t" << "--купа-стек-позначення <число>  Найбільша кількість об'єктів в стеку позначення.\n";
+    ss << "\t" << "--купа-ліниве-прибирання  Звільняє мертві об'єкти поступово під час наступних виділень пам'яті.\n";
+    ss << "\t" << "--без-кешу          Не використовує кеш скомпільованого коду.\n";
+    ss << "\t" << "--тека-кешу <тека>  Тека для кешу скомпільованого коду, замість \"__кеш__\" поруч з програмою.\n";
+    ss << "\t" << "--ліниво            Компілює тіло функції при її першому виклику, але помилки в тілах повідомляє до запуску. Програма не записується в кеш.\n";
+    ss << "\t" << "--етапи             Виводить в stderr час, пік RSS та кількість об'єктів для кожного етапу запуску.\n";
+    ss << "\t" << "--образ <файл>      Записує образ скомпільованої програми, який можна запустити замість неї. Не запускає програму.\n";
 #ifdef DEV_TOOLS
     ss << "\t" << "-а, --асемблер     Виводить згенерований код для віртуальної машини. Не запускає програму.\n";
 #endif
@@ -32,6 +48,24 @@ static bool cmdOptionExists(std::span<const std::string_view> tokens, std::strin
 #define COMPARE_OPTION(token, option, fullOption) \
     (token == option || token == fullOption)
 
+template<typename T>
+static bool parseOptionValue(std::span<const std::string_view> tokens, size_t& i, T& value)
+{
+    if (i + 1 >= tokens.size())
+    {
+        std::cout << "Аргумент \"" << tokens[i] << "\" потребує значення" << std::endl;
+        return false;
+    }
+    auto text = tokens[++i];
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size())
+    {
+        std::cout << "Некоректне значення аргументу \"" << tokens[i - 1] << "\": \"" << text << "\"" << std::endl;
+        return false;
+    }
+    return true;
+}
+
 int launcher(std::span<const std::wstring_view> wargs) noexcept
 {
     std::vector<std::string> args(wargs.size());
@@ -56,6 +90,12 @@ int launcher(std::span<const std::string_view> args) noexcept
     std::span<const std::string_view> tokens(args.begin() + 1, args.end());
     std::span<const std::string_view> argsForInterpreter; // Аргументи для інтерпретатора
     std::span<const std::string_view> argsForProgram; // Аргументи для програми запущеної інтерпретатором
+    auto gcPolicy = vm::GCPolicy::fromEnvironment();
+    bool useBytecodeCache = true;
+    std::filesystem::path cacheDirectory;
+    std::filesystem::path imagePath;
+    bool phaseReport = false;
+    bool lazyCompilation = false;
     for (size_t i = 0; i < tokens.size(); ++i)
     {
         std::string_view token = tokens[i];
@@ -64,6 +104,76 @@ int launcher(std::span<const std::string_view> args) noexcept
             std::cout << usage(programName);
             return 0;
         }
+        else if (token == "--купа-початкова")
+        {
+            if (!parseOptionValue(tokens, i, gcPolicy.initialHeap)) return 0;
+        }
+        else if (token == "--купа-зростання")
+        {
+            if (!parseOptionValue(tokens, i, gcPolicy.growthFactor)) return 0;
+        }
+        else if (token == "--купа-мінімум")
+        {
+            if (!parseOptionValue(tokens, i, gcPolicy.minHeap)) return 0;
+        }
+        else if (token == "--купа-максимум")
+        {
+            if (!parseOptionValue(tokens, i, gcPolicy.maxHeap)) return 0;
+        }
+        else if (token == "--купа-межа")
+        {
+            if (!parseOptionValue(tokens, i, gcPolicy.hardLimit)) return 0;
+        }
+        else if (token == "--купа-утримання")
+        {
+            if (!parseOptionValue(tokens, i, gcPolicy.retainedBytes)) return 0;
+        }
+        else if (token == "--купа-великі-сторінки")
+        {
+            if (!parseOptionValue(tokens, i, gcPolicy.hugePageThreshold)) return 0;
+        }
+        else if (token == "--купа-потоки")
+        {
+            if (!parseOptionValue(tokens, i, gcPolicy.markThreads)) return 0;
+        }
+        else if (token == "--купа-стек-позначення")
+        {
+            if (!parseOptionValue(tokens, i, gcPolicy.markStackLimit)) return 0;
+        }
+        else if (token == "--купа-ліниве-прибирання")
+        {
+            gcPolicy.lazySweep = true;
+        }
+        else if (token == "--без-кешу")
+        {
+            useBytecodeCache = false;
+        }
+        else if (token == "--тека-кешу")
+        {
+            if (i + 1 >= tokens.size())
+            {
+                std::cout << "Аргумент \"" << token << "\" потребує значення" << std::endl;
+                return 0;
+            }
+            cacheDirectory = std::filesystem::path(tokens[++i]);
+        }
+        else if (token == "--ліниво")
+        {
+            lazyCompilation = true;
+        }
+        else if (token == "--етапи")
+        {
+            phaseReport = true;
+        }
+        else if (token == "--образ")
+        {
+            if (i + 1 >= tokens.size())
+            {
+                std::cout << "Аргумент \"" << token << "\" потребує значення" << std::endl;
+                return 0;
+            }
+            imagePath = std::filesystem::path(tokens[++i]);
+        }
 #ifdef DEV_TOOLS
         else if (COMPARE_OPTION(token, "-а", "--асемблер"))
         {
@@ -85,6 +195,25 @@ int launcher(std::span<const std::string_view> args) noexcept
 
     periwinkle::initialize();
 	periwinkle::Periwinkle interpreter(std::filesystem::path(argsForInterpreter.back()));
+    interpreter.setGCPolicy(gcPolicy);
+    interpreter.setBytecodeCache(useBytecodeCache, cacheDirectory);
+    interpreter.setLazyCompilation(lazyCompilation);
+    if (phaseReport)
+    {
+        interpreter.enablePhaseReport([](const periwinkle::PhaseReport& report)
+        {
+            std::cerr << report.format();
+        });
+    }
+    if (!imagePath.empty())
+    {
+        if (!interpreter.writeImage(imagePath))
+        {
+            std::cout << "Не вдалося записати образ програми \"" << imagePath.string() << "\"" << std::endl;
+        }
+        periwinkle::finalize();
+        return 0;
+    }
 
 #ifdef DEV_TOOLS
 	if (cmdOptionExists(argsForInterpreter, "-а", "--асемблер"))
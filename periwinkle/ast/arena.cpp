@@ -0,0 +1,52 @@
+#include <cstring>
+
+#include "arena.hpp"
+#include "plogger.hpp"
+
+using namespace ast;
+
+thread_local Arena* ast::Arena::currentArena = nullptr;
+
+Arena* ast::Arena::current()
+{
+    plog::passert(currentArena != nullptr) << "Вузли AST та стан компілятора розміщуються лише в арені";
+    return currentArena;
+}
+
+void* ast::Arena::allocate(size_t size, size_t alignment)
+{
+    allocated += size;
+    return resource.allocate(size, alignment);
+}
+
+std::string_view ast::Arena::copyString(std::string_view text)
+{
+    if (text.empty())
+    {
+        return {};
+    }
+    auto data = static_cast<char*>(allocate(text.size(), 1));
+    std::memcpy(data, text.data(), text.size());
+    return { data, text.size() };
+}
+
+size_t ast::Arena::allocatedBytes() const
+{
+    return allocated;
+}
+
+ast::Arena::Arena(size_t initialSize)
+    : resource(initialSize)
+{
+}
+
+ast::ArenaScope::ArenaScope(Arena* arena)
+    : previous(Arena::currentArena)
+{
+    Arena::currentArena = arena;
+}
+
+ast::ArenaScope::~ArenaScope()
+{
+    Arena::currentArena = previous;
+}
@@ -0,0 +1,482 @@
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <span>
+#include <sstream>
+
+#include "bytecode_cache.hpp"
+#include "verifier.hpp"
+#include "int_object.hpp"
+#include "real_object.hpp"
+#include "bool_object.hpp"
+#include "null_object.hpp"
+#include "string_object.hpp"
+#include "string_vector_object.hpp"
+#include "periwinkle.hpp"
+#include "platform.hpp"
+
+using namespace compiler;
+
+// Формат кешу: заголовок, потім таблиця об'єктів. Кожен об'єкт посилається лише на
+// об'єкти, записані перед ним, кореневий CodeObject записується останнім.
+// Числа записуються в порядку байтів платформи: кеш не переноситься між машинами
+static constexpr char MAGIC[4] = { 'P', 'W', 'B', 'C' };
+
+enum class ConstantTag : u8
+{
+    NULL_CONST, TRUE_CONST, FALSE_CONST, INT, REAL, STRING, STRING_VECTOR, CODE_OBJECT
+};
+
+u64 compiler::fnv1aHash(std::string_view text)
+{
+    u64 hash = 14695981039346656037ull;
+    for (unsigned char c : text)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+class Writer
+{
+private:
+    std::string& out;
+public:
+    template<typename T>
+    void write(T value)
+    {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        out.append(bytes, sizeof(T));
+    }
+
+    void writeString(std::string_view value)
+    {
+        write(static_cast<u32>(value.size()));
+        out.append(value);
+    }
+
+    void writeStrings(const std::vector<std::string>& values)
+    {
+        write(static_cast<u32>(values.size()));
+        for (const auto& value : values)
+        {
+            writeString(value);
+        }
+    }
+
+    Writer(std::string& out) : out(out) {}
+};
+
+class Reader
+{
+private:
+    std::string_view data;
+    size_t position = 0;
+public:
+    // Встановлюється, якщо дані закінчились раніше, ніж очікувалось
+    bool failed = false;
+
+    template<typename T>
+    T read()
+    {
+        T value{};
+        // Після першої помилки читання нічого не читає, щоб розміри не бралися зі сміття
+        if (failed || data.size() - position < sizeof(T))
+        {
+            failed = true;
+            return value;
+        }
+        std::memcpy(&value, data.data() + position, sizeof(T));
+        position += sizeof(T);
+        return value;
+    }
+
+    std::string readString()
+    {
+        auto size = read<u32>();
+        if (failed || data.size() - position < size)
+        {
+            failed = true;
+            return {};
+        }
+        std::string value(data.substr(position, size));
+        position += size;
+        return value;
+    }
+
+    std::vector<std::string> readStrings()
+    {
+        std::vector<std::string> values(readCount(sizeof(u32)));
+        for (auto& value : values)
+        {
+            if (failed) break;
+            value = readString();
+        }
+        return values;
+    }
+
+    // Кількість елементів, для яких вистачає даних, щоб пошкоджений розмір не виділяв пам'ять
+    u32 readCount(size_t elementSize)
+    {
+        auto count = read<u32>();
+        if (!failed && (data.size() - position) / elementSize < count)
+        {
+            failed = true;
+            return 0;
+        }
+        return count;
+    }
+
+    bool atEnd() const
+    {
+        return position == data.size();
+    }
+
+    // Ще не прочитані дані
+    std::string_view remaining() const
+    {
+        return data.substr(position);
+    }
+
+    Reader(std::string_view data) : data(data) {}
+};
+
+bool compiler::ModuleObjects::add(vm::Object* object)
+{
+    if (indexes.contains(object))
+    {
+        return true;
+    }
+    if (OBJECT_IS(object, &vm::codeObjectType))
+    {
+        // Тіла без байткоду (лінива компіляція) не зберігаються
+        if (static_cast<vm::CodeObject*>(object)->deferredBody != nullptr)
+        {
+            return false;
+        }
+        for (auto constant : static_cast<vm::CodeObject*>(object)->constants)
+        {
+            if (!add(constant)) return false;
+        }
+    }
+    else if (object != &vm::P_null && object != &vm::P_true && object != &vm::P_false
+        && !OBJECT_IS(object, &vm::intObjectType) && !OBJECT_IS(object, &vm::realObjectType)
+        && !OBJECT_IS(object, &vm::stringObjectType) && !OBJECT_IS(object, &vm::stringVectorObjectType))
+    {
+        return false;
+    }
+    indexes[object] = static_cast<u32>(objects.size());
+    objects.push_back(object);
+    return true;
+}
+
+static void writeCodeObject(Writer& writer, vm::CodeObject* codeObject, const ModuleObjects& table)
+{
+    writer.writeString(codeObject->name);
+    writer.write(codeObject->arity);
+    writer.write(static_cast<u8>(codeObject->isVariadic));
+    writer.write(static_cast<u32>(codeObject->code.size()));
+    for (auto word : codeObject->code)
+    {
+        writer.write(word);
+    }
+    writer.write(static_cast<u32>(codeObject->constants.size()));
+    for (auto constant : codeObject->constants)
+    {
+        writer.write(table.indexes.at(constant));
+    }
+    writer.writeStrings(codeObject->names);
+    writer.writeStrings(codeObject->locals);
+    writer.writeStrings(codeObject->cells);
+    writer.writeStrings(codeObject->freevars);
+    writer.writeStrings(codeObject->defaults);
+    writer.write(static_cast<u32>(codeObject->ipToLineno.size()));
+    for (auto [ip, lineno] : codeObject->ipToLineno)
+    {
+        writer.write(ip);
+        writer.write(lineno);
+    }
+    writer.write(static_cast<u32>(codeObject->exceptionHandlers.size()));
+    for (const auto& handler : codeObject->exceptionHandlers)
+    {
+        writer.write(handler.stackDepth);
+        writer.write(handler.startAddress);
+        writer.write(handler.firstHandlerAddress);
+        writer.write(handler.endAddress);
+        writer.write(handler.finallyAddress);
+    }
+    writer.write(codeObject->maxStackDepth);
+}
+
+static vm::CodeObject* readCodeObject(Reader& reader, std::span<vm::Object* const> objects,
+    periwinkle::ProgramSource* source)
+{
+    auto codeObject = vm::CodeObject::create(reader.readString());
+    codeObject->source = source;
+    codeObject->arity = reader.read<vm::WORD>();
+    codeObject->isVariadic = reader.read<u8>() != 0;
+    codeObject->code.resize(reader.readCount(sizeof(vm::WORD)));
+    for (auto& word : codeObject->code)
+    {
+        word = reader.read<vm::WORD>();
+    }
+    codeObject->constants.resize(reader.readCount(sizeof(u32)));
+    for (auto& constant : codeObject->constants)
+    {
+        auto index = reader.read<u32>();
+        if (index >= objects.size())
+        {
+            return nullptr;
+        }
+        constant = objects[index];
+    }
+    codeObject->names = reader.readStrings();
+    codeObject->locals = reader.readStrings();
+    codeObject->cells = reader.readStrings();
+    codeObject->freevars = reader.readStrings();
+    codeObject->defaults = reader.readStrings();
+    auto linenoCount = reader.readCount(2 * sizeof(vm::WORD));
+    for (u32 i = 0; i < linenoCount; ++i)
+    {
+        auto ip = reader.read<vm::WORD>();
+        codeObject->ipToLineno[ip] = reader.read<vm::WORD>();
+    }
+    codeObject->exceptionHandlers.resize(reader.readCount(5 * sizeof(vm::WORD)));
+    for (auto& handler : codeObject->exceptionHandlers)
+    {
+        handler.stackDepth = reader.read<vm::WORD>();
+        handler.startAddress = reader.read<vm::WORD>();
+        handler.firstHandlerAddress = reader.read<vm::WORD>();
+        handler.endAddress = reader.read<vm::WORD>();
+        handler.finallyAddress = reader.read<vm::WORD>();
+    }
+    codeObject->maxStackDepth = reader.read<vm::WORD>();
+    if (reader.failed)
+    {
+        return nullptr;
+    }
+    codeObject->computeFrameLayout();
+    return codeObject;
+}
+
+std::optional<std::string> compiler::serializeCodeObject(vm::CodeObject* codeObject, std::string_view sourceText)
+{
+    ModuleObjects table;
+    if (!table.add(codeObject))
+    {
+        return std::nullopt;
+    }
+
+    // Дані після заголовка записуються окремо, бо заголовок містить їх хеш
+    std::string payload;
+    Writer writer(payload);
+    writer.write(static_cast<u32>(table.objects.size()));
+    for (auto object : table.objects)
+    {
+        if (object == &vm::P_null)
+        {
+            writer.write(ConstantTag::NULL_CONST);
+        }
+        else if (object == &vm::P_true || object == &vm::P_false)
+        {
+            writer.write(object == &vm::P_true ? ConstantTag::TRUE_CONST : ConstantTag::FALSE_CONST);
+        }
+        else if (OBJECT_IS(object, &vm::intObjectType))
+        {
+            writer.write(ConstantTag::INT);
+            writer.write(static_cast<vm::IntObject*>(object)->value);
+        }
+        else if (OBJECT_IS(object, &vm::realObjectType))
+        {
+            writer.write(ConstantTag::REAL);
+            writer.write(static_cast<vm::RealObject*>(object)->value);
+        }
+        else if (OBJECT_IS(object, &vm::stringObjectType))
+        {
+            const auto& value = static_cast<vm::StringObject*>(object)->value;
+            writer.write(ConstantTag::STRING);
+            writer.write(static_cast<u32>(value.size()));
+            for (auto c : value)
+            {
+                writer.write(static_cast<u32>(c));
+            }
+        }
+        else if (OBJECT_IS(object, &vm::stringVectorObjectType))
+        {
+            writer.write(ConstantTag::STRING_VECTOR);
+            writer.writeStrings(static_cast<vm::StringVectorObject*>(object)->value);
+        }
+        else
+        {
+            writer.write(ConstantTag::CODE_OBJECT);
+            writeCodeObject(writer, static_cast<vm::CodeObject*>(object), table);
+        }
+    }
+
+    std::string out;
+    Writer headerWriter(out);
+    out.append(MAGIC, sizeof(MAGIC));
+    headerWriter.write(BYTECODE_CACHE_VERSION);
+    headerWriter.write(static_cast<u32>(periwinkle::Periwinkle::getVersionAsInt()));
+    headerWriter.write(static_cast<u32>(vm::OpCode::COUNT));
+    headerWriter.write(static_cast<u64>(sourceText.size()));
+    headerWriter.write(fnv1aHash(sourceText));
+    headerWriter.write(fnv1aHash(payload));
+    out += payload;
+    return out;
+}
+
+vm::CodeObject* compiler::deserializeCodeObject(std::string_view data, periwinkle::ProgramSource* source)
+{
+    if (data.size() < sizeof(MAGIC) || std::memcmp(data.data(), MAGIC, sizeof(MAGIC)) != 0)
+    {
+        return nullptr;
+    }
+    auto text = source->getText();
+    Reader reader(data.substr(sizeof(MAGIC)));
+    if (reader.read<vm::WORD>() != BYTECODE_CACHE_VERSION
+        || reader.read<u32>() != static_cast<u32>(periwinkle::Periwinkle::getVersionAsInt())
+        || reader.read<u32>() != static_cast<u32>(vm::OpCode::COUNT)
+        || reader.read<u64>() != text.size()
+        || reader.read<u64>() != fnv1aHash(text))
+    {
+        return nullptr;
+    }
+    // Пошкоджені дані відкидаються до розбору, а некоректний байткод, записаний без
+    // пошкоджень, відкидає верифікатор
+    auto payloadHash = reader.read<u64>();
+    if (reader.failed || payloadHash != fnv1aHash(reader.remaining()))
+    {
+        return nullptr;
+    }
+
+    // Константи та CodeObject живуть до кінця роботи інтерпретатора
+    vm::ImmortalScope immortal(getCurrentState()->getGC());
+    std::vector<vm::Object*> objects(reader.readCount(sizeof(ConstantTag)));
+    for (auto& object : objects)
+    {
+        switch (reader.read<ConstantTag>())
+        {
+        case ConstantTag::NULL_CONST:
+            object = &vm::P_null;
+            break;
+        case ConstantTag::TRUE_CONST:
+            object = &vm::P_true;
+            break;
+        case ConstantTag::FALSE_CONST:
+            object = &vm::P_false;
+            break;
+        case ConstantTag::INT:
+            object = vm::IntObject::create(reader.read<i64>());
+            break;
+        case ConstantTag::REAL:
+            object = vm::RealObject::create(reader.read<double>());
+            break;
+        case ConstantTag::STRING:
+        {
+            std::u32string value(reader.readCount(sizeof(u32)), U'\0');
+            for (auto& c : value)
+            {
+                c = static_cast<char32_t>(reader.read<u32>());
+            }
+            object = vm::StringObject::create(value);
+            break;
+        }
+        case ConstantTag::STRING_VECTOR:
+            object = vm::StringVectorObject::create(reader.readStrings());
+            break;
+        case ConstantTag::CODE_OBJECT:
+        {
+            // CodeObject посилається лише на вже прочитані об'єкти
+            object = readCodeObject(reader, { objects.data(), &object }, source);
+            break;
+        }
+        default:
+            return nullptr;
+        }
+        if (reader.failed || object == nullptr)
+        {
+            return nullptr;
+        }
+    }
+    if (objects.empty() || !reader.atEnd() || !OBJECT_IS(objects.back(), &vm::codeObjectType))
+    {
+        return nullptr;
+    }
+    auto codeObject = static_cast<vm::CodeObject*>(objects.back());
+    Verifier verifier;
+    return verifier.verify(codeObject) ? codeObject : nullptr;
+}
+
+vm::CodeObject* compiler::BytecodeCache::load()
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return nullptr;
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return deserializeCodeObject(ss.str(), source);
+}
+
+bool compiler::BytecodeCache::store(vm::CodeObject* codeObject)
+{
+    auto data = serializeCodeObject(codeObject, source->getText());
+    if (!data)
+    {
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+    if (error)
+    {
+        return false;
+    }
+    // Файл записується під тимчасовим іменем і перейменовується, щоб інші процеси
+    // не прочитали частково записаний кеш
+    auto temporaryPath = path;
+    temporaryPath += "." + std::to_string(platform::processId());
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(data->data(), static_cast<std::streamsize>(data->size())))
+        {
+            file.close();
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error)
+    {
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+    return true;
+}
+
+compiler::BytecodeCache::BytecodeCache(periwinkle::ProgramSource* source, const std::filesystem::path& cacheDirectory)
+    : source(source)
+{
+    auto sourcePath = source->getPath();
+    if (cacheDirectory.empty())
+    {
+        path = sourcePath.parent_path() / std::filesystem::path(u8"__кеш__") / sourcePath.filename();
+    }
+    else
+    {
+        // В спільній теці кешу програми з однаковими іменами з різних тек розрізняються
+        // за хешем повного шляху
+        std::error_code error;
+        auto canonicalPath = std::filesystem::weakly_canonical(sourcePath, error);
+        if (error)
+        {
+            canonicalPath = std::filesystem::absolute(sourcePath, error);
+        }
+        path = cacheDirectory / sourcePath.filename();
+        path += std::format(".{:016x}", fnv1aHash(canonicalPath.string()));
+    }
+    path += std::filesystem::path(u8".бк");
+}
@@ -0,0 +1,533 @@
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include "bytecode_image.hpp"
+#include "bytecode_cache.hpp"
+#include "verifier.hpp"
+#include "int_object.hpp"
+#include "real_object.hpp"
+#include "bool_object.hpp"
+#include "null_object.hpp"
+#include "string_object.hpp"
+#include "string_vector_object.hpp"
+#include "exception_object.hpp"
+#include "periwinkle.hpp"
+#include "platform.hpp"
+
+using namespace compiler;
+
+// Формат образу: заголовок, таблиця об'єктів з записами однакового розміру, потім дані,
+// на які посилаються записи. Посилання - зміщення від початку образу, масиви вирівняні
+// за своїм типом, тому байткод та таблиці рядків використовуються прямо з відображеної
+// пам'яті. Як і кеш, образ записується в порядку байтів платформи
+static constexpr char MAGIC[4] = { 'P', 'W', 'I', 'M' };
+// Записується в заголовок як число, щоб відкинути образ з іншим порядком байтів
+static constexpr u32 BYTE_ORDER_MARK = 0x01020304;
+
+enum class ImageTag : u32
+{
+    NULL_CONST, TRUE_CONST, FALSE_CONST, INT, REAL, STRING, STRING_VECTOR, CODE_OBJECT
+};
+
+// Рядок або масив в образі
+struct ImageSpan
+{
+    u64 offset;
+    u64 count;
+};
+
+struct ImageHeader
+{
+    char magic[4];
+    u32 byteOrder;
+    vm::WORD formatVersion;
+    u32 interpreterVersion;
+    u32 opcodeCount;
+    u64 imageSize;
+    ImageSpan sourceName;
+    ImageSpan sourceText;
+    ImageSpan objects; // Масив ImageObject
+};
+
+struct ImageObject
+{
+    ImageTag tag;
+    u32 reserved;
+    // INT, REAL - біти значення. STRING - масив char32_t, STRING_VECTOR - масив ImageSpan
+    // рядків, CODE_OBJECT - один ImageCodeObject
+    ImageSpan value;
+};
+
+struct ImageCodeObject
+{
+    ImageSpan name;
+    ImageSpan code; // vm::WORD
+    ImageSpan constants; // u32, індекси в таблиці об'єктів
+    ImageSpan names; // Масиви ImageSpan рядків
+    ImageSpan locals;
+    ImageSpan cells;
+    ImageSpan freevars;
+    ImageSpan defaults;
+    ImageSpan linenos; // vm::LinenoEntry
+    ImageSpan exceptionHandlers; // vm::ExceptionHandler
+    vm::WORD arity;
+    vm::WORD maxStackDepth;
+    u32 isVariadic;
+    u64 dataOffset; // Початок даних CodeObject, які записуються перед записом
+    // Хеш FNV-1a даних CodeObject та запису до цього поля. Перевіряється при читанні тіла,
+    // тому пошкодження виявляється лише в тих функціях, які викликаються
+    u64 hash;
+};
+
+static_assert(std::is_trivially_copyable_v<vm::LinenoEntry>);
+static_assert(std::is_trivially_copyable_v<vm::ExceptionHandler>);
+
+class ImageWriter
+{
+private:
+    std::string out;
+
+    // Дописує дані, вирівняні на align, і повертає їх зміщення
+    u64 append(const void* bytes, size_t size, size_t align)
+    {
+        out.resize((out.size() + align - 1) / align * align, '\0');
+        auto offset = static_cast<u64>(out.size());
+        out.append(static_cast<const char*>(bytes), size);
+        return offset;
+    }
+public:
+    template<typename T>
+    ImageSpan writeArray(const T* values, size_t count)
+    {
+        return { append(values, count * sizeof(T), alignof(T)), count };
+    }
+
+    template<typename T>
+    u64 write(const T& value)
+    {
+        return append(&value, sizeof(T), alignof(T));
+    }
+
+    ImageSpan writeString(std::string_view value)
+    {
+        return writeArray(value.data(), value.size());
+    }
+
+    ImageSpan writeStrings(const std::vector<std::string>& values)
+    {
+        std::vector<ImageSpan> strings;
+        strings.reserve(values.size());
+        for (const auto& value : values)
+        {
+            strings.push_back(writeString(value));
+        }
+        return writeArray(strings.data(), strings.size());
+    }
+
+    // Перезаписує вже записане значення
+    template<typename T>
+    void patch(u64 offset, const T& value)
+    {
+        std::memcpy(out.data() + offset, &value, sizeof(T));
+    }
+
+    std::string& getData()
+    {
+        return out;
+    }
+};
+
+// Дані CodeObject та його запис без поля hash йдуть в образі підряд
+static u64 codeObjectHash(std::string_view data, u64 dataOffset, u64 recordOffset)
+{
+    return fnv1aHash(data.substr(dataOffset, recordOffset + offsetof(ImageCodeObject, hash) - dataOffset));
+}
+
+static ImageSpan writeCodeObject(ImageWriter& writer, vm::CodeObject* codeObject, const ModuleObjects& table)
+{
+    ImageCodeObject record{};
+    record.dataOffset = writer.getData().size();
+    record.name = writer.writeString(codeObject->name);
+    record.code = writer.writeArray(codeObject->code.data(), codeObject->code.size());
+    std::vector<u32> constants;
+    constants.reserve(codeObject->constants.size());
+    for (auto constant : codeObject->constants)
+    {
+        constants.push_back(table.indexes.at(constant));
+    }
+    record.constants = writer.writeArray(constants.data(), constants.size());
+    record.names = writer.writeStrings(codeObject->names);
+    record.locals = writer.writeStrings(codeObject->locals);
+    record.cells = writer.writeStrings(codeObject->cells);
+    record.freevars = writer.writeStrings(codeObject->freevars);
+    record.defaults = writer.writeStrings(codeObject->defaults);
+    std::vector<vm::LinenoEntry> linenos;
+    linenos.reserve(codeObject->ipToLineno.size());
+    for (auto [ip, lineno] : codeObject->ipToLineno)
+    {
+        linenos.push_back({ ip, lineno });
+    }
+    record.linenos = writer.writeArray(linenos.data(), linenos.size());
+    record.exceptionHandlers = writer.writeArray(codeObject->exceptionHandlers.data(),
+        codeObject->exceptionHandlers.size());
+    record.arity = codeObject->arity;
+    record.maxStackDepth = codeObject->maxStackDepth;
+    record.isVariadic = codeObject->isVariadic;
+    auto recordOffset = writer.write(record);
+    record.hash = codeObjectHash(writer.getData(), record.dataOffset, recordOffset);
+    writer.patch(recordOffset, record);
+    return { recordOffset, 1 };
+}
+
+bool compiler::writeBytecodeImage(vm::CodeObject* codeObject, periwinkle::ProgramSource* source,
+    const std::filesystem::path& path)
+{
+    ModuleObjects table;
+    if (!table.add(codeObject))
+    {
+        return false;
+    }
+
+    ImageWriter writer;
+    auto headerOffset = writer.write(ImageHeader{});
+    // Записи об'єктів заповнюються після запису їх даних
+    std::vector<ImageObject> records(table.objects.size());
+    auto objectsOffset = writer.writeArray(records.data(), records.size()).offset;
+    for (size_t i = 0; i < table.objects.size(); ++i)
+    {
+        auto object = table.objects[i];
+        auto& record = records[i];
+        if (object == &vm::P_null)
+        {
+            record.tag = ImageTag::NULL_CONST;
+        }
+        else if (object == &vm::P_true || object == &vm::P_false)
+        {
+            record.tag = object == &vm::P_true ? ImageTag::TRUE_CONST : ImageTag::FALSE_CONST;
+        }
+        else if (OBJECT_IS(object, &vm::intObjectType))
+        {
+            record.tag = ImageTag::INT;
+            std::memcpy(&record.value.offset, &static_cast<vm::IntObject*>(object)->value, sizeof(i64));
+        }
+        else if (OBJECT_IS(object, &vm::realObjectType))
+        {
+            record.tag = ImageTag::REAL;
+            std::memcpy(&record.value.offset, &static_cast<vm::RealObject*>(object)->value, sizeof(double));
+        }
+        else if (OBJECT_IS(object, &vm::stringObjectType))
+        {
+            const auto& value = static_cast<vm::StringObject*>(object)->value;
+            record.tag = ImageTag::STRING;
+            record.value = writer.writeArray(value.data(), value.size());
+        }
+        else if (OBJECT_IS(object, &vm::stringVectorObjectType))
+        {
+            record.tag = ImageTag::STRING_VECTOR;
+            record.value = writer.writeStrings(static_cast<vm::StringVectorObject*>(object)->value);
+        }
+        else
+        {
+            record.tag = ImageTag::CODE_OBJECT;
+            record.value = writeCodeObject(writer, static_cast<vm::CodeObject*>(object), table);
+        }
+    }
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        writer.patch(objectsOffset + i * sizeof(ImageObject), records[i]);
+    }
+
+    ImageHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.formatVersion = BYTECODE_IMAGE_VERSION;
+    header.interpreterVersion = static_cast<u32>(periwinkle::Periwinkle::getVersionAsInt());
+    header.opcodeCount = static_cast<u32>(vm::OpCode::COUNT);
+    header.sourceName = writer.writeString(source->getFilename());
+    header.sourceText = writer.writeString(source->getText());
+    header.objects = { objectsOffset, records.size() };
+    auto& data = writer.getData();
+    header.imageSize = data.size();
+    writer.patch(headerOffset, header);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    return static_cast<bool>(file.write(data.data(), static_cast<std::streamsize>(data.size())));
+}
+
+// Повертає вказівник на масив з count елементів T за зміщенням offset, або nullptr, якщо
+// масив виходить за межі образу або не вирівняний
+template<typename T>
+static const T* imageArray(const char* data, size_t size, ImageSpan span)
+{
+    if (span.offset > size || span.offset % alignof(T) != 0 || (size - span.offset) / sizeof(T) < span.count)
+    {
+        return nullptr;
+    }
+    return reinterpret_cast<const T*>(data + span.offset);
+}
+
+static bool readStrings(const char* data, size_t size, ImageSpan span, std::vector<std::string>& values)
+{
+    auto strings = imageArray<ImageSpan>(data, size, span);
+    if (strings == nullptr)
+    {
+        return false;
+    }
+    values.reserve(span.count);
+    for (u64 i = 0; i < span.count; ++i)
+    {
+        auto chars = imageArray<char>(data, size, strings[i]);
+        if (chars == nullptr)
+        {
+            return false;
+        }
+        values.emplace_back(chars, strings[i].count);
+    }
+    return true;
+}
+
+// Тіло функції в образі, яке ще не прочитане
+struct compiler::ImageBody
+{
+    BytecodeImage* image;
+    const ImageCodeObject* record;
+    u64 index; // Номер запису CodeObject в таблиці об'єктів
+};
+
+// Створює CodeObject без тіла: ім'я, параметри та розмітку фрейму, потрібні для створення
+// функції та перевірки аргументів. Тіло читається в BytecodeImage::readBody
+static vm::CodeObject* readCodeObject(const char* data, size_t size, ImageSpan span,
+    periwinkle::ProgramSource* source)
+{
+    auto record = imageArray<ImageCodeObject>(data, size, span);
+    if (record == nullptr || span.count != 1)
+    {
+        return nullptr;
+    }
+    auto name = imageArray<char>(data, size, record->name);
+    if (name == nullptr)
+    {
+        return nullptr;
+    }
+
+    auto codeObject = vm::CodeObject::create(std::string(name, record->name.count));
+    codeObject->source = source;
+    codeObject->arity = record->arity;
+    codeObject->isVariadic = record->isVariadic != 0;
+    if (!readStrings(data, size, record->locals, codeObject->locals)
+        || !readStrings(data, size, record->cells, codeObject->cells)
+        || !readStrings(data, size, record->freevars, codeObject->freevars)
+        || !readStrings(data, size, record->defaults, codeObject->defaults))
+    {
+        return nullptr;
+    }
+    // Аргументи перевіряються до читання тіла, тому кількість параметрів перевіряється вже тут
+    if (codeObject->defaults.size() > codeObject->arity)
+    {
+        return nullptr;
+    }
+    codeObject->computeFrameLayout();
+    return codeObject;
+}
+
+bool compiler::BytecodeImage::isImage(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(MAGIC)];
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+compiler::BytecodeImage* compiler::BytecodeImage::open(const std::filesystem::path& path)
+{
+    size_t size = 0;
+    auto data = static_cast<const char*>(platform::mapFile(path, size));
+    if (data == nullptr)
+    {
+        return nullptr;
+    }
+    auto header = reinterpret_cast<const ImageHeader*>(data);
+    if (size < sizeof(ImageHeader)
+        || std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0
+        || header->byteOrder != BYTE_ORDER_MARK
+        || header->formatVersion != BYTECODE_IMAGE_VERSION
+        || header->interpreterVersion != static_cast<u32>(periwinkle::Periwinkle::getVersionAsInt())
+        || header->opcodeCount != static_cast<u32>(vm::OpCode::COUNT)
+        || header->imageSize != size
+        || imageArray<char>(data, size, header->sourceName) == nullptr
+        || imageArray<char>(data, size, header->sourceText) == nullptr)
+    {
+        platform::unmapFile(data, size);
+        return nullptr;
+    }
+    auto image = new BytecodeImage();
+    image->data = data;
+    image->size = size;
+    return image;
+}
+
+std::string_view compiler::BytecodeImage::getSourceName() const
+{
+    auto header = reinterpret_cast<const ImageHeader*>(data);
+    return { data + header->sourceName.offset, header->sourceName.count };
+}
+
+std::string_view compiler::BytecodeImage::getSourceText() const
+{
+    auto header = reinterpret_cast<const ImageHeader*>(data);
+    return { data + header->sourceText.offset, header->sourceText.count };
+}
+
+vm::Object* compiler::BytecodeImage::getObject(u64 index)
+{
+    if (objects[index] != nullptr)
+    {
+        return objects[index];
+    }
+    auto header = reinterpret_cast<const ImageHeader*>(data);
+    const auto& record = reinterpret_cast<const ImageObject*>(data + header->objects.offset)[index];
+    vm::Object* object = nullptr;
+    switch (record.tag)
+    {
+    case ImageTag::NULL_CONST:
+        object = &vm::P_null;
+        break;
+    case ImageTag::TRUE_CONST:
+        object = &vm::P_true;
+        break;
+    case ImageTag::FALSE_CONST:
+        object = &vm::P_false;
+        break;
+    case ImageTag::INT:
+    {
+        i64 value;
+        std::memcpy(&value, &record.value.offset, sizeof(value));
+        object = vm::IntObject::create(value);
+        break;
+    }
+    case ImageTag::REAL:
+    {
+        double value;
+        std::memcpy(&value, &record.value.offset, sizeof(value));
+        object = vm::RealObject::create(value);
+        break;
+    }
+    case ImageTag::STRING:
+    {
+        // StringObject володіє своїм рядком, тому рядкові константи копіюються
+        auto chars = imageArray<char32_t>(data, size, record.value);
+        object = chars ? vm::StringObject::create(std::u32string(chars, record.value.count)) : nullptr;
+        break;
+    }
+    case ImageTag::STRING_VECTOR:
+    {
+        std::vector<std::string> values;
+        object = readStrings(data, size, record.value, values)
+            ? vm::StringVectorObject::create(std::move(values)) : nullptr;
+        break;
+    }
+    case ImageTag::CODE_OBJECT:
+    {
+        auto codeObject = readCodeObject(data, size, record.value, source);
+        if (codeObject != nullptr)
+        {
+            codeObject->imageBody = new ImageBody{ this,
+                reinterpret_cast<const ImageCodeObject*>(data + record.value.offset), index };
+        }
+        object = codeObject;
+        break;
+    }
+    default:
+        break;
+    }
+    objects[index] = object;
+    return object;
+}
+
+bool compiler::BytecodeImage::readBody(vm::CodeObject* codeObject)
+{
+    auto body = codeObject->imageBody;
+    auto record = body->record;
+    auto recordOffset = static_cast<u64>(reinterpret_cast<const char*>(record) - data);
+    if (record->dataOffset > recordOffset
+        || record->hash != codeObjectHash({ data, size }, record->dataOffset, recordOffset))
+    {
+        return false;
+    }
+    auto code = imageArray<vm::WORD>(data, size, record->code);
+    auto constants = imageArray<u32>(data, size, record->constants);
+    auto linenos = imageArray<vm::LinenoEntry>(data, size, record->linenos);
+    auto handlers = imageArray<vm::ExceptionHandler>(data, size, record->exceptionHandlers);
+    if (code == nullptr || constants == nullptr || linenos == nullptr || handlers == nullptr
+        || record->code.count == 0)
+    {
+        return false;
+    }
+
+    codeObject->maxStackDepth = record->maxStackDepth;
+    codeObject->borrowedCode = { code, record->code.count };
+    codeObject->borrowedLinenos = { linenos, record->linenos.count };
+    codeObject->exceptionHandlers.assign(handlers, handlers + record->exceptionHandlers.count);
+    // Константи та вкладені CodeObject живуть до кінця роботи інтерпретатора
+    vm::ImmortalScope immortal(getCurrentState()->getGC());
+    // Після невдалого читання тіло читається знову при наступному виклику
+    codeObject->constants.clear();
+    codeObject->names.clear();
+    codeObject->constants.reserve(record->constants.count);
+    for (u64 i = 0; i < record->constants.count; ++i)
+    {
+        // CodeObject посилається лише на записи перед ним, тому посилання не утворюють циклів
+        auto constant = constants[i] < body->index ? getObject(constants[i]) : nullptr;
+        if (constant == nullptr)
+        {
+            return false;
+        }
+        codeObject->constants.push_back(constant);
+    }
+    if (!readStrings(data, size, record->names, codeObject->names))
+    {
+        return false;
+    }
+    codeObject->imageBody = nullptr;
+    delete body;
+    return true;
+}
+
+vm::CodeObject* compiler::BytecodeImage::load(periwinkle::ProgramSource* source)
+{
+    auto header = reinterpret_cast<const ImageHeader*>(data);
+    if (imageArray<ImageObject>(data, size, header->objects) == nullptr || header->objects.count == 0)
+    {
+        return nullptr;
+    }
+    this->source = source;
+    objects.assign(header->objects.count, nullptr);
+
+    // Модуль - останній запис. Тіла функцій читаються та верифікуються при першому виклику
+    vm::ImmortalScope immortal(getCurrentState()->getGC());
+    auto object = getObject(header->objects.count - 1);
+    if (object == nullptr || !OBJECT_IS(object, &vm::codeObjectType))
+    {
+        return nullptr;
+    }
+    auto codeObject = static_cast<vm::CodeObject*>(object);
+    Verifier verifier;
+    return readBody(codeObject) && verifier.verify(codeObject) ? codeObject : nullptr;
+}
+
+bool compiler::loadImageBody(vm::CodeObject* codeObject)
+{
+    Verifier verifier;
+    if (!codeObject->imageBody->image->readBody(codeObject) || !verifier.verifyFunction(codeObject))
+    {
+        getCurrentState()->setException(&vm::InternalErrorObjectType, "Образ програми пошкоджений");
+        return false;
+    }
+    return true;
+}
+
+compiler::BytecodeImage::~BytecodeImage()
+{
+    platform::unmapFile(data, size);
+}
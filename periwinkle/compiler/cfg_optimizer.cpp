@@ -0,0 +1,417 @@
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "cfg_optimizer.hpp"
+#include "builtins.hpp"
+#include "disassembler.hpp"
+#include "plogger.hpp"
+
+using namespace compiler;
+using enum vm::OpCode;
+
+static bool isCall(vm::OpCode op)
+{
+    return op == CALL || op == CALL_NA || op == CALL_METHOD || op == CALL_METHOD_NA
+        || op == TAIL_CALL || op == TAIL_CALL_NA;
+}
+
+void compiler::CfgOptimizer::collectStoredGlobals(vm::CodeObject* function)
+{
+    if (function->deferredBody != nullptr)
+    {
+        storedGlobalsKnown = false;
+        return;
+    }
+    for (const auto& instruction : Disassembler::decode(function).instructions)
+    {
+        if (instruction.op == STORE_GLOBAL || instruction.op == DELETE_GLOBAL)
+        {
+            storedInFunctions.insert(function->names[instruction.operand]);
+        }
+    }
+    for (auto constant : function->constants)
+    {
+        if (OBJECT_IS(constant, &vm::codeObjectType))
+        {
+            collectStoredGlobals(static_cast<vm::CodeObject*>(constant));
+        }
+    }
+}
+
+void compiler::CfgOptimizer::eliminateDeadStores()
+{
+    auto localCount = codeObject->locals.size();
+    if (localCount == 0)
+    {
+        return;
+    }
+    graph.analyze();
+    const auto& layout = graph.layout;
+    // Змінні, значення яких може бути прочитане після початку блоку
+    std::vector<std::vector<bool>> liveIn(layout.size(), std::vector<bool>(localCount, false));
+
+    // Обчислює живі змінні на початку блоку. Змінні, які читає обробник винятку блоку,
+    // живі в кожній його точці, бо виняток може виникнути на будь-якій інструкції
+    auto transfer = [&](BasicBlock* block, bool removeDeadStores)
+    {
+        std::vector<bool> live(localCount, false);
+        for (auto successor : ControlFlowGraph::successors(block))
+        {
+            std::transform(live.begin(), live.end(), liveIn[successor->position].begin(),
+                live.begin(), std::logical_or<>());
+        }
+        std::vector<bool> exceptionLive(localCount, false);
+        if (block->exceptionTarget)
+        {
+            exceptionLive = liveIn[block->exceptionTarget->position];
+            std::transform(live.begin(), live.end(), exceptionLive.begin(),
+                live.begin(), std::logical_or<>());
+        }
+        for (auto instruction = block->instructions.rbegin();
+            instruction != block->instructions.rend(); ++instruction)
+        {
+            auto local = instruction->operand;
+            switch (instruction->op)
+            {
+            case STORE_LOCAL:
+                if (!live[local] && removeDeadStores)
+                {
+                    instruction->op = POP;
+                    instruction->operand = 0;
+                }
+                live[local] = exceptionLive[local];
+                break;
+            case LOAD_LOCAL:
+            case LOAD_LOCAL_FAST:
+            case DELETE_LOCAL:
+                live[local] = true;
+                break;
+            default:
+                break;
+            }
+        }
+        return live;
+    };
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto block = layout.rbegin(); block != layout.rend(); ++block)
+        {
+            auto live = transfer(*block, false);
+            if (live != liveIn[(*block)->position])
+            {
+                liveIn[(*block)->position] = std::move(live);
+                changed = true;
+            }
+        }
+    }
+    for (auto block : layout)
+    {
+        transfer(block, true);
+    }
+}
+
+std::optional<vm::WORD> compiler::CfgOptimizer::hoistedLocal(const std::string& name)
+{
+    if (auto it = hoistedLocals.find(name); it != hoistedLocals.end())
+    {
+        return it->second;
+    }
+    auto& locals = codeObject->locals;
+    if (std::find(locals.begin(), locals.end(), name) != locals.end())
+    {
+        return std::nullopt;
+    }
+    if (locals.empty())
+    {
+        // Слот 0 кореневого фрейму не використовується, як слот функції у фреймах функцій
+        locals.push_back(codeObject->name);
+    }
+    // Змінна має ім'я глобальної, тому NameError з неї має те саме повідомлення
+    auto local = static_cast<vm::WORD>(locals.size());
+    locals.push_back(name);
+    hoistedLocals.emplace(name, local);
+    return local;
+}
+
+void compiler::CfgOptimizer::hoistLoopGlobals(const Loop& loop)
+{
+    auto header = loop.header;
+    if (header->isHandlerBoundary)
+    {
+        return;
+    }
+    std::unordered_set<vm::WORD> storedNames;
+    bool hasCalls = false;
+    for (auto block : loop.blocks)
+    {
+        for (const auto& instruction : block->instructions)
+        {
+            if (instruction.op == STORE_GLOBAL || instruction.op == DELETE_GLOBAL)
+            {
+                storedNames.insert(instruction.operand);
+            }
+            hasCalls |= isCall(instruction.op);
+        }
+    }
+
+    // Виклик у циклі може виконати будь-яку функцію модуля, зокрема поточну
+    auto builtin = vm::getBuiltin();
+    std::vector<vm::WORD> hoisted;
+    std::unordered_map<vm::WORD, std::optional<vm::WORD>> localByName;
+    for (auto block : loop.blocks)
+    {
+        for (const auto& instruction : block->instructions)
+        {
+            if (instruction.op != LOAD_GLOBAL || storedNames.contains(instruction.operand)
+                || localByName.contains(instruction.operand))
+            {
+                continue;
+            }
+            const auto& name = codeObject->names[instruction.operand];
+            if (hasCalls && (!storedGlobalsKnown || storedInFunctions.contains(name)))
+            {
+                localByName.emplace(instruction.operand, std::nullopt);
+                continue;
+            }
+            auto local = hoistedLocal(name);
+            localByName.emplace(instruction.operand, local);
+            if (local)
+            {
+                hoisted.push_back(instruction.operand);
+            }
+        }
+    }
+    if (hoisted.empty())
+    {
+        return;
+    }
+
+    // Вбудований об'єкт завжди визначений. Глобальна змінна може бути не визначеною, тоді
+    // в локальній змінній залишається nullptr, і помилку викидає LOAD_LOCAL там, де раніше
+    // її викидав LOAD_GLOBAL
+    auto preheader = graph.createBlock();
+    auto lineno = header->instructions.empty()
+        ? std::nullopt : header->instructions.front().lineno;
+    for (auto nameIdx : hoisted)
+    {
+        bool isBuiltin = builtin->contains(codeObject->names[nameIdx]);
+        preheader->instructions.push_back({ isBuiltin ? LOAD_GLOBAL : LOAD_GLOBAL_OR_NULL, nameIdx, std::nullopt, lineno });
+        preheader->instructions.push_back({ STORE_LOCAL, localByName[nameIdx].value(), std::nullopt, lineno });
+    }
+    preheader->next = header;
+
+    std::unordered_set<BasicBlock*> inLoop(loop.blocks.begin(), loop.blocks.end());
+    for (auto predecessor : header->predecessors)
+    {
+        if (inLoop.contains(predecessor))
+        {
+            continue;
+        }
+        if (predecessor->next == header)
+        {
+            predecessor->next = preheader;
+        }
+        if (!predecessor->instructions.empty() && predecessor->instructions.back().target == header)
+        {
+            predecessor->instructions.back().target = preheader;
+        }
+    }
+    for (auto block : loop.blocks)
+    {
+        for (auto& instruction : block->instructions)
+        {
+            if (instruction.op != LOAD_GLOBAL)
+            {
+                continue;
+            }
+            if (auto local = localByName.find(instruction.operand);
+                local != localByName.end() && local->second)
+            {
+                bool isBuiltin = builtin->contains(codeObject->names[instruction.operand]);
+                instruction.op = isBuiltin ? LOAD_LOCAL_FAST : LOAD_LOCAL;
+                instruction.operand = local->second.value();
+            }
+        }
+    }
+    graph.layout.insert(graph.layout.begin() + header->position, preheader);
+    graph.updatePositions();
+}
+
+void compiler::CfgOptimizer::hoistGlobalLoads()
+{
+    graph.analyze();
+    auto loops = graph.findLoops();
+    // Спочатку зовнішні цикли, тоді винесене з них завантаження зникає і з вкладених
+    std::stable_sort(loops.begin(), loops.end(),
+        [](const Loop& a, const Loop& b) { return a.blocks.size() > b.blocks.size(); });
+    for (const auto& loop : loops)
+    {
+        hoistLoopGlobals(loop);
+    }
+}
+
+bool compiler::CfgOptimizer::rotateLoop(const Loop& loop)
+{
+    auto& layout = graph.layout;
+    auto header = loop.header;
+    std::unordered_set<BasicBlock*> inLoop(loop.blocks.begin(), loop.blocks.end());
+    auto last = *std::max_element(loop.blocks.begin(), loop.blocks.end(),
+        [](BasicBlock* a, BasicBlock* b) { return a->position < b->position; });
+    // Вигідно, лише якщо останній блок тіла переходить на початок циклу
+    if (last->next != header || header->isHandlerBoundary)
+    {
+        return false;
+    }
+
+    // Умова - блоки від заголовка до умовного виходу з циклу, розміщені поспіль.
+    // Переходи всередині умови ведуть лише вперед у її межах
+    BasicBlock* condition = nullptr;
+    size_t furthestTarget = header->position;
+    for (auto position = header->position; position < layout.size() && !condition; ++position)
+    {
+        auto block = layout[position];
+        if (!inLoop.contains(block) || block->instructions.empty() || block->isHandlerBoundary
+            || block->region != header->region)
+        {
+            return false;
+        }
+        if (block != header)
+        {
+            for (auto predecessor : block->predecessors)
+            {
+                if (predecessor->position < header->position || predecessor->position >= position)
+                {
+                    return false;
+                }
+            }
+        }
+        const auto& jump = block->instructions.back();
+        if ((jump.op == JMP_IF_FALSE || jump.op == JMP_IF_TRUE)
+            && !inLoop.contains(jump.target) && inLoop.contains(block->next))
+        {
+            condition = block;
+            break;
+        }
+        for (auto successor : ControlFlowGraph::successors(block))
+        {
+            if (successor->position <= position)
+            {
+                return false;
+            }
+            furthestTarget = std::max(furthestTarget, successor->position);
+        }
+        if (position + 1 == layout.size() || block->next != layout[position + 1])
+        {
+            return false;
+        }
+    }
+    if (!condition || furthestTarget > condition->position)
+    {
+        return false;
+    }
+    auto body = condition->next;
+    if (body->position != condition->position + 1 || body->isHandlerBoundary
+        || last->position <= condition->position || last->region != header->region)
+    {
+        return false;
+    }
+    // Остання інструкція перед межею обробника не входить в його діапазон,
+    // тому умова не розміщується перед межею
+    if (last->position + 1 < layout.size())
+    {
+        auto after = layout[last->position + 1];
+        if (after->isHandlerBoundary || after->region != last->region)
+        {
+            return false;
+        }
+    }
+
+    if (header == layout.front())
+    {
+        // Вхід залишається першим блоком і переходить на умову
+        auto entry = graph.createBlock();
+        entry->next = header;
+        layout.insert(layout.begin(), entry);
+        graph.updatePositions();
+    }
+    auto& jump = condition->instructions.back();
+    jump.op = jump.op == JMP_IF_FALSE ? JMP_IF_TRUE : JMP_IF_FALSE;
+    condition->next = jump.target;
+    jump.target = body;
+
+    auto first = layout.begin() + header->position;
+    std::vector<BasicBlock*> chain(first, layout.begin() + condition->position + 1);
+    layout.erase(first, layout.begin() + condition->position + 1);
+    layout.insert(layout.begin() + (last->position - chain.size() + 1), chain.begin(), chain.end());
+    graph.updatePositions();
+    return true;
+}
+
+void compiler::CfgOptimizer::rotateLoops()
+{
+    graph.analyze();
+    auto loops = graph.findLoops();
+    // Спочатку вкладені цикли, щоб останній блок зовнішнього циклу був уже на своєму місці
+    std::stable_sort(loops.begin(), loops.end(),
+        [](const Loop& a, const Loop& b) { return a.blocks.size() < b.blocks.size(); });
+    for (const auto& loop : loops)
+    {
+        rotateLoop(loop);
+    }
+}
+
+void compiler::CfgOptimizer::optimizeCodeObject(vm::CodeObject* codeObject)
+{
+    this->codeObject = codeObject;
+    hoistedLocals.clear();
+    graph.build(codeObject);
+    eliminateDeadStores();
+    hoistGlobalLoads();
+    rotateLoops();
+    graph.linearize(codeObject);
+    if (!hoistedLocals.empty())
+    {
+        codeObject->computeFrameLayout();
+    }
+}
+
+void compiler::CfgOptimizer::optimizeNested(vm::CodeObject* codeObject)
+{
+    if (codeObject->deferredBody != nullptr)
+    {
+        return;
+    }
+    optimizeCodeObject(codeObject);
+    for (auto constant : codeObject->constants)
+    {
+        if (OBJECT_IS(constant, &vm::codeObjectType))
+        {
+            optimizeNested(static_cast<vm::CodeObject*>(constant));
+        }
+    }
+}
+
+void compiler::CfgOptimizer::optimize(vm::CodeObject* codeObject)
+{
+    storedInFunctions.clear();
+    storedGlobalsKnown = true;
+    for (auto constant : codeObject->constants)
+    {
+        if (OBJECT_IS(constant, &vm::codeObjectType))
+        {
+            collectStoredGlobals(static_cast<vm::CodeObject*>(constant));
+        }
+    }
+    optimizeNested(codeObject);
+}
+
+void compiler::CfgOptimizer::optimizeDeferred(vm::CodeObject* function)
+{
+    storedInFunctions.clear();
+    storedGlobalsKnown = false;
+    optimizeNested(function);
+}
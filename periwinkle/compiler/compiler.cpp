@@ -1,9 +1,14 @@
 #include <algorithm>
+#include <bit>
 #include <variant>
 #include <unordered_set>
 #include <format>
 
 #include "compiler.hpp"
+#include "verifier.hpp"
+#include "constant_folder.hpp"
+#include "cfg_optimizer.hpp"
+#include "peephole_optimizer.hpp"
 #include "code_object.hpp"
 #include "bool_object.hpp"
 #include "int_object.hpp"
@@ -23,55 +28,132 @@ using namespace ast;
 using enum vm::OpCode;
 using enum ast::NodeKind;
 
-#define FIND_CONST_IDX(OBJECT, OBJECT_TYPE)                               \
-    for (vm::WORD i = 0; i < (vm::WORD)codeObject->constants.size(); ++i) \
-    {                                                                     \
-        auto constant = codeObject->constants[i];                         \
-        if (OBJECT_IS(constant, &vm::OBJECT_TYPE) == false)               \
-        {                                                                 \
-            continue;                                                     \
-        }                                                                 \
-        else if (((vm::OBJECT*)constant)->value == value)                 \
-        {                                                                 \
-            return i;                                                     \
-        }                                                                 \
-    }                                                                     \
-    codeObject->constants.push_back(vm::OBJECT::create(value));           \
-    return vm::WORD(codeObject->constants.size() - 1);
+static constexpr const char* BREAK_OUTSIDE_LOOP = "Оператор \"завершити\" знаходиться поза циклом";
+static constexpr const char* CONTINUE_OUTSIDE_LOOP = "Оператор \"пропустити\" знаходиться поза циклом";
 
 #define STATE_POP() stateStack.pop_back()
 #define STATE_BACK(stateType) ((stateType*)stateStack.back())
 #define PUSH_SCOPE(node) scopeStack.push_back(scopeInfo[node])
-#define SCOPE_POP()               \
-    {                             \
-        delete scopeStack.back(); \
-        scopeStack.pop_back();    \
-    }
+// Області видимості звільняються разом з ареною компіляції
+#define SCOPE_POP() scopeStack.pop_back()
 #define SCOPE_BACK() scopeStack.back()
 
 struct LoopState : CompilerState
 {
     vm::WORD startIp; // Початок циклу
+    bool isForEach; // Цикл "обійти" тримає ітератор на стеку
     // Адреси, що будуть будуть змінені на адресу кінці циклу
-    std::vector<vm::WORD> addressesForPatchWithEndBlock;
+    ast::ArenaVector<vm::WORD> addressesForPatchWithEndBlock;
 };
 
 struct FunctionState : CompilerState
 {
     vm::CodeObject* codeObject;
+    // Кількість блоків "спробувати", всередині яких зараз компілюється код функції.
+    // Виклик в них не може бути хвостовим, бо виняток з нього має обробити цей фрейм
+    size_t tryDepth = 0;
 };
 
-#define PUSH_LOOP_STATE(startIp) \
-    stateStack.push_back(new LoopState{{CompilerStateType::LOOP}, startIp})
+#define PUSH_LOOP_STATE(startIp, isForEach) \
+    stateStack.push_back(new LoopState{{CompilerStateType::LOOP}, startIp, isForEach})
 
 #define PUSH_FUNCTION_STATE(codeObject) \
     stateStack.push_back(new FunctionState{{CompilerStateType::FUNCTION}, codeObject})
 
+// Чи можна виклик в "повернути" виконати як TAIL_CALL або TAIL_CALL_NA. Виклики методів
+// компілюються звичайно
+static bool canTailCall(Expression* expression, FunctionState* state)
+{
+    if (expression->kind != CALL_EXPRESSION || state->tryDepth)
+    {
+        return false;
+    }
+    auto call = (CallExpression*)expression;
+    return call->callable->kind != ATTRIBUTE_EXPRESSION;
+}
+
+// Залишає присвоєними лише змінні, присвоєні в обох гілках
+static void intersectAssigned(std::vector<bool>& assigned, const std::vector<bool>& other)
+{
+    for (size_t i = 0; i < assigned.size(); ++i)
+    {
+        assigned[i] = assigned[i] && other[i];
+    }
+}
+
+// Збирає імена змінних, які видаляє DELETE_LOCAL всередині node. Зараз змінні
+// видаляються лише в кінці блоку "зловити", вкладені функції мають власні фрейми
+static void collectDeletedNames(ast::Node* node, std::vector<std::string>& names)
+{
+    switch (node->kind)
+    {
+    case BLOCK_STATEMENT:
+        for (auto statement : ((BlockStatement*)node)->statements)
+        {
+            collectDeletedNames(statement, names);
+        }
+        break;
+    case WHILE_STATEMENT:
+        collectDeletedNames(((WhileStatement*)node)->block.get(), names);
+        break;
+    case IF_STATEMENT:
+    {
+        auto ifStatement = (IfStatement*)node;
+        collectDeletedNames(ifStatement->block.get(), names);
+        if (ifStatement->elseOrIf)
+        {
+            collectDeletedNames(ifStatement->elseOrIf.value().get(), names);
+        }
+        break;
+    }
+    case ELSE_STATEMENT:
+        collectDeletedNames(((ElseStatement*)node)->block.get(), names);
+        break;
+    case FOR_EACH_STATEMENT:
+        collectDeletedNames(((ForEachStatement*)node)->block.get(), names);
+        break;
+    case TRY_CATCH_STATEMENT:
+    {
+        auto tryStatement = (TryCatchStatement*)node;
+        collectDeletedNames(tryStatement->block.get(), names);
+        for (auto catchBlock : tryStatement->catchBlocks)
+        {
+            if (catchBlock->variableName.has_value())
+            {
+                names.emplace_back(catchBlock->variableName.value().text);
+            }
+            collectDeletedNames(catchBlock->block.get(), names);
+        }
+        if (tryStatement->finallyBlock.has_value())
+        {
+            collectDeletedNames(tryStatement->finallyBlock.value()->block.get(), names);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
 
 vm::Frame* compiler::Compiler::compile()
 {
-    ScopeAnalyzer scopeAnalyzer(root);
-    scopeInfo = scopeAnalyzer.analyze();
+    // Області видимості визначаються до згортання констант, тому змінні з відкинутих
+    // гілок залишаються локальними, як і без нього
+    auto phaseTimer = getCurrentState()->getPhaseTimer();
+    {
+        periwinkle::PhaseScope phase(phaseTimer, "області видимості");
+        ScopeAnalyzer scopeAnalyzer(root);
+        scopeInfo = scopeAnalyzer.analyze();
+    }
+    periwinkle::PhaseScope phase(phaseTimer, "компіляція");
+    // Проміжні значення згортання - звичайні об'єкти, які прибере збирач сміття
+    ConstantFolder constantFolder(root);
+    constantFolder.foldConstants();
+    // Константи та CodeObject живуть до кінця роботи інтерпретатора
+    vm::ImmortalScope immortal(getCurrentState()->getGC());
+    CodeObjectIndexes rootIndexes;
+    indexes = &rootIndexes;
     PUSH_SCOPE(root);
     for (auto statement = root->statements.begin(); statement != root->statements.end(); ++statement)
     {
@@ -85,6 +167,15 @@ vm::Frame* compiler::Compiler::compile()
         emitOpCode(LOAD_CONST, nullConstIdx());
         emitOpCode(RETURN);
     }
+    CfgOptimizer cfgOptimizer;
+    cfgOptimizer.optimize(codeObject);
+    PeepholeOptimizer peepholeOptimizer;
+    peepholeOptimizer.optimize(codeObject);
+    Verifier verifier;
+    if (!verifier.verify(codeObject))
+    {
+        plog::fatal << verifier.getError();
+    }
     auto frame = new vm::Frame;
     frame->codeObject = codeObject;
     frame->globals = new vm::Frame::object_map_t;
@@ -168,13 +259,25 @@ void compiler::Compiler::compileExpressionStatement(ExpressionStatement* stateme
 
 void compiler::Compiler::compileWhileStatement(WhileStatement* statement)
 {
+    // На початку кожної ітерації присвоєні змінні, присвоєні до циклу і не видалені в ньому
+    forgetDeletedLocals(statement->block.get());
     auto startWhileAddress = getOffset();
-    compileExpression(statement->condition.get());
-    auto endWhileBlock = emitOpCode(JMP_IF_FALSE, 0);
-    PUSH_LOOP_STATE(startWhileAddress);
+    // Цикл зі сталою істинною умовою не має умови після згортання констант
+    std::optional<vm::WORD> endWhileBlock;
+    if (statement->condition)
+    {
+        compileExpression(statement->condition.get());
+        endWhileBlock = emitOpCode(JMP_IF_FALSE, 0);
+    }
+    auto loopEntryAssigned = assignedLocals;
+    PUSH_LOOP_STATE(startWhileAddress, false);
     compileBlock(statement->block.get());
     emitOpCode(JMP, startWhileAddress);
-    patchJumpAddress(endWhileBlock, getOffset());
+    assignedLocals = std::move(loopEntryAssigned);
+    if (endWhileBlock)
+    {
+        patchJumpAddress(endWhileBlock.value(), getOffset());
+    }
     for (auto address : STATE_BACK(LoopState)->addressesForPatchWithEndBlock)
     {
         patchJumpAddress(address, getOffset());
@@ -188,12 +291,18 @@ void compiler::Compiler::compileBreakStatement(BreakStatement* statement)
     if (state)
     {
         setLineno(statement->break_);
+        if (state->isForEach)
+        {
+            // При виході з циклу "обійти" ітератор знімається зі стеку
+            emitOpCode(POP);
+        }
         auto endBlock = emitOpCode(JMP, 0);
         state->addressesForPatchWithEndBlock.push_back(endBlock);
+        markUnreachable();
     }
     else
     {
-        throwCompileError("Оператор \"завершити\" знаходиться поза циклом", statement->break_);
+        throwCompileError(BREAK_OUTSIDE_LOOP, statement->break_);
     }
 }
 
@@ -204,26 +313,31 @@ void compiler::Compiler::compileContinueStatement(ContinueStatement* statement)
     {
         setLineno(statement->continue_);
         emitOpCode(JMP, state->startIp);
+        markUnreachable();
     }
     else
     {
-        throwCompileError("Оператор \"пропустити\" знаходиться поза циклом", statement->continue_);
+        throwCompileError(CONTINUE_OUTSIDE_LOOP, statement->continue_);
     }
 }
 
 void compiler::Compiler::compileIfStatement(IfStatement* statement)
 {
     compileExpression(statement->condition.get());
+    auto conditionAssigned = assignedLocals;
     auto endIfBlock = emitOpCode(JMP_IF_FALSE, 0);
     compileBlock(statement->block.get());
     if (!statement->elseOrIf)
     {
         patchJumpAddress(endIfBlock, getOffset());
+        intersectAssigned(assignedLocals, conditionAssigned);
     }
     else
     {
         auto endIfElseBlock = emitOpCode(JMP, 0);
         patchJumpAddress(endIfBlock, getOffset());
+        auto ifBlockAssigned = std::move(assignedLocals);
+        assignedLocals = std::move(conditionAssigned);
 
         auto elseOrIf = statement->elseOrIf.value().get();
         if (elseOrIf->kind == ELSE_STATEMENT)
@@ -238,11 +352,22 @@ void compiler::Compiler::compileIfStatement(IfStatement* statement)
         }
 
         patchJumpAddress(endIfElseBlock, getOffset());
+        intersectAssigned(assignedLocals, ifBlockAssigned);
+    }
+}
+
+// Додає в index позиції імен. Для повторених імен залишається перша позиція
+static void indexNames(compiler::name_index_t& index,
+    const std::vector<std::string>& names, vm::WORD offset = 0)
+{
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        index.try_emplace(names[i], static_cast<vm::WORD>(offset + i));
     }
 }
 
 static std::optional<Token> checkDuplicateParameters(ast::FunctionDeclaration* func) {
-    std::unordered_set<std::string> parameterNames;
+    std::unordered_set<std::string_view> parameterNames;
 
     for (const auto& param : func->parameters) {
         if (parameterNames.find(param.text) != parameterNames.end()) {
@@ -270,79 +395,325 @@ static std::optional<Token> checkDuplicateParameters(ast::FunctionDeclaration* f
     return std::nullopt;
 }
 
-void compiler::Compiler::compileFunctionDeclaration(ast::FunctionDeclaration* statement)
+static std::optional<Token> checkDuplicateNamedArguments(ast::CallExpression* call)
+{
+    std::unordered_set<std::string_view> names;
+    for (auto& namedArgument : call->namedArguments)
+    {
+        if (!names.insert(namedArgument.first.text).second)
+        {
+            return namedArgument.first;
+        }
+    }
+    return std::nullopt;
+}
+
+void compiler::Compiler::checkParameters(ast::FunctionDeclaration* statement)
 {
     if (auto param = checkDuplicateParameters(statement)) {
         throwCompileError(std::format(
             "Параметр з ім'ям \"{}\" повторюється", param.value().text),
             param.value());
     }
-    auto& name = statement->id.text;
-    auto fnCodeObject = vm::CodeObject::create(name);
-    auto prevCodeObject = codeObject;
-    codeObject = fnCodeObject;
-    PUSH_FUNCTION_STATE(fnCodeObject);
-    PUSH_SCOPE(statement);
+}
 
-    codeObject->source = source;
-    codeObject->locals = SCOPE_BACK()->locals;
-    codeObject->cells = SCOPE_BACK()->cells;
-    codeObject->freevars = SCOPE_BACK()->freeVariables;
+void compiler::Compiler::checkNamedArguments(ast::CallExpression* expression)
+{
+    if (auto name = checkDuplicateNamedArguments(expression))
+    {
+        throwCompileError(
+            std::format("Іменований параметр \"{}\" повторюється", name.value().text),
+            name.value());
+    }
+}
 
-    for (auto& argName : codeObject->locals)
+void compiler::Compiler::checkDeferredBody(ast::Node* node, bool isInLoop)
+{
+    switch (node->kind)
+    {
+    case BLOCK_STATEMENT:
+    {
+        for (auto statement : ((ast::BlockStatement*)node)->statements)
+        {
+            checkDeferredBody(statement, isInLoop);
+        }
+        break;
+    }
+    case EXPRESSION_STATEMENT:
+    {
+        checkDeferredBody(((ast::ExpressionStatement*)node)->expression.get(), isInLoop);
+        break;
+    }
+    case WHILE_STATEMENT:
+    {
+        auto whileStatement = (ast::WhileStatement*)node;
+        // Згорнутий цикл без умови
+        if (whileStatement->condition)
+        {
+            checkDeferredBody(whileStatement->condition.get(), isInLoop);
+        }
+        checkDeferredBody(whileStatement->block.get(), true);
+        break;
+    }
+    case BREAK_STATEMENT:
+    {
+        if (!isInLoop)
+        {
+            throwCompileError(BREAK_OUTSIDE_LOOP, ((ast::BreakStatement*)node)->break_);
+        }
+        break;
+    }
+    case CONTINUE_STATEMENT:
+    {
+        if (!isInLoop)
+        {
+            throwCompileError(CONTINUE_OUTSIDE_LOOP, ((ast::ContinueStatement*)node)->continue_);
+        }
+        break;
+    }
+    case IF_STATEMENT:
+    {
+        auto ifStatement = (ast::IfStatement*)node;
+        checkDeferredBody(ifStatement->condition.get(), isInLoop);
+        checkDeferredBody(ifStatement->block.get(), isInLoop);
+        if (ifStatement->elseOrIf)
+        {
+            checkDeferredBody(ifStatement->elseOrIf.value().get(), isInLoop);
+        }
+        break;
+    }
+    case ELSE_STATEMENT:
+    {
+        checkDeferredBody(((ast::ElseStatement*)node)->block.get(), isInLoop);
+        break;
+    }
+    case FUNCTION_STATEMENT:
     {
-        for (auto& cellName : codeObject->cells)
+        auto fnDeclaration = (ast::FunctionDeclaration*)node;
+        checkParameters(fnDeclaration);
+        for (auto& defaultParameter : fnDeclaration->defaultParameters)
         {
-            if (argName == cellName)
+            checkDeferredBody(defaultParameter.second, isInLoop);
+        }
+        // Цикл навколо оголошення не робить "завершити" в тілі функції допустимим
+        checkDeferredBody(fnDeclaration->block.get(), false);
+        break;
+    }
+    case RETURN_STATEMENT:
+    {
+        auto returnStatement = (ast::ReturnStatement*)node;
+        if (returnStatement->returnValue)
+        {
+            checkDeferredBody(returnStatement->returnValue.value().get(), isInLoop);
+        }
+        break;
+    }
+    case FOR_EACH_STATEMENT:
+    {
+        auto forEach = (ast::ForEachStatement*)node;
+        checkDeferredBody(forEach->expression.get(), isInLoop);
+        checkDeferredBody(forEach->block.get(), true);
+        break;
+    }
+    case TRY_CATCH_STATEMENT:
+    {
+        auto tryStatement = (ast::TryCatchStatement*)node;
+        checkDeferredBody(tryStatement->block.get(), isInLoop);
+        for (const auto& catchBlock : tryStatement->catchBlocks)
+        {
+            checkDeferredBody(catchBlock->block.get(), isInLoop);
+        }
+        if (tryStatement->finallyBlock)
+        {
+            checkDeferredBody(tryStatement->finallyBlock.value()->block.get(), isInLoop);
+        }
+        break;
+    }
+    case RAISE_STATEMENT:
+    {
+        checkDeferredBody(((ast::RaiseStatement*)node)->exception.get(), isInLoop);
+        break;
+    }
+    case ASSIGNMENT_EXPRESSION:
+    {
+        checkDeferredBody(((ast::AssignmentExpression*)node)->expression.get(), isInLoop);
+        break;
+    }
+    case BINARY_EXPRESSION:
+    {
+        auto binaryExpression = (ast::BinaryExpression*)node;
+        checkDeferredBody(binaryExpression->left.get(), isInLoop);
+        checkDeferredBody(binaryExpression->right.get(), isInLoop);
+        break;
+    }
+    case UNARY_EXPRESSION:
+    {
+        checkDeferredBody(((ast::UnaryExpression*)node)->operand.get(), isInLoop);
+        break;
+    }
+    case PARENTHESIZED_EXPRESSION:
+    {
+        checkDeferredBody(((ast::ParenthesizedExpression*)node)->expression.get(), isInLoop);
+        break;
+    }
+    case ATTRIBUTE_EXPRESSION:
+    {
+        checkDeferredBody(((ast::AttributeExpression*)node)->expression.get(), isInLoop);
+        break;
+    }
+    case CALL_EXPRESSION:
+    {
+        auto callExpression = (ast::CallExpression*)node;
+        checkDeferredBody(callExpression->callable.get(), isInLoop);
+        for (auto argument : callExpression->arguments)
+        {
+            checkDeferredBody(argument, isInLoop);
+        }
+        checkNamedArguments(callExpression);
+        for (auto& namedArgument : callExpression->namedArguments)
+        {
+            checkDeferredBody(namedArgument.second, isInLoop);
+        }
+        break;
+    }
+    case LITERAL_EXPRESSION:
+    {
+        auto literal = (ast::LiteralExpression*)node;
+        if (literal->literalType == ast::LiteralExpression::Type::STRING)
+        {
+            for (auto str : std::get<ast::LiteralExpression::stringType>(literal->value))
             {
-                codeObject->argsAsCells.push_back(argName);
+                parseString(str);
             }
         }
+        break;
     }
+    case VARIABLE_EXPRESSION:
+        break;
+    default:
+        plog::fatal << "Неможливо обробити вузол \""
+                << ast::stringEnum::enumToString(node->kind) << "\"";
+    }
+}
 
-    codeObject->arity = statement->parameters.size() + statement->defaultParameters.size();
+void compiler::Compiler::compileFunctionDeclaration(ast::FunctionDeclaration* statement)
+{
+    checkParameters(statement);
+    auto& name = statement->id.text;
+    auto fnCodeObject = vm::CodeObject::create(std::string(name));
+    // Розмітка фрейму, комірки та вільні змінні визначаються одразу, бо від них залежить
+    // код MAKE_FUNCTION в поточній функції, навіть якщо тіло компілюється пізніше
+    auto scope = scopeInfo[statement];
+    fnCodeObject->source = source;
+    fnCodeObject->locals.assign(scope->locals.begin(), scope->locals.end());
+    fnCodeObject->cells.assign(scope->cells.begin(), scope->cells.end());
+    fnCodeObject->freevars.assign(scope->freeVariables.begin(), scope->freeVariables.end());
+    fnCodeObject->arity = statement->parameters.size() + statement->defaultParameters.size();
     if (statement->variadicParameter)
-        codeObject->isVariadic = true;
-    compileBlock(statement->block.get());
-    emitOpCode(LOAD_CONST, nullConstIdx());
-    emitOpCode(RETURN);
+        fnCodeObject->isVariadic = true;
+    fnCodeObject->computeFrameLayout();
 
-    SCOPE_POP();
-    STATE_POP();
-    codeObject = prevCodeObject;
+    if (deferredArena != nullptr)
+    {
+        // Помилки, для яких не потрібна генерація коду, повідомляються до запуску програми,
+        // як і без лінивої компіляції. Вкладені функції перевіряються разом з зовнішньою
+        if (unwindStateStack(CompilerStateType::FUNCTION) == nullptr)
+        {
+            checkDeferredBody(statement->block.get(), false);
+        }
+        fnCodeObject->deferredBody = new DeferredBody{ this, statement };
+    }
+    else
+    {
+        compileFunctionBody(statement, fnCodeObject);
+    }
 
     for (auto& defaultParameter : statement->defaultParameters)
     {
-        fnCodeObject->defaults.push_back(defaultParameter.first.text);
+        fnCodeObject->defaults.emplace_back(defaultParameter.first.text);
         setLineno(defaultParameter.first);
         compileExpression(defaultParameter.second);
     }
 
     setLineno(statement->id);
-    if (fnCodeObject->freevars.size() > 0)
+    // Комірка для кожної вільної змінної функції. MAKE_FUNCTION знімає їх зі стеку
+    // в замикання, починаючи з першої, тому вони додаються в зворотному порядку
+    auto& freevars = fnCodeObject->freevars;
+    for (auto name = freevars.rbegin(); name != freevars.rend(); ++name)
     {
-        auto state = (FunctionState*)unwindStateStack(CompilerStateType::FUNCTION);
-        auto& cells = state->codeObject->cells;
-
-        for (auto& name : state->codeObject->cells)
-        {
-            auto cellIdx = std::find(cells.begin(), cells.end(), name);
-            emitOpCode(GET_CELL, cellIdx - cells.begin());
-        }
+        emitOpCode(GET_CELL, freeIdx(*name));
     }
 
-    codeObject->constants.push_back(fnCodeObject);
-    emitOpCode(LOAD_CONST, codeObject->constants.size() - 1);
+    emitOpCode(LOAD_CONST, constantIdx(fnCodeObject));
     emitOpCode(MAKE_FUNCTION);
     compileNameSet(name);
 }
 
+void compiler::Compiler::compileFunctionBody(ast::FunctionDeclaration* statement, vm::CodeObject* fnCodeObject)
+{
+    auto prevCodeObject = codeObject;
+    codeObject = fnCodeObject;
+    PUSH_FUNCTION_STATE(fnCodeObject);
+    PUSH_SCOPE(statement);
+
+    CodeObjectIndexes fnIndexes;
+    auto prevIndexes = indexes;
+    indexes = &fnIndexes;
+    indexNames(fnIndexes.locals, codeObject->locals);
+    indexNames(fnIndexes.freevars, codeObject->cells);
+    indexNames(fnIndexes.freevars, codeObject->freevars, static_cast<vm::WORD>(codeObject->cells.size()));
+
+    // При вході у функцію присвоєні лише слоти, заповнені викликом
+    auto prevAssignedLocals = std::move(assignedLocals);
+    assignedLocals.assign(codeObject->locals.size(), false);
+    std::fill_n(assignedLocals.begin(), codeObject->frameLayout.argumentSlots, true);
+
+    compileBlock(statement->block.get());
+    emitOpCode(LOAD_CONST, nullConstIdx());
+    emitOpCode(RETURN);
+
+    SCOPE_POP();
+    STATE_POP();
+    codeObject = prevCodeObject;
+    indexes = prevIndexes;
+    assignedLocals = std::move(prevAssignedLocals);
+}
+
+void compiler::Compiler::compileDeferred(ast::FunctionDeclaration* declaration, vm::CodeObject* fnCodeObject)
+{
+    ast::ArenaScope arenaScope(deferredArena);
+    vm::ImmortalScope immortal(getCurrentState()->getGC());
+    compileFunctionBody(declaration, fnCodeObject);
+    CfgOptimizer cfgOptimizer;
+    cfgOptimizer.optimizeDeferred(fnCodeObject);
+    PeepholeOptimizer peepholeOptimizer;
+    peepholeOptimizer.optimize(fnCodeObject);
+    Verifier verifier;
+    if (!verifier.verifyFunction(fnCodeObject))
+    {
+        plog::fatal << verifier.getError();
+    }
+}
+
+void compiler::compileDeferredBody(vm::CodeObject* codeObject)
+{
+    auto body = codeObject->deferredBody;
+    codeObject->deferredBody = nullptr;
+    body->compiler->compileDeferred(body->declaration, codeObject);
+}
+
 void compiler::Compiler::compileReturnStatement(ast::ReturnStatement* statement)
 {
     auto state = (FunctionState*)unwindStateStack(CompilerStateType::FUNCTION);
     if (state)
     {
         setLineno(statement->return_);
+        if (statement->returnValue && canTailCall(statement->returnValue.value().get(), state))
+        {
+            compileCallExpression((CallExpression*)statement->returnValue.value().get(), true);
+            markUnreachable();
+            return;
+        }
         if (statement->returnValue)
         {
             compileExpression(statement->returnValue.value().get());
@@ -352,6 +723,7 @@ void compiler::Compiler::compileReturnStatement(ast::ReturnStatement* statement)
             emitOpCode(LOAD_CONST, nullConstIdx());
         }
         emitOpCode(RETURN);
+        markUnreachable();
     }
     else
     {
@@ -364,13 +736,16 @@ void compiler::Compiler::compileForEachStatement(ForEachStatement* statement)
     compileExpression(statement->expression.get());
     setLineno(statement->forEach);
     emitOpCode(UNARY_OP, static_cast<vm::WORD>(vm::ObjectOperatorOffset::GET_ITER));
+    forgetDeletedLocals(statement->block.get());
+    auto loopEntryAssigned = assignedLocals;
     auto startForEachAddress = getOffset();
     auto endForEachBlock = emitOpCode(FOR_EACH, 0);
     setLineno(statement->variable);
     compileNameSet(statement->variable.text);
-    PUSH_LOOP_STATE(startForEachAddress);
+    PUSH_LOOP_STATE(startForEachAddress, true);
     compileBlock(statement->block.get());
     emitOpCode(JMP, startForEachAddress);
+    assignedLocals = std::move(loopEntryAssigned);
     patchJumpAddress(endForEachBlock, getOffset());
     for (auto address : STATE_BACK(LoopState)->addressesForPatchWithEndBlock)
     {
@@ -381,21 +756,34 @@ void compiler::Compiler::compileForEachStatement(ForEachStatement* statement)
 
 void compiler::Compiler::compileTryCatchStatement(TryCatchStatement* statement)
 {
+    auto functionState = (FunctionState*)unwindStateStack(CompilerStateType::FUNCTION);
+    if (functionState)
+    {
+        functionState->tryDepth++;
+    }
     vm::ExceptionHandler excHandler{};
     excHandler.startAddress = getOffset();
+    auto tryAssigned = assignedLocals;
     setLineno(statement->try_);
     emitOpCode(TRY);
     compileBlock(statement->block.get());
+
+    // Виняток може виникнути будь-де в блоці, тому обробники отримують
+    // лише змінні, присвоєні до нього
+    auto endAssigned = std::move(assignedLocals);
+    assignedLocals = tryAssigned;
+    forgetDeletedLocals(statement->block.get());
+    auto handlerAssigned = std::move(assignedLocals);
     std::vector<vm::WORD> ends;
     ends.reserve(statement->catchBlocks.size()
         + 1 // Для JMP в блоці TRY
-        - 1 // Останньому обробнику не потрібен JMP
     );
     ends.push_back(emitOpCode(JMP, 0));
     excHandler.firstHandlerAddress = getOffset();
     for (auto i = statement->catchBlocks.cbegin(); i != statement->catchBlocks.cend(); ++i)
     {
         auto catchBlock = *i;
+        assignedLocals = handlerAssigned;
         setLineno(catchBlock->exceptionName);
         compileNameGet(catchBlock->exceptionName.text);
         setLineno(catchBlock->catch_);
@@ -414,18 +802,21 @@ void compiler::Compiler::compileTryCatchStatement(TryCatchStatement* statement)
         {
             compileNameDelete(catchBlock->variableName.value().text);
         }
+        intersectAssigned(endAssigned, assignedLocals);
+        ends.push_back(emitOpCode(JMP, 0));
+        // Якщо тип винятку не збігся, перевіряється наступний обробник
         patchJumpAddress(endCatchBlock, getOffset());
-        if (i != statement->catchBlocks.cend())
-        {
-            ends.push_back(emitOpCode(JMP, 0));
-        }
     }
     for (auto a : ends)
     {
         patchJumpAddress(a, getOffset());
     }
+    assignedLocals = std::move(endAssigned);
     if (statement->finallyBlock.has_value())
     {
+        // Блок "наприкінці" виконується і після винятку в будь-якому з блоків
+        assignedLocals = std::move(tryAssigned);
+        forgetDeletedLocals(statement);
         excHandler.finallyAddress = getOffset();
         auto finallyBlock = statement->finallyBlock.value().get();
         setLineno(finallyBlock->finally_);
@@ -434,12 +825,17 @@ void compiler::Compiler::compileTryCatchStatement(TryCatchStatement* statement)
     excHandler.endAddress = getOffset();
     emitOpCode(END_TRY);
     codeObject->exceptionHandlers.push_back(excHandler);
+    if (functionState)
+    {
+        functionState->tryDepth--;
+    }
 }
 
 void compiler::Compiler::compileRaiseStatement(RaiseStatement* statement)
 {
     compileExpression(statement->exception.get());
     emitOpCode(RAISE);
+    markUnreachable();
 }
 
 void compiler::Compiler::compileExpression(Expression* expression)
@@ -478,7 +874,7 @@ void compiler::Compiler::compileExpression(Expression* expression)
 
 void compiler::Compiler::compileAssignmentExpression(AssignmentExpression* expression)
 {
-    std::string name = expression->id.text;
+    auto name = expression->id.text;
     compileExpression(expression->expression.get());
     auto& op = expression->assignment.text;
     if (op == Keyword::EQUAL)
@@ -636,7 +1032,7 @@ void compiler::Compiler::compileVariableExpression(VariableExpression* expressio
     compileNameGet(variableName);
 }
 
-void compiler::Compiler::compileCallExpression(CallExpression* expression)
+void compiler::Compiler::compileCallExpression(CallExpression* expression, bool isTailCall)
 {
     auto argc = (vm::WORD)expression->arguments.size() + (vm::WORD)expression->namedArguments.size();
     bool withNamedArgs = (bool)expression->namedArguments.size();
@@ -660,22 +1056,11 @@ void compiler::Compiler::compileCallExpression(CallExpression* expression)
 
     if (withNamedArgs)
     {
+        checkNamedArguments(expression);
         std::vector<std::string> namedArgs;
         for (auto& namedArgument : expression->namedArguments)
         {
-            for (auto& a: namedArgs)
-            {
-               if (namedArgument.first.text == a)
-               {
-                   throwCompileError(
-                       std::format(
-                           "Іменований параметр \"{}\" повторюється", a),
-                       namedArgument.first
-                   );
-               }
-            }
-
-            namedArgs.push_back(namedArgument.first.text);
+            namedArgs.emplace_back(namedArgument.first.text);
             compileExpression(namedArgument.second);
         }
 
@@ -688,6 +1073,10 @@ void compiler::Compiler::compileCallExpression(CallExpression* expression)
     {
         emitOpCode(withNamedArgs ? CALL_METHOD_NA : CALL_METHOD, argc);
     }
+    else if (isTailCall)
+    {
+        emitOpCode(withNamedArgs ? TAIL_CALL_NA : TAIL_CALL, argc);
+    }
     else
     {
         emitOpCode(withNamedArgs ? CALL_NA : CALL, argc);
@@ -709,8 +1098,11 @@ void compiler::Compiler::compileBinaryExpression(BinaryExpression* expression)
         compileExpression(expression->left.get());
         setLineno(expression->op);
         auto end = emitOpCode(op == Keyword::AND ? JMP_IF_FALSE_OR_POP : JMP_IF_TRUE_OR_POP, 0);
+        // Правий операнд може не обчислюватись
+        auto leftAssigned = assignedLocals;
         compileExpression(expression->right.get());
         patchJumpAddress(end, getOffset());
+        assignedLocals = std::move(leftAssigned);
         return;
     }
     compileExpression(expression->right.get());
@@ -759,7 +1151,7 @@ void compiler::Compiler::compileAttributeExpression(
     emitOpCode(isMethod ? LOAD_METHOD : GET_ATTR, nameIdx(expression->attribute.text));
 }
 
-void compiler::Compiler::compileNameGet(const std::string& name)
+void compiler::Compiler::compileNameGet(std::string_view name)
 {
     auto scope = SCOPE_BACK();
     auto varGetter = scope->getVarGetter(name);
@@ -767,7 +1159,13 @@ void compiler::Compiler::compileNameGet(const std::string& name)
     vm::WORD index;
     switch(varGetter)
     {
-    case LOAD_LOCAL: index = localIdx(name); break;
+    case LOAD_LOCAL:
+        index = localIdx(name);
+        if (assignedLocals[index])
+        {
+            varGetter = LOAD_LOCAL_FAST;
+        }
+        break;
     case LOAD_CELL: index = freeIdx(name); break;
     case LOAD_GLOBAL: index = nameIdx(name); break;
     default:
@@ -776,7 +1174,7 @@ void compiler::Compiler::compileNameGet(const std::string& name)
     emitOpCode(varGetter, index);
 }
 
-void compiler::Compiler::compileNameSet(const std::string& name)
+void compiler::Compiler::compileNameSet(std::string_view name)
 {
     auto scope = SCOPE_BACK();
     auto varSetter = scope->getVarSetter(name);
@@ -784,7 +1182,10 @@ void compiler::Compiler::compileNameSet(const std::string& name)
     vm::WORD index;
     switch(varSetter)
     {
-    case STORE_LOCAL: index = localIdx(name); break;
+    case STORE_LOCAL:
+        index = localIdx(name);
+        assignedLocals[index] = true;
+        break;
     case STORE_CELL: index = freeIdx(name); break;
     case STORE_GLOBAL: index = nameIdx(name); break;
     default:
@@ -793,7 +1194,7 @@ void compiler::Compiler::compileNameSet(const std::string& name)
     emitOpCode(varSetter, index);
 }
 
-void compiler::Compiler::compileNameDelete(const std::string& name)
+void compiler::Compiler::compileNameDelete(std::string_view name)
 {
     auto scope = SCOPE_BACK();
     auto varDeleter = scope->getVarDeleter(name);
@@ -801,7 +1202,10 @@ void compiler::Compiler::compileNameDelete(const std::string& name)
     vm::WORD index;
     switch(varDeleter)
     {
-    case DELETE_LOCAL: index = localIdx(name); break;
+    case DELETE_LOCAL:
+        index = localIdx(name);
+        assignedLocals[index] = false;
+        break;
     case DELETE_GLOBAL: index = nameIdx(name); break;
     default:
         plog::fatal << "Невідомний varDeleter";
@@ -809,6 +1213,24 @@ void compiler::Compiler::compileNameDelete(const std::string& name)
     emitOpCode(varDeleter, index);
 }
 
+void compiler::Compiler::forgetDeletedLocals(ast::Node* node)
+{
+    std::vector<std::string> names;
+    collectDeletedNames(node, names);
+    for (auto& name : names)
+    {
+        if (auto index = indexes->locals.find(name); index != indexes->locals.end())
+        {
+            assignedLocals[index->second] = false;
+        }
+    }
+}
+
+void compiler::Compiler::markUnreachable()
+{
+    std::fill(assignedLocals.begin(), assignedLocals.end(), true);
+}
+
 CompilerState* compiler::Compiler::unwindStateStack(CompilerStateType type)
 {
     for (auto it = stateStack.rbegin(); it != stateStack.rend(); ++it)
@@ -817,123 +1239,114 @@ CompilerState* compiler::Compiler::unwindStateStack(CompilerStateType type)
         {
             return *it;
         }
+        // Цикли зовнішньої функції не видно з тіла вкладеної
+        if ((*it)->type == CompilerStateType::FUNCTION)
+        {
+            return nullptr;
+        }
     }
     return nullptr;
 }
 
-vm::WORD compiler::Compiler::booleanConstIdx(bool value)
+vm::WORD compiler::Compiler::constantIdx(vm::Object* constant)
 {
-    for (vm::WORD i = 0; i < (vm::WORD)codeObject->constants.size(); ++i)
+    auto [it, inserted] = indexes->constants.try_emplace(
+        constant, static_cast<vm::WORD>(codeObject->constants.size()));
+    if (inserted)
     {
-        if (OBJECT_IS(codeObject->constants[i], &vm::boolObjectType) == false)
-        {
-            continue;
-        }
-        if (((vm::BoolObject*)codeObject->constants[i])->value == value)
-        {
-            return i;
-        }
+        codeObject->constants.push_back(constant);
     }
-    codeObject->constants.push_back(P_BOOL(value));
-    return (vm::WORD)codeObject->constants.size() - 1;
+    return it->second;
+}
+
+vm::WORD compiler::Compiler::booleanConstIdx(bool value)
+{
+    return constantIdx(P_BOOL(value));
 }
 
 vm::WORD compiler::Compiler::realConstIdx(double value)
 {
-    FIND_CONST_IDX(RealObject, realObjectType)
+    // Біти розрізняють 0.0 та -0.0, які при порівнянні рівні
+    auto& constant = realConstants[std::bit_cast<u64>(value)];
+    if (constant == nullptr)
+    {
+        constant = vm::RealObject::create(value);
+    }
+    return constantIdx(constant);
 }
 
 vm::WORD compiler::Compiler::integerConstIdx(i64 value)
 {
-    FIND_CONST_IDX(IntObject, intObjectType)
+    auto& constant = integerConstants[value];
+    if (constant == nullptr)
+    {
+        constant = vm::IntObject::create(value);
+    }
+    return constantIdx(constant);
 }
 
 vm::WORD compiler::Compiler::stringVectorIdx(const std::vector<std::string>& value)
 {
-    FIND_CONST_IDX(StringVectorObject, stringVectorObjectType)
+    std::string key;
+    for (const auto& str : value)
+    {
+        key += str;
+        key += '\0';
+    }
+    auto& constant = stringVectorConstants[key];
+    if (constant == nullptr)
+    {
+        constant = vm::StringVectorObject::create(value);
+    }
+    return constantIdx(constant);
 }
 
 vm::WORD compiler::Compiler::stringConstIdx(const std::u32string& value)
 {
-    for (vm::WORD i = 0; i < (vm::WORD)codeObject->constants.size(); ++i)
+    auto& constant = stringConstants[value];
+    if (constant == nullptr)
     {
-        auto constant = codeObject->constants[i];
-        if (OBJECT_IS(constant, &vm::stringObjectType) == false)
-        {
-            continue;
-        }
-        else if (static_cast<vm::StringObject*>(constant)->value == value)
-        {
-            return i;
-        }
+        constant = vm::StringObject::create(value);
     }
-    codeObject->constants.push_back(vm::StringObject::create(value));
-        return vm::WORD(codeObject->constants.size() - 1);
+    return constantIdx(constant);
 }
 
 vm::WORD compiler::Compiler::nullConstIdx()
 {
-    for (vm::WORD i = 0; i < (vm::WORD)codeObject->constants.size(); ++i)
-    {
-        if (OBJECT_IS(codeObject->constants[i], &vm::nullObjectType))
-        {
-            return i;
-        }
-    }
-    codeObject->constants.push_back(&vm::P_null);
-    return (vm::WORD)codeObject->constants.size() - 1;
+    return constantIdx(&vm::P_null);
 }
 
-vm::WORD compiler::Compiler::freeIdx(const std::string& name)
+vm::WORD compiler::Compiler::freeIdx(std::string_view name)
 {
-    auto& cells = codeObject->cells;
-    auto cellIdx = std::find(cells.begin(), cells.end(), name);
-    if (cellIdx != cells.end())
+    auto index = indexes->freevars.find(name);
+    if (index == indexes->freevars.end())
     {
-        return cellIdx - cells.begin();
-    }
-    else
-    {
-        auto& freevars = codeObject->freevars;
-        auto freeIndex = std::find(freevars.begin(), freevars.end(), name);
-        if (freeIndex != freevars.end())
-        {
-            return freeIndex - freevars.begin() + cells.size();
-        }
-        else
-        {
-            plog::fatal << "Неможливо знайти змінну \"" << name << "\"";
-        }
+        plog::fatal << "Неможливо знайти змінну \"" << name << "\"";
     }
+    return index->second;
 }
 
-vm::WORD compiler::Compiler::localIdx(const std::string& name)
+vm::WORD compiler::Compiler::localIdx(std::string_view name)
 {
-    auto& locals = codeObject->locals;
-    auto nameIdx = std::find(locals.begin(), locals.end(), name);
-    if (nameIdx != locals.end())
-    {
-        return nameIdx - locals.begin();
-    }
-    else
+    auto index = indexes->locals.find(name);
+    if (index == indexes->locals.end())
     {
         plog::fatal << "Локальної змінної \"" << name << "\" не існує";
     }
+    return index->second;
 }
 
-vm::WORD compiler::Compiler::nameIdx(const std::string& name)
+vm::WORD compiler::Compiler::nameIdx(std::string_view name)
 {
     auto& names = codeObject->names;
-    auto nameIdx = std::find(names.begin(), names.end(), name);
-    if (nameIdx != names.end())
-    {
-        return nameIdx - names.begin();
-    }
-    else
+    if (auto it = indexes->names.find(name); it != indexes->names.end())
     {
-        names.push_back(name);
-        return names.size() - 1;
+        return it->second;
     }
+    auto index = static_cast<vm::WORD>(names.size());
+    indexes->names.emplace(name, index);
+    names.emplace_back(name);
+    return index;
 }
 
 void compiler::Compiler::throwCompileError(std::string message, Token token)
@@ -974,10 +1387,13 @@ void compiler::Compiler::patchJumpAddress(int offset, vm::WORD newAddress, bool
         codeObject->code[offset] = newAddress;
 }
 
-compiler::Compiler::Compiler(BlockStatement* root, periwinkle::ProgramSource* source)
+compiler::Compiler::Compiler(BlockStatement* root, periwinkle::ProgramSource* source,
+    ast::Arena* deferredArena)
     :
     root(root),
-    source(source)
+    source(source),
+    deferredArena(deferredArena)
 {
+    vm::ImmortalScope immortal(getCurrentState()->getGC());
     codeObject = vm::CodeObject::create("");
 }
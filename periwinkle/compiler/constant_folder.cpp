@@ -0,0 +1,430 @@
+#include <string>
+
+#include "constant_folder.hpp"
+#include "bool_object.hpp"
+#include "int_object.hpp"
+#include "real_object.hpp"
+#include "string_object.hpp"
+#include "null_object.hpp"
+#include "keyword.hpp"
+#include "periwinkle.hpp"
+#include "unicode.hpp"
+
+using namespace compiler;
+using namespace ast;
+using enum ast::NodeKind;
+
+// Значення літерала як об'єкт середовища виконання, щоб обчислення давали той самий результат,
+// що й під час виконання. Повертає nullptr для рядків з керувальними послідовностями:
+// їх розбирає компілятор разом з повідомленнями про помилки в них
+static vm::Object* literalValue(LiteralExpression* literal)
+{
+    using enum LiteralExpression::Type;
+    switch (literal->literalType)
+    {
+    case NUMBER:
+        return vm::IntObject::create(std::get<i64>(literal->value));
+    case REAL:
+        return vm::RealObject::create(std::get<double>(literal->value));
+    case BOOLEAN:
+        return P_BOOL(std::get<bool>(literal->value));
+    case NULL_:
+        return &vm::P_null;
+    case STRING:
+    {
+        std::string value;
+        for (auto str : std::get<LiteralExpression::stringType>(literal->value))
+        {
+            if (str->str.find('\\') != std::string::npos)
+            {
+                return nullptr;
+            }
+            value += str->str;
+        }
+        return vm::StringObject::create(unicode::toUtf32(value));
+    }
+    }
+    return nullptr;
+}
+
+// Створює літерал зі значенням value або повертає nullptr, якщо значення не можна записати літералом
+static LiteralExpression* makeLiteral(vm::Object* value, const Token& token)
+{
+    using enum LiteralExpression::Type;
+    if (OBJECT_IS(value, &vm::intObjectType))
+    {
+        return new LiteralExpression(token, NUMBER, static_cast<vm::IntObject*>(value)->value);
+    }
+    else if (OBJECT_IS(value, &vm::realObjectType))
+    {
+        return new LiteralExpression(token, REAL, static_cast<vm::RealObject*>(value)->value);
+    }
+    else if (OBJECT_IS(value, &vm::boolObjectType))
+    {
+        return new LiteralExpression(token, BOOLEAN, value == &vm::P_true);
+    }
+    else if (OBJECT_IS(value, &vm::nullObjectType))
+    {
+        return new LiteralExpression(token, NULL_, {});
+    }
+    else if (OBJECT_IS(value, &vm::stringObjectType))
+    {
+        // Компілятор розбирає керувальні послідовності, тому зворотні скісні риски екрануються
+        std::u32string escaped;
+        for (auto c : static_cast<vm::StringObject*>(value)->value)
+        {
+            if (c == U'\\')
+            {
+                escaped += U'\\';
+            }
+            escaped += c;
+        }
+        auto str = new LiteralString{ token, ast::Arena::current()->copyString(unicode::toUtf8(escaped)) };
+        return new LiteralExpression(token, STRING, LiteralExpression::stringType{ str });
+    }
+    return nullptr;
+}
+
+// Істинність значення літерала, std::nullopt, якщо вона невідома під час компіляції
+static std::optional<bool> literalTruth(Expression* expression)
+{
+    if (expression->kind != LITERAL_EXPRESSION)
+    {
+        return std::nullopt;
+    }
+    auto value = literalValue((LiteralExpression*)expression);
+    if (value == nullptr)
+    {
+        return std::nullopt;
+    }
+    auto truth = value->asBool();
+    if (!truth)
+    {
+        getCurrentState()->exceptionClear();
+    }
+    return truth;
+}
+
+static vm::Object* evaluateBinaryOperator(std::string_view op, vm::Object* left, vm::Object* right)
+{
+    using enum vm::ObjectCompOperator;
+    if      (op == Keyword::ADD) return left->callBinaryOperator(right, vm::ObjectOperatorOffset::ADD);
+    else if (op == Keyword::SUB) return left->callBinaryOperator(right, vm::ObjectOperatorOffset::SUB);
+    else if (op == Keyword::DIV) return left->callBinaryOperator(right, vm::ObjectOperatorOffset::DIV);
+    else if (op == Keyword::MUL) return left->callBinaryOperator(right, vm::ObjectOperatorOffset::MUL);
+    else if (op == Keyword::MOD) return left->callBinaryOperator(right, vm::ObjectOperatorOffset::MOD);
+    else if (op == Keyword::FLOOR_DIV) return left->callBinaryOperator(right, vm::ObjectOperatorOffset::FLOOR_DIV);
+    else if (op == Keyword::EQUAL_EQUAL) return left->compare(right, EQ);
+    else if (op == Keyword::NOT_EQUAL) return left->compare(right, NE);
+    else if (op == Keyword::GREATER) return left->compare(right, GT);
+    else if (op == Keyword::GREATER_EQUAL) return left->compare(right, GE);
+    else if (op == Keyword::LESS) return left->compare(right, LT);
+    else if (op == Keyword::LESS_EQUAL) return left->compare(right, LE);
+    // Результат "є" залежить від того, чи будуть константи одним об'єктом
+    return nullptr;
+}
+
+void compiler::ConstantFolder::foldBlock(BlockStatement* block)
+{
+    auto& statements = block->statements;
+    for (auto it = statements.begin(); it != statements.end();)
+    {
+        auto folded = foldStatement(*it);
+        if (folded == nullptr)
+        {
+            it = statements.erase(it);
+        }
+        else
+        {
+            *it = folded;
+            ++it;
+        }
+    }
+}
+
+Statement* compiler::ConstantFolder::foldStatement(Statement* statement)
+{
+    switch (statement->kind)
+    {
+    case BLOCK_STATEMENT:
+        foldBlock((BlockStatement*)statement);
+        break;
+    case EXPRESSION_STATEMENT:
+        fold(((ExpressionStatement*)statement)->expression);
+        break;
+    case WHILE_STATEMENT:
+    {
+        auto whileStatement = (WhileStatement*)statement;
+        fold(whileStatement->condition);
+        auto truth = literalTruth(whileStatement->condition.get());
+        if (truth.has_value() && !truth.value())
+        {
+            return nullptr;
+        }
+        if (truth.has_value())
+        {
+            // Цикл без умови
+            whileStatement->condition.reset();
+        }
+        foldBlock(whileStatement->block.get());
+        break;
+    }
+    case IF_STATEMENT:
+    {
+        auto ifStatement = (IfStatement*)statement;
+        fold(ifStatement->condition);
+        foldBlock(ifStatement->block.get());
+        if (ifStatement->elseOrIf)
+        {
+            auto& elseOrIf = ifStatement->elseOrIf.value();
+            if (elseOrIf->kind == ELSE_STATEMENT)
+            {
+                foldBlock(((ElseStatement*)elseOrIf.get())->block.get());
+            }
+            else
+            {
+                auto folded = foldStatement(elseOrIf.release());
+                if (folded == nullptr)
+                {
+                    ifStatement->elseOrIf.reset();
+                }
+                else if (folded->kind == BLOCK_STATEMENT)
+                {
+                    elseOrIf.reset(new ElseStatement(ifStatement->if_, (BlockStatement*)folded));
+                }
+                else
+                {
+                    elseOrIf.reset(folded);
+                }
+            }
+        }
+
+        auto truth = literalTruth(ifStatement->condition.get());
+        if (!truth.has_value())
+        {
+            break;
+        }
+        Statement* taken = nullptr;
+        if (truth.value())
+        {
+            taken = ifStatement->block.release();
+        }
+        else if (ifStatement->elseOrIf)
+        {
+            auto elseOrIf = ifStatement->elseOrIf.value().release();
+            if (elseOrIf->kind == ELSE_STATEMENT)
+            {
+                taken = ((ElseStatement*)elseOrIf)->block.release();
+            }
+            else
+            {
+                taken = elseOrIf;
+            }
+        }
+        return taken;
+    }
+    case FUNCTION_STATEMENT:
+    {
+        auto function = (FunctionDeclaration*)statement;
+        for (auto& parameter : function->defaultParameters)
+        {
+            parameter.second = foldExpression(parameter.second);
+        }
+        foldBlock(function->block.get());
+        break;
+    }
+    case RETURN_STATEMENT:
+    {
+        auto returnStatement = (ReturnStatement*)statement;
+        if (returnStatement->returnValue)
+        {
+            fold(returnStatement->returnValue.value());
+        }
+        break;
+    }
+    case FOR_EACH_STATEMENT:
+    {
+        auto forEach = (ForEachStatement*)statement;
+        fold(forEach->expression);
+        foldBlock(forEach->block.get());
+        break;
+    }
+    case TRY_CATCH_STATEMENT:
+    {
+        auto tryCatch = (TryCatchStatement*)statement;
+        foldBlock(tryCatch->block.get());
+        for (auto catchBlock : tryCatch->catchBlocks)
+        {
+            foldBlock(catchBlock->block.get());
+        }
+        if (tryCatch->finallyBlock)
+        {
+            foldBlock(tryCatch->finallyBlock.value()->block.get());
+        }
+        break;
+    }
+    case RAISE_STATEMENT:
+        fold(((RaiseStatement*)statement)->exception);
+        break;
+    default:
+        break;
+    }
+    return statement;
+}
+
+Expression* compiler::ConstantFolder::foldExpression(Expression* expression)
+{
+    switch (expression->kind)
+    {
+    case ASSIGNMENT_EXPRESSION:
+        fold(((AssignmentExpression*)expression)->expression);
+        break;
+    case CALL_EXPRESSION:
+    {
+        auto call = (CallExpression*)expression;
+        fold(call->callable);
+        for (auto& argument : call->arguments)
+        {
+            argument = foldExpression(argument);
+        }
+        for (auto& argument : call->namedArguments)
+        {
+            argument.second = foldExpression(argument.second);
+        }
+        break;
+    }
+    case ATTRIBUTE_EXPRESSION:
+        fold(((AttributeExpression*)expression)->expression);
+        break;
+    case PARENTHESIZED_EXPRESSION:
+    {
+        auto parenthesized = (ParenthesizedExpression*)expression;
+        fold(parenthesized->expression);
+        if (parenthesized->expression->kind == LITERAL_EXPRESSION)
+        {
+            auto literal = parenthesized->expression.release();
+            return literal;
+        }
+        break;
+    }
+    case BINARY_EXPRESSION:
+        return foldBinaryExpression((BinaryExpression*)expression);
+    case UNARY_EXPRESSION:
+        return foldUnaryExpression((UnaryExpression*)expression);
+    default:
+        break;
+    }
+    return expression;
+}
+
+Expression* compiler::ConstantFolder::foldBinaryExpression(BinaryExpression* expression)
+{
+    fold(expression->left);
+    fold(expression->right);
+    auto& op = expression->op.text;
+
+    if (op == Keyword::AND || op == Keyword::OR)
+    {
+        // Результатом є лівий операнд, якщо він визначає результат, інакше правий
+        auto truth = literalTruth(expression->left.get());
+        if (!truth.has_value())
+        {
+            return expression;
+        }
+        auto result = truth.value() == (op == Keyword::AND) ?
+            expression->right.release() : expression->left.release();
+        return result;
+    }
+
+    if (expression->left->kind != LITERAL_EXPRESSION || expression->right->kind != LITERAL_EXPRESSION)
+    {
+        return expression;
+    }
+    auto left = (LiteralExpression*)expression->left.get();
+    auto right = (LiteralExpression*)expression->right.get();
+
+    using enum LiteralExpression::Type;
+    if (op == Keyword::ADD && left->literalType == STRING && right->literalType == STRING)
+    {
+        // Частини рядків переносяться без розбору, тому керувальні послідовності залишаються як є
+        auto& leftParts = std::get<LiteralExpression::stringType>(left->value);
+        auto& rightParts = std::get<LiteralExpression::stringType>(right->value);
+        LiteralExpression::stringType parts(leftParts);
+        parts.insert(parts.end(), rightParts.begin(), rightParts.end());
+        leftParts.clear();
+        rightParts.clear();
+        auto result = new LiteralExpression(left->literalToken, STRING, parts);
+        return result;
+    }
+
+    auto leftValue = literalValue(left);
+    auto rightValue = literalValue(right);
+    if (leftValue == nullptr || rightValue == nullptr)
+    {
+        return expression;
+    }
+    auto value = evaluateBinaryOperator(op, leftValue, rightValue);
+    if (value == nullptr)
+    {
+        // Помилка буде викинута під час виконання
+        getCurrentState()->exceptionClear();
+        return expression;
+    }
+    auto result = makeLiteral(value, expression->op);
+    if (result == nullptr)
+    {
+        return expression;
+    }
+    return result;
+}
+
+Expression* compiler::ConstantFolder::foldUnaryExpression(UnaryExpression* expression)
+{
+    fold(expression->operand);
+    if (expression->operand->kind != LITERAL_EXPRESSION)
+    {
+        return expression;
+    }
+
+    auto& op = expression->op.text;
+    vm::Object* value = nullptr;
+    if (op == Keyword::NOT)
+    {
+        auto truth = literalTruth(expression->operand.get());
+        if (truth.has_value())
+        {
+            value = P_BOOL(!truth.value());
+        }
+    }
+    else if (auto operand = literalValue((LiteralExpression*)expression->operand.get()))
+    {
+        value = operand->callUnaryOperator(op == Keyword::SUB ?
+            vm::ObjectOperatorOffset::NEG : vm::ObjectOperatorOffset::POS);
+        if (value == nullptr)
+        {
+            getCurrentState()->exceptionClear();
+        }
+    }
+
+    auto result = value ? makeLiteral(value, expression->op) : nullptr;
+    if (result == nullptr)
+    {
+        return expression;
+    }
+    return result;
+}
+
+void compiler::ConstantFolder::fold(std::unique_ptr<Expression>& expression)
+{
+    expression.reset(foldExpression(expression.release()));
+}
+
+void compiler::ConstantFolder::foldConstants()
+{
+    foldBlock(root);
+}
+
+compiler::ConstantFolder::ConstantFolder(BlockStatement* root)
+    : root(root)
+{
+}
@@ -0,0 +1,462 @@
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "control_flow_graph.hpp"
+#include "disassembler.hpp"
+#include "plogger.hpp"
+
+using namespace compiler;
+using enum vm::OpCode;
+
+// Наступники блоку разом з блоком, в який переходить виконання при винятку
+static std::vector<BasicBlock*> allSuccessors(BasicBlock* block)
+{
+    auto result = ControlFlowGraph::successors(block);
+    if (block->exceptionTarget)
+    {
+        result.push_back(block->exceptionTarget);
+    }
+    return result;
+}
+
+BasicBlock* compiler::ControlFlowGraph::createBlock()
+{
+    return blocks.emplace_back(std::make_unique<BasicBlock>()).get();
+}
+
+void compiler::ControlFlowGraph::updatePositions()
+{
+    for (size_t i = 0; i < layout.size(); ++i)
+    {
+        layout[i]->position = i;
+    }
+}
+
+std::vector<BasicBlock*> compiler::ControlFlowGraph::successors(BasicBlock* block)
+{
+    std::vector<BasicBlock*> result;
+    if (!block->instructions.empty() && block->instructions.back().target)
+    {
+        result.push_back(block->instructions.back().target);
+    }
+    if (block->next)
+    {
+        result.push_back(block->next);
+    }
+    return result;
+}
+
+void compiler::ControlFlowGraph::analyze()
+{
+    updatePositions();
+    for (auto block : layout)
+    {
+        block->predecessors.clear();
+        block->exceptionTarget = nullptr;
+        block->region.reset();
+        block->isHandlerBoundary = false;
+        block->isReachable = false;
+        block->immediateDominator = nullptr;
+    }
+
+    // Області обробників визначаються проходом по розміщенню блоків. Вкладений обробник
+    // починається пізніше за зовнішній, тому найглибший - останній активний
+    std::vector<std::vector<size_t>> boundariesAt(layout.size());
+    std::vector<std::vector<size_t>> startsAfter(layout.size());
+    for (size_t i = 0; i < handlers.size(); ++i)
+    {
+        const auto& handler = handlers[i];
+        for (auto boundary : { handler.firstHandler, handler.end, handler.finally })
+        {
+            if (boundary)
+            {
+                boundary->isHandlerBoundary = true;
+                boundariesAt[boundary->position].push_back(i);
+            }
+        }
+        startsAfter[handler.start->position].push_back(i);
+    }
+    std::vector<std::pair<size_t, HandlerSection>> active;
+    for (auto block : layout)
+    {
+        for (auto handlerIndex : boundariesAt[block->position])
+        {
+            const auto& handler = handlers[handlerIndex];
+            auto region = std::find_if(active.begin(), active.end(),
+                [&](const auto& region) { return region.first == handlerIndex; });
+            plog::passert(region != active.end()) << "Межа обробника винятків розміщена перед його TRY";
+            if (handler.end == block)
+            {
+                active.erase(region);
+            }
+            else if (handler.finally == block)
+            {
+                region->second = HandlerSection::FINALLY;
+            }
+            else
+            {
+                region->second = HandlerSection::HANDLERS;
+            }
+        }
+        if (!active.empty())
+        {
+            block->region = active.back();
+            const auto& handler = handlers[active.back().first];
+            switch (active.back().second)
+            {
+            case HandlerSection::TRY_BODY:
+                block->exceptionTarget = handler.firstHandler;
+                break;
+            case HandlerSection::HANDLERS:
+                block->exceptionTarget = handler.finally ? handler.finally : handler.end;
+                break;
+            case HandlerSection::FINALLY:
+                block->exceptionTarget = handler.end;
+                break;
+            }
+        }
+        for (auto handlerIndex : startsAfter[block->position])
+        {
+            active.emplace_back(handlerIndex, HandlerSection::TRY_BODY);
+        }
+    }
+
+    for (auto block : layout)
+    {
+        for (auto successor : allSuccessors(block))
+        {
+            successor->predecessors.push_back(block);
+        }
+    }
+
+    // Обхід в глибину для нумерації блоків у зворотному порядку
+    std::vector<BasicBlock*> postorderBlocks;
+    std::vector<std::pair<BasicBlock*, std::vector<BasicBlock*>>> stack;
+    layout.front()->isReachable = true;
+    stack.emplace_back(layout.front(), allSuccessors(layout.front()));
+    while (!stack.empty())
+    {
+        auto& [block, pending] = stack.back();
+        if (pending.empty())
+        {
+            block->postorder = postorderBlocks.size();
+            postorderBlocks.push_back(block);
+            stack.pop_back();
+            continue;
+        }
+        auto successor = pending.back();
+        pending.pop_back();
+        if (!successor->isReachable)
+        {
+            successor->isReachable = true;
+            stack.emplace_back(successor, allSuccessors(successor));
+        }
+    }
+
+    // Домінатори за алгоритмом Купера, Гарві та Кеннеді
+    auto intersect = [](BasicBlock* a, BasicBlock* b)
+    {
+        while (a != b)
+        {
+            while (a->postorder < b->postorder)
+            {
+                a = a->immediateDominator;
+            }
+            while (b->postorder < a->postorder)
+            {
+                b = b->immediateDominator;
+            }
+        }
+        return a;
+    };
+    layout.front()->immediateDominator = layout.front();
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto block = postorderBlocks.rbegin(); block != postorderBlocks.rend(); ++block)
+        {
+            if (*block == layout.front())
+            {
+                continue;
+            }
+            BasicBlock* dominator = nullptr;
+            for (auto predecessor : (*block)->predecessors)
+            {
+                if (predecessor->immediateDominator)
+                {
+                    dominator = dominator ? intersect(predecessor, dominator) : predecessor;
+                }
+            }
+            if ((*block)->immediateDominator != dominator)
+            {
+                (*block)->immediateDominator = dominator;
+                changed = true;
+            }
+        }
+    }
+}
+
+bool compiler::ControlFlowGraph::dominates(BasicBlock* dominator, BasicBlock* block) const
+{
+    if (!block->isReachable)
+    {
+        return false;
+    }
+    while (block != dominator)
+    {
+        if (block == block->immediateDominator)
+        {
+            return false;
+        }
+        block = block->immediateDominator;
+    }
+    return true;
+}
+
+std::vector<Loop> compiler::ControlFlowGraph::findLoops() const
+{
+    std::vector<Loop> loops;
+    std::vector<std::unordered_set<BasicBlock*>> members;
+    std::unordered_map<BasicBlock*, size_t> loopByHeader;
+    for (auto block : layout)
+    {
+        if (!block->isReachable)
+        {
+            continue;
+        }
+        for (auto header : allSuccessors(block))
+        {
+            // Зворотна дуга веде в блок, який домінує над її початком
+            if (!dominates(header, block))
+            {
+                continue;
+            }
+            auto [it, inserted] = loopByHeader.try_emplace(header, loops.size());
+            if (inserted)
+            {
+                loops.push_back({ header, {} });
+                members.push_back({ header });
+            }
+            auto& loopMembers = members[it->second];
+            std::vector<BasicBlock*> worklist;
+            if (loopMembers.insert(block).second)
+            {
+                worklist.push_back(block);
+            }
+            while (!worklist.empty())
+            {
+                auto member = worklist.back();
+                worklist.pop_back();
+                for (auto predecessor : member->predecessors)
+                {
+                    if (predecessor->isReachable && loopMembers.insert(predecessor).second)
+                    {
+                        worklist.push_back(predecessor);
+                    }
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+        loops[i].blocks.assign(members[i].begin(), members[i].end());
+        std::sort(loops[i].blocks.begin(), loops[i].blocks.end(),
+            [](BasicBlock* a, BasicBlock* b) { return a->position < b->position; });
+    }
+    return loops;
+}
+
+void compiler::ControlFlowGraph::build(vm::CodeObject* codeObject)
+{
+    auto decoded = Disassembler::decode(codeObject);
+    std::vector<IrInstruction> instructions;
+    instructions.reserve(decoded.instructions.size());
+    std::optional<vm::WORD> lineno;
+    for (const auto& instruction : decoded.instructions)
+    {
+        // В ipToLineno записані лише зміни рядка, а блоки можуть бути переставлені,
+        // тому кожна інструкція отримує свій рядок
+        if (instruction.lineno)
+        {
+            lineno = instruction.lineno;
+        }
+        instructions.push_back({ instruction.op, instruction.operand, instruction.argument, lineno });
+    }
+
+    // Блоки починаються з цілей переходів, меж обробників винятків та END_TRY, а
+    // завершуються переходами та TRY, щоб межі областей обробників збігались з межами блоків
+    std::vector<bool> isLeader(instructions.size() + 1, false);
+    isLeader[0] = true;
+    isLeader[instructions.size()] = true;
+    for (size_t i = 0; i < instructions.size(); ++i)
+    {
+        auto op = instructions[i].op;
+        if (Disassembler::isJump(op))
+        {
+            isLeader[decoded.toIndex(instructions[i].operand)] = true;
+        }
+        if (Disassembler::isJump(op) || Disassembler::isTerminator(op) || op == TRY)
+        {
+            isLeader[i + 1] = true;
+        }
+        if (op == END_TRY)
+        {
+            isLeader[i] = true;
+        }
+    }
+    for (const auto& handler : codeObject->exceptionHandlers)
+    {
+        isLeader[decoded.toIndex(handler.firstHandlerAddress)] = true;
+        isLeader[decoded.toIndex(handler.endAddress)] = true;
+        if (handler.finallyAddress)
+        {
+            isLeader[decoded.toIndex(handler.finallyAddress)] = true;
+        }
+    }
+
+    blocks.clear();
+    layout.clear();
+    handlers.clear();
+    std::vector<BasicBlock*> blockByIndex(instructions.size(), nullptr);
+    for (size_t i = 0; i < instructions.size(); ++i)
+    {
+        if (isLeader[i])
+        {
+            layout.push_back(createBlock());
+        }
+        blockByIndex[i] = layout.back();
+    }
+    for (size_t i = 0; i < instructions.size(); ++i)
+    {
+        auto block = blockByIndex[i];
+        auto& instruction = instructions[i];
+        if (Disassembler::isJump(instruction.op))
+        {
+            instruction.target = blockByIndex[decoded.toIndex(instruction.operand)];
+            instruction.operand = 0;
+        }
+        if (instruction.op == JMP)
+        {
+            block->next = instruction.target;
+            continue;
+        }
+        block->instructions.push_back(instruction);
+        if (isLeader[i + 1] && !Disassembler::isTerminator(instruction.op) && i + 1 < instructions.size())
+        {
+            block->next = blockByIndex[i + 1];
+        }
+    }
+    for (const auto& handler : codeObject->exceptionHandlers)
+    {
+        auto start = blockByIndex[decoded.toIndex(handler.startAddress)];
+        plog::passert(start->instructions.back().op == TRY) << "Обробник винятків не починається з TRY";
+        handlers.push_back({
+            start,
+            blockByIndex[decoded.toIndex(handler.firstHandlerAddress)],
+            blockByIndex[decoded.toIndex(handler.endAddress)],
+            handler.finallyAddress ? blockByIndex[decoded.toIndex(handler.finallyAddress)] : nullptr });
+    }
+
+    // Блоки, що складались лише з JMP, стали порожніми. Переходи в них ведуть одразу в ціль.
+    // Кількість кроків обмежена, щоб не зациклитись на порожньому нескінченному циклі
+    auto skipEmpty = [&](BasicBlock* block)
+    {
+        for (size_t steps = 0; block && block->instructions.empty() && block->next
+            && steps < layout.size(); ++steps)
+        {
+            block = block->next;
+        }
+        return block;
+    };
+    for (auto block : layout)
+    {
+        block->next = skipEmpty(block->next);
+        for (auto& instruction : block->instructions)
+        {
+            instruction.target = skipEmpty(instruction.target);
+        }
+    }
+    std::unordered_set<BasicBlock*> referenced{ layout.front() };
+    for (auto block : layout)
+    {
+        for (auto successor : successors(block))
+        {
+            referenced.insert(successor);
+        }
+    }
+    std::erase_if(layout, [&](BasicBlock* block)
+        { return block->instructions.empty() && !referenced.contains(block); });
+    updatePositions();
+}
+
+void compiler::ControlFlowGraph::linearize(vm::CodeObject* codeObject)
+{
+    updatePositions();
+    auto needsJump = [&](BasicBlock* block)
+    {
+        return block->next
+            && (block->position + 1 == layout.size() || layout[block->position + 1] != block->next);
+    };
+
+    std::vector<vm::WORD> addresses;
+    addresses.reserve(layout.size());
+    vm::WORD address = 0;
+    for (auto block : layout)
+    {
+        addresses.push_back(address);
+        for (const auto& instruction : block->instructions)
+        {
+            address += instruction.argument ? 2 : 1;
+        }
+        address += needsJump(block) ? 1 : 0;
+    }
+
+    auto& code = codeObject->code;
+    code.clear();
+    codeObject->ipToLineno.clear();
+    std::optional<vm::WORD> lineno;
+    std::vector<vm::WORD> tryAddresses(layout.size(), 0);
+    auto emit = [&](const IrInstruction& instruction, vm::WORD operand)
+    {
+        if (instruction.lineno && instruction.lineno != lineno)
+        {
+            codeObject->ipToLineno[static_cast<vm::WORD>(code.size())] = instruction.lineno.value();
+            lineno = instruction.lineno;
+        }
+        code.push_back(static_cast<vm::WORD>(instruction.op) + (operand << 8));
+        if (instruction.argument)
+        {
+            code.push_back(instruction.argument.value());
+        }
+    };
+    for (auto block : layout)
+    {
+        for (const auto& instruction : block->instructions)
+        {
+            if (instruction.op == TRY)
+            {
+                tryAddresses[block->position] = static_cast<vm::WORD>(code.size());
+            }
+            emit(instruction,
+                instruction.target ? addresses[instruction.target->position] : instruction.operand);
+        }
+        if (needsJump(block))
+        {
+            emit({ JMP }, addresses[block->next->position]);
+        }
+    }
+    code.shrink_to_fit();
+
+    codeObject->exceptionHandlers.clear();
+    for (const auto& handler : handlers)
+    {
+        vm::ExceptionHandler excHandler{};
+        excHandler.startAddress = tryAddresses[handler.start->position];
+        excHandler.firstHandlerAddress = addresses[handler.firstHandler->position];
+        excHandler.endAddress = addresses[handler.end->position];
+        excHandler.finallyAddress = handler.finally ? addresses[handler.finally->position] : 0;
+        codeObject->exceptionHandlers.push_back(excHandler);
+    }
+}
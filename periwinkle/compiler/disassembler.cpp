@@ -2,6 +2,9 @@
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <limits>
+#include <cstdint>
+#include <format>
 
 #include "disassembler.hpp"
 #include "types.hpp"
@@ -38,11 +41,14 @@ int compiler::Disassembler::opCodeLenArguments(OpCode code)
     case LOAD_LOCAL:
     case STORE_LOCAL:
     case DELETE_LOCAL:
+    case LOAD_LOCAL_FAST:
+    case LOAD_GLOBAL_OR_NULL:
     case LOAD_CELL:
     case STORE_CELL:
     case GET_CELL:
     case GET_ATTR:
     case CALL:
+    case TAIL_CALL:
     case COMPARE:
     case LOAD_METHOD:
     case CALL_METHOD:
@@ -55,12 +61,68 @@ int compiler::Disassembler::opCodeLenArguments(OpCode code)
         return 1;
     case CALL_NA:
     case CALL_METHOD_NA:
+    case TAIL_CALL_NA:
         return 2;
     default:
         return 0;
     }
 }
 
+bool compiler::Disassembler::isJump(OpCode code)
+{
+    switch (code)
+    {
+    case JMP:
+    case JMP_IF_TRUE:
+    case JMP_IF_FALSE:
+    case JMP_IF_TRUE_OR_POP:
+    case JMP_IF_FALSE_OR_POP:
+    case FOR_EACH:
+    case CATCH:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool compiler::Disassembler::isTerminator(OpCode code)
+{
+    return code == JMP || code == RETURN || code == TAIL_CALL || code == TAIL_CALL_NA || code == RAISE;
+}
+
+DecodedCode compiler::Disassembler::decode(vm::CodeObject* codeObject)
+{
+    const auto& code = codeObject->code;
+    DecodedCode decoded{ codeObject, {}, std::vector<size_t>(code.size(), SIZE_MAX) };
+    for (size_t ip = 0; ip < code.size();)
+    {
+        auto op = static_cast<OpCode>(code[ip] & vm::OPCODE_MASK);
+        DecodedInstruction instruction{ op, code[ip] >> 8 };
+        if (auto it = codeObject->ipToLineno.find(static_cast<vm::WORD>(ip)); it != codeObject->ipToLineno.end())
+        {
+            instruction.lineno = it->second;
+        }
+        decoded.indexByAddress[ip] = decoded.instructions.size();
+        if (opCodeLenArguments(op) == 2)
+        {
+            instruction.argument = code[++ip];
+        }
+        decoded.instructions.push_back(instruction);
+        ++ip;
+    }
+    return decoded;
+}
+
+size_t compiler::DecodedCode::toIndex(vm::WORD address) const
+{
+    if (address >= indexByAddress.size() || indexByAddress[address] == SIZE_MAX)
+    {
+        plog::fatal << std::format(
+            "Байткод \"{}\": адреса {} не є початком інструкції", codeObject->name, address);
+    }
+    return indexByAddress[address];
+}
+
 std::string compiler::Disassembler::getValueAsString(vm::Object* object)
 {
     if (OBJECT_IS(object, &vm::intObjectType))
@@ -78,8 +140,13 @@ std::string compiler::Disassembler::getValueAsString(vm::Object* object)
     else if (OBJECT_IS(object, &vm::realObjectType))
     {
         std::stringstream ss;
+        ss.precision(std::numeric_limits<double>::max_digits10);
         ss << (((vm::RealObject*)object)->value);
-        return ss.str();
+        auto value = ss.str();
+        // Дійсне число завжди виводиться з крапкою, щоб не збігатися з цілим
+        if (value.find_first_of(".en") == std::string::npos)
+            value += ".0";
+        return value;
     }
     else if (OBJECT_IS(object, &vm::nullObjectType))
     {
@@ -146,7 +213,7 @@ std::string compiler::Disassembler::disassemble(vm::CodeObject* codeObject)
                 }
             }
             else if (op == STORE_GLOBAL || op == LOAD_GLOBAL || op == DELETE_GLOBAL
-                || op == GET_ATTR || op == LOAD_METHOD)
+                || op == LOAD_GLOBAL_OR_NULL || op == GET_ATTR || op == LOAD_METHOD)
             {
                 auto& name = codeObject->names[argument];
                 out << "(" << name << ")";
@@ -166,7 +233,7 @@ std::string compiler::Disassembler::disassemble(vm::CodeObject* codeObject)
                 }
                 out << ")";
             }
-            else if (op == LOAD_LOCAL || op == STORE_LOCAL || op == DELETE_LOCAL)
+            else if (op == LOAD_LOCAL || op == STORE_LOCAL || op == DELETE_LOCAL || op == LOAD_LOCAL_FAST)
             {
                 auto& name = codeObject->locals[argument];
                 out << "(" << name << ")";
@@ -211,7 +278,7 @@ std::string compiler::Disassembler::disassemble(vm::CodeObject* codeObject)
 
             out << ", " << argument2;
 
-            if (op == CALL_NA || op == CALL_METHOD_NA)
+            if (op == CALL_NA || op == CALL_METHOD_NA || op == TAIL_CALL_NA)
             {
                 out << "(" << getValueAsString(codeObject->constants[argument2]) << ")";
             }
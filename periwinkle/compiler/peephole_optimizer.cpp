@@ -0,0 +1,293 @@
+#include <algorithm>
+
+#include "peephole_optimizer.hpp"
+#include "disassembler.hpp"
+#include "plogger.hpp"
+
+using namespace compiler;
+using enum vm::OpCode;
+
+void compiler::PeepholeOptimizer::decode(vm::CodeObject* codeObject)
+{
+    auto decoded = Disassembler::decode(codeObject);
+    instructions.clear();
+    instructions.reserve(decoded.instructions.size());
+    for (const auto& instruction : decoded.instructions)
+    {
+        auto operand = Disassembler::isJump(instruction.op)
+            ? static_cast<vm::WORD>(decoded.toIndex(instruction.operand)) : instruction.operand;
+        instructions.push_back({ instruction.op, operand, instruction.argument, instruction.lineno });
+    }
+    handlers.clear();
+    for (const auto& handler : codeObject->exceptionHandlers)
+    {
+        handlers.push_back({
+            decoded.toIndex(handler.startAddress),
+            decoded.toIndex(handler.firstHandlerAddress),
+            decoded.toIndex(handler.endAddress),
+            handler.finallyAddress ? std::optional(decoded.toIndex(handler.finallyAddress)) : std::nullopt });
+    }
+}
+
+void compiler::PeepholeOptimizer::encode(vm::CodeObject* codeObject)
+{
+    std::vector<vm::WORD> addresses;
+    addresses.reserve(instructions.size());
+    vm::WORD address = 0;
+    for (const auto& instruction : instructions)
+    {
+        addresses.push_back(address);
+        address += instruction.argument ? 2 : 1;
+    }
+
+    auto& code = codeObject->code;
+    code.clear();
+    codeObject->ipToLineno.clear();
+    for (size_t i = 0; i < instructions.size(); ++i)
+    {
+        const auto& instruction = instructions[i];
+        auto operand = Disassembler::isJump(instruction.op) ? addresses[instruction.operand] : instruction.operand;
+        if (instruction.lineno)
+        {
+            codeObject->ipToLineno[addresses[i]] = instruction.lineno.value();
+        }
+        code.push_back(static_cast<vm::WORD>(instruction.op) + (operand << 8));
+        if (instruction.argument)
+        {
+            code.push_back(instruction.argument.value());
+        }
+    }
+    code.shrink_to_fit();
+
+    codeObject->exceptionHandlers.clear();
+    for (const auto& handler : handlers)
+    {
+        vm::ExceptionHandler excHandler{};
+        excHandler.startAddress = addresses[handler.start];
+        excHandler.firstHandlerAddress = addresses[handler.firstHandler];
+        excHandler.endAddress = addresses[handler.end];
+        excHandler.finallyAddress = handler.finally ? addresses[handler.finally.value()] : 0;
+        codeObject->exceptionHandlers.push_back(excHandler);
+    }
+}
+
+void compiler::PeepholeOptimizer::compact()
+{
+    // Нові індекси. Видалена інструкція отримує індекс наступної, що залишилась
+    std::vector<size_t> newIndex(instructions.size() + 1);
+    size_t kept = std::count_if(instructions.begin(), instructions.end(),
+        [](const Instruction& instruction) { return !instruction.removed; });
+    newIndex[instructions.size()] = kept;
+    for (size_t i = instructions.size(); i-- > 0;)
+    {
+        if (!instructions[i].removed)
+        {
+            --kept;
+        }
+        newIndex[i] = kept;
+    }
+
+    std::vector<Instruction> result;
+    result.reserve(newIndex[instructions.size()]);
+    for (auto& instruction : instructions)
+    {
+        if (instruction.removed)
+        {
+            continue;
+        }
+        if (Disassembler::isJump(instruction.op))
+        {
+            instruction.operand = static_cast<vm::WORD>(newIndex[instruction.operand]);
+        }
+        result.push_back(instruction);
+    }
+    instructions = std::move(result);
+
+    std::erase_if(handlers, [](const Handler& handler) { return handler.removed; });
+    for (auto& handler : handlers)
+    {
+        handler.start = newIndex[handler.start];
+        handler.firstHandler = newIndex[handler.firstHandler];
+        handler.end = newIndex[handler.end];
+        if (handler.finally)
+        {
+            handler.finally = newIndex[handler.finally.value()];
+        }
+    }
+}
+
+bool compiler::PeepholeOptimizer::threadJumps()
+{
+    bool changed = false;
+    for (auto& instruction : instructions)
+    {
+        if (!Disassembler::isJump(instruction.op))
+        {
+            continue;
+        }
+        // Кількість кроків обмежена, щоб не зациклитись на циклі з переходів
+        auto target = instruction.operand;
+        for (size_t steps = 0; instructions[target].op == JMP && steps < instructions.size(); ++steps)
+        {
+            target = instructions[target].operand;
+        }
+        if (target != instruction.operand)
+        {
+            instruction.operand = target;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool compiler::PeepholeOptimizer::removeUnreachable()
+{
+    std::vector<bool> reachable(instructions.size(), false);
+    std::vector<size_t> worklist;
+    std::vector<const Handler*> handlerByStart(instructions.size(), nullptr);
+    for (const auto& handler : handlers)
+    {
+        handlerByStart[handler.start] = &handler;
+    }
+    auto reach = [&](size_t index)
+    {
+        if (!reachable[index])
+        {
+            reachable[index] = true;
+            worklist.push_back(index);
+        }
+    };
+
+    reach(0);
+    while (!worklist.empty())
+    {
+        auto index = worklist.back();
+        worklist.pop_back();
+        const auto& instruction = instructions[index];
+        if (Disassembler::isJump(instruction.op))
+        {
+            reach(instruction.operand);
+        }
+        if (instruction.op == TRY)
+        {
+            // Обробник помилок переходить в обробники, блок "наприкінці" та END_TRY
+            auto handler = handlerByStart[index];
+            plog::passert(handler != nullptr) << "Для TRY немає обробника";
+            reach(handler->firstHandler);
+            reach(handler->end);
+            if (handler->finally)
+            {
+                reach(handler->finally.value());
+            }
+        }
+        if (!Disassembler::isTerminator(instruction.op) && index + 1 < instructions.size())
+        {
+            reach(index + 1);
+        }
+    }
+
+    bool changed = false;
+    for (size_t i = 0; i < instructions.size(); ++i)
+    {
+        if (!reachable[i])
+        {
+            instructions[i].removed = true;
+            changed = true;
+        }
+    }
+    for (auto& handler : handlers)
+    {
+        handler.removed = !reachable[handler.start];
+    }
+    return changed;
+}
+
+bool compiler::PeepholeOptimizer::combinePairs()
+{
+    // Інструкції, в які можна потрапити не з попередньої
+    std::vector<bool> isTarget(instructions.size(), false);
+    for (const auto& instruction : instructions)
+    {
+        if (Disassembler::isJump(instruction.op))
+        {
+            isTarget[instruction.operand] = true;
+        }
+    }
+    for (const auto& handler : handlers)
+    {
+        isTarget[handler.firstHandler] = true;
+        isTarget[handler.end] = true;
+        if (handler.finally)
+        {
+            isTarget[handler.finally.value()] = true;
+        }
+    }
+
+    bool changed = false;
+    for (size_t i = 0; i < instructions.size(); ++i)
+    {
+        auto& instruction = instructions[i];
+        if (instruction.op == JMP && instruction.operand == i + 1)
+        {
+            instruction.removed = true;
+            changed = true;
+            continue;
+        }
+        if (i + 1 == instructions.size() || isTarget[i + 1])
+        {
+            continue;
+        }
+        auto& next = instructions[i + 1];
+        if (instruction.op == LOAD_CONST && next.op == POP)
+        {
+            instruction.removed = true;
+            next.removed = true;
+            changed = true;
+            ++i;
+        }
+        else if (instruction.op == STORE_LOCAL && (next.op == LOAD_LOCAL || next.op == LOAD_LOCAL_FAST)
+            && next.operand == instruction.operand)
+        {
+            // Значення залишається на стеку, тому змінна не читається повторно
+            next.op = STORE_LOCAL;
+            next.lineno = instruction.lineno;
+            instruction.op = DUP;
+            instruction.operand = 0;
+            changed = true;
+            ++i;
+        }
+    }
+    return changed;
+}
+
+void compiler::PeepholeOptimizer::optimizeCodeObject(vm::CodeObject* codeObject)
+{
+    decode(codeObject);
+    bool changed;
+    do
+    {
+        changed = threadJumps();
+        changed |= removeUnreachable();
+        compact();
+        changed |= combinePairs();
+        compact();
+    } while (changed);
+    encode(codeObject);
+}
+
+void compiler::PeepholeOptimizer::optimize(vm::CodeObject* codeObject)
+{
+    // Відкладене тіло оптимізується після компіляції при першому виклику
+    if (codeObject->deferredBody != nullptr)
+    {
+        return;
+    }
+    optimizeCodeObject(codeObject);
+    for (auto constant : codeObject->constants)
+    {
+        if (OBJECT_IS(constant, &vm::codeObjectType))
+        {
+            optimize(static_cast<vm::CodeObject*>(constant));
+        }
+    }
+}
@@ -5,25 +5,25 @@
 
 using namespace compiler;
 
-void compiler::Scope::addLocal(const std::string& name)
+void compiler::Scope::addLocal(std::string_view name)
 {
     locals.push_back(name);
     variableInfo[name] = type == ScopeType::GLOBAL ? VariableType::GLOBAL : VariableType::LOCAL;
 }
 
-void compiler::Scope::addCell(const std::string& name)
+void compiler::Scope::addCell(std::string_view name)
 {
     cells.push_back(name);
     variableInfo[name] = VariableType::CELL;
 }
 
-void compiler::Scope::addFree(const std::string& name)
+void compiler::Scope::addFree(std::string_view name)
 {
     freeVariables.push_back(name);
     variableInfo[name] = VariableType::CELL;
 }
 
-void compiler::Scope::promote(const std::string& name, Scope* owner)
+void compiler::Scope::promote(std::string_view name, Scope* owner)
 {
     owner->addCell(name);
     auto scope = this;
@@ -34,7 +34,7 @@ void compiler::Scope::promote(const std::string& name, Scope* owner)
     }
 }
 
-void compiler::Scope::maybePromote(const std::string& name)
+void compiler::Scope::maybePromote(std::string_view name)
 {
     auto varType = (type == ScopeType::GLOBAL) ? VariableType::GLOBAL : VariableType::LOCAL;
 
@@ -57,9 +57,9 @@ void compiler::Scope::maybePromote(const std::string& name)
 }
 
 std::pair<Scope*, VariableType> compiler::Scope::resolve(
-    const std::string& name, VariableType variableType)
+    std::string_view name, VariableType variableType)
 {
-    if (vm::getBuiltin()->contains(name) || type == ScopeType::GLOBAL)
+    if (vm::getBuiltin()->contains(std::string(name)) || type == ScopeType::GLOBAL)
     {
         return std::make_pair(nullptr, VariableType::GLOBAL);
     }
@@ -87,10 +87,19 @@ std::pair<Scope*, VariableType> compiler::Scope::resolve(
     return parent->resolve(name, variableType);
 }
 
-vm::OpCode Scope::getVarGetter(const std::string& name)
+// Тип змінної в області видимості. Змінні, яких в ній немає, глобальні. Ключі variableInfo
+// вказують на текст токенів, тому ім'я, передане при пошуку, в неї не додається
+static VariableType variableType(const Scope* scope, std::string_view name)
+{
+    auto it = scope->variableInfo.find(name);
+    return it == scope->variableInfo.end() ? VariableType::GLOBAL : it->second;
+}
+
+vm::OpCode Scope::getVarGetter(std::string_view name)
 {
     using enum VariableType;
-    switch (variableInfo[name])
+    auto varType = variableType(this, name);
+    switch (varType)
     {
     case GLOBAL:
         return vm::OpCode::LOAD_GLOBAL;
@@ -99,14 +108,15 @@ vm::OpCode Scope::getVarGetter(const std::string& name)
     case CELL:
         return vm::OpCode::LOAD_CELL;
     default:
-        plog::fatal << "Невідомий тип змінної \"" << (int)variableInfo[name] << "\"";
+        plog::fatal << "Невідомий тип змінної \"" << (int)varType << "\"";
     }
 }
 
-vm::OpCode Scope::getVarSetter(const std::string& name)
+vm::OpCode Scope::getVarSetter(std::string_view name)
 {
     using enum VariableType;
-    switch (variableInfo[name])
+    auto varType = variableType(this, name);
+    switch (varType)
     {
     case GLOBAL:
         return vm::OpCode::STORE_GLOBAL;
@@ -115,21 +125,22 @@ vm::OpCode Scope::getVarSetter(const std::string& name)
     case CELL:
         return vm::OpCode::STORE_CELL;
     default:
-        plog::fatal << "Невідомий тип змінної \"" << (int)variableInfo[name] << "\"";
+        plog::fatal << "Невідомий тип змінної \"" << (int)varType << "\"";
     }
 }
 
-vm::OpCode Scope::getVarDeleter(const std::string& name)
+vm::OpCode Scope::getVarDeleter(std::string_view name)
 {
     using enum VariableType;
-    switch (variableInfo[name])
+    auto varType = variableType(this, name);
+    switch (varType)
     {
     case GLOBAL:
         return vm::OpCode::DELETE_GLOBAL;
     case LOCAL:
         return vm::OpCode::DELETE_LOCAL;
     default:
-        plog::fatal << "Невідомий тип змінної \"" << (int)variableInfo[name] << "\"";
+        plog::fatal << "Невідомий тип змінної \"" << (int)varType << "\"";
     }
 }
 
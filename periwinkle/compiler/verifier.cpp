@@ -0,0 +1,414 @@
+#include <algorithm>
+#include <format>
+#include <span>
+#include <vector>
+
+#include "verifier.hpp"
+#include "disassembler.hpp"
+#include "string_vector_object.hpp"
+#include "plogger.hpp"
+
+using namespace compiler;
+using enum vm::OpCode;
+
+// Інструкція ще не досягнута
+constexpr const int UNKNOWN_DEPTH = -1;
+
+static bool isUnaryOperator(vm::WORD operand)
+{
+    using enum vm::ObjectOperatorOffset;
+    auto offset = static_cast<vm::ObjectOperatorOffset>(operand);
+    return offset == POS || offset == NEG || offset == GET_ITER;
+}
+
+static bool isBinaryOperator(vm::WORD operand)
+{
+    using enum vm::ObjectOperatorOffset;
+    auto offset = static_cast<vm::ObjectOperatorOffset>(operand);
+    return offset == ADD || offset == SUB || offset == MUL || offset == DIV
+        || offset == FLOOR_DIV || offset == MOD;
+}
+
+void compiler::Verifier::fail(std::string message)
+{
+    if (error.empty())
+    {
+        error = std::move(message);
+    }
+}
+
+bool compiler::Verifier::verifyCodeObject(vm::CodeObject* codeObject, bool isFunction)
+{
+    std::span<const vm::WORD> code(codeObject->instructions(),
+        codeObject->borrowedCode.empty() ? codeObject->code.size() : codeObject->borrowedCode.size());
+    const auto& layout = codeObject->frameLayout;
+    // Фрейм функції починається зі слотів аргументів, а в кореневому фреймі немає комірок
+    if (isFunction && (layout.argumentSlots > layout.localCount || codeObject->defaults.size() > codeObject->arity))
+    {
+        fail(std::format("Байткод \"{}\": параметри не вміщаються в локальні змінні", codeObject->name));
+        return false;
+    }
+    if (!isFunction && (layout.cellCount != 0 || layout.freevarCount != 0))
+    {
+        fail(std::format("Байткод \"{}\": модуль не може мати комірок", codeObject->name));
+        return false;
+    }
+    auto cellCount = static_cast<vm::WORD>(layout.cellCount + layout.freevarCount);
+
+    std::vector<int> depths(code.size(), UNKNOWN_DEPTH);
+    std::vector<vm::WORD> worklist;
+    int maxDepth = 0;
+    // Обробники винятків за адресами їх TRY та END_TRY
+    std::vector<vm::ExceptionHandler*> handlerByStart(code.size(), nullptr);
+    std::vector<vm::ExceptionHandler*> handlerByEnd(code.size(), nullptr);
+    for (auto& handler : codeObject->exceptionHandlers)
+    {
+        if (handler.startAddress >= handler.endAddress || handler.endAddress >= code.size()
+            || handler.firstHandlerAddress >= code.size() || handler.finallyAddress >= code.size())
+        {
+            fail(std::format("Байткод \"{}\": обробник винятків за межами коду", codeObject->name));
+            return false;
+        }
+        handlerByStart[handler.startAddress] = &handler;
+        handlerByEnd[handler.endAddress] = &handler;
+    }
+
+    // Записує глибину стеку, з якою виконання приходить в target
+    auto reach = [&](vm::WORD from, vm::WORD target, int depth)
+    {
+        // Повідомлення форматуються лише при помилці, бо перевірки виконуються для кожної інструкції
+        if (target >= code.size())
+        {
+            fail(std::format(
+                "Байткод \"{}\": перехід з {} за межі коду в {}", codeObject->name, from, target));
+        }
+        else if (depth < 0)
+        {
+            fail(std::format(
+                "Байткод \"{}\": інструкція {} знімає значення з порожнього стеку", codeObject->name, from));
+        }
+        else if (depths[target] == UNKNOWN_DEPTH)
+        {
+            depths[target] = depth;
+            maxDepth = std::max(maxDepth, depth);
+            worklist.push_back(target);
+        }
+        else if (depths[target] != depth)
+        {
+            fail(std::format(
+                "Байткод \"{}\": в інструкцію {} шляхи приходять з різною глибиною стеку ({} та {})",
+                codeObject->name, target, depths[target], depth));
+        }
+    };
+    // Перевіряє, що операнд інструкції ip є індексом в масиві розміру size
+    auto inRange = [&](vm::WORD ip, vm::WORD operand, size_t size, const char* what)
+    {
+        if (operand >= size)
+        {
+            fail(std::format("Байткод \"{}\": інструкція {} посилається на {} {} за межами масиву",
+                codeObject->name, ip, what, operand));
+            return false;
+        }
+        return true;
+    };
+    // Перевіряє константу з іменами іменованих аргументів виклику ip, записану в наступному слові
+    auto namedArgumentsValid = [&](vm::WORD ip, vm::WORD operand)
+    {
+        auto namesIndex = code[ip + 1];
+        if (!inRange(ip, namesIndex, codeObject->constants.size(), "константу"))
+        {
+            return false;
+        }
+        auto namedArgs = codeObject->constants[namesIndex];
+        if (!OBJECT_IS(namedArgs, &vm::stringVectorObjectType)
+            || static_cast<vm::StringVectorObject*>(namedArgs)->value.size() > operand)
+        {
+            fail(std::format("Байткод \"{}\": некоректні іменовані аргументи виклику {}",
+                codeObject->name, ip));
+            return false;
+        }
+        return true;
+    };
+
+    reach(0, 0, 0);
+    while (!worklist.empty() && error.empty())
+    {
+        auto ip = worklist.back();
+        worklist.pop_back();
+
+        auto op = static_cast<vm::OpCode>(code[ip] & vm::OPCODE_MASK);
+        if (op >= COUNT)
+        {
+            fail(std::format("Байткод \"{}\": невідомий опкод {} в інструкції {}",
+                codeObject->name, code[ip] & vm::OPCODE_MASK, ip));
+            break;
+        }
+        vm::WORD operand = code[ip] >> 8;
+        auto depth = depths[ip];
+        vm::WORD next = ip + std::max(Disassembler::opCodeLenArguments(op), 1);
+        if (next > code.size())
+        {
+            fail(std::format("Байткод \"{}\": інструкція {} обрізана", codeObject->name, ip));
+            break;
+        }
+
+        switch (op)
+        {
+        case LOAD_CONST:
+            if (inRange(ip, operand, codeObject->constants.size(), "константу"))
+            {
+                reach(ip, next, depth + 1);
+            }
+            break;
+        case LOAD_GLOBAL:
+        case LOAD_GLOBAL_OR_NULL:
+            if (inRange(ip, operand, codeObject->names.size(), "ім'я"))
+            {
+                reach(ip, next, depth + 1);
+            }
+            break;
+        case LOAD_LOCAL:
+        case LOAD_LOCAL_FAST:
+            if (inRange(ip, operand, codeObject->locals.size(), "локальну змінну"))
+            {
+                reach(ip, next, depth + 1);
+            }
+            break;
+        case GET_CELL:
+        case LOAD_CELL:
+            if (inRange(ip, operand, cellCount, "комірку"))
+            {
+                reach(ip, next, depth + 1);
+            }
+            break;
+        case DUP:
+            reach(ip, next, depth + 1);
+            break;
+        case UNARY_OP:
+            if (!isUnaryOperator(operand))
+            {
+                fail(std::format("Байткод \"{}\": невідомий унарний оператор в інструкції {}",
+                    codeObject->name, ip));
+                break;
+            }
+            reach(ip, next, depth);
+            break;
+        case GET_ATTR:
+        case LOAD_METHOD:
+        case DELETE_GLOBAL:
+            if (inRange(ip, operand, codeObject->names.size(), "ім'я"))
+            {
+                reach(ip, next, depth);
+            }
+            break;
+        case DELETE_LOCAL:
+            if (inRange(ip, operand, codeObject->locals.size(), "локальну змінну"))
+            {
+                reach(ip, next, depth);
+            }
+            break;
+        case NOT:
+            reach(ip, next, depth);
+            break;
+        case STORE_GLOBAL:
+            if (inRange(ip, operand, codeObject->names.size(), "ім'я"))
+            {
+                reach(ip, next, depth - 1);
+            }
+            break;
+        case STORE_LOCAL:
+            if (inRange(ip, operand, codeObject->locals.size(), "локальну змінну"))
+            {
+                reach(ip, next, depth - 1);
+            }
+            break;
+        case STORE_CELL:
+            if (inRange(ip, operand, cellCount, "комірку"))
+            {
+                reach(ip, next, depth - 1);
+            }
+            break;
+        case BINARY_OP:
+            if (!isBinaryOperator(operand))
+            {
+                fail(std::format("Байткод \"{}\": невідомий бінарний оператор в інструкції {}",
+                    codeObject->name, ip));
+                break;
+            }
+            reach(ip, next, depth - 1);
+            break;
+        case IS:
+        case COMPARE:
+            if (operand > (op == IS ? 1 : static_cast<vm::WORD>(vm::ObjectCompOperator::LE)))
+            {
+                fail(std::format("Байткод \"{}\": невідомий оператор порівняння в інструкції {}",
+                    codeObject->name, ip));
+                break;
+            }
+            reach(ip, next, depth - 1);
+            break;
+        case POP:
+            reach(ip, next, depth - 1);
+            break;
+        case JMP:
+            reach(ip, operand, depth);
+            break;
+        case JMP_IF_TRUE:
+        case JMP_IF_FALSE:
+            reach(ip, next, depth - 1);
+            reach(ip, operand, depth - 1);
+            break;
+        case JMP_IF_TRUE_OR_POP:
+        case JMP_IF_FALSE_OR_POP:
+            reach(ip, next, depth - 1);
+            reach(ip, operand, depth);
+            break;
+        case CALL_NA:
+        case CALL_METHOD_NA:
+            if (!namedArgumentsValid(ip, operand))
+            {
+                break;
+            }
+            [[fallthrough]];
+        case CALL:
+        case CALL_METHOD:
+            // Викликаний об'єкт та аргументи замінюються результатом
+            if (depth <= static_cast<int>(operand))
+            {
+                fail(std::format(
+                    "Байткод \"{}\": на стеку немає аргументів для виклику {}", codeObject->name, ip));
+                break;
+            }
+            reach(ip, next, depth - static_cast<int>(operand));
+            break;
+        case TAIL_CALL_NA:
+            if (!namedArgumentsValid(ip, operand))
+            {
+                break;
+            }
+            [[fallthrough]];
+        case TAIL_CALL:
+            // Результат виклику повертається з фрейму, тому хвостовий виклик можливий лише у функції
+            if (!isFunction)
+            {
+                fail(std::format("Байткод \"{}\": хвостовий виклик {} поза функцією", codeObject->name, ip));
+                break;
+            }
+            if (depth <= static_cast<int>(operand))
+            {
+                fail(std::format(
+                    "Байткод \"{}\": на стеку немає аргументів для виклику {}", codeObject->name, ip));
+            }
+            break;
+        case RETURN:
+        case RAISE:
+            if (depth <= 0)
+            {
+                fail(std::format(
+                    "Байткод \"{}\": інструкція {} знімає значення з порожнього стеку", codeObject->name, ip));
+            }
+            break;
+        case FOR_EACH:
+            // Наступний елемент додається над ітератором, а в кінці ітератор знімається
+            reach(ip, next, depth + 1);
+            reach(ip, operand, depth - 1);
+            break;
+        case MAKE_FUNCTION:
+        {
+            // CodeObject функції завантажує попередня інструкція
+            auto load = ip > 0 ? code[ip - 1] : 0;
+            if (ip == 0 || static_cast<vm::OpCode>(load & vm::OPCODE_MASK) != LOAD_CONST
+                || (load >> 8) >= codeObject->constants.size()
+                || !OBJECT_IS(codeObject->constants[load >> 8], &vm::codeObjectType))
+            {
+                fail(std::format(
+                    "Байткод \"{}\": перед MAKE_FUNCTION {} немає CodeObject", codeObject->name, ip));
+                break;
+            }
+            auto function = static_cast<vm::CodeObject*>(codeObject->constants[load >> 8]);
+            reach(ip, next, depth
+                - static_cast<int>(function->freevars.size() + function->defaults.size()));
+            break;
+        }
+        case TRY:
+        {
+            // Обробники та блок "наприкінці" починаються зі стеком, відновленим до глибини TRY
+            auto handler = handlerByStart[ip];
+            if (handler == nullptr)
+            {
+                fail(std::format("Байткод \"{}\": для TRY {} немає обробника", codeObject->name, ip));
+                break;
+            }
+            handler->stackDepth = static_cast<vm::WORD>(depth);
+            reach(ip, next, depth);
+            reach(ip, handler->firstHandlerAddress, depth);
+            if (handler->finallyAddress)
+            {
+                reach(ip, handler->finallyAddress, depth);
+            }
+            break;
+        }
+        case CATCH:
+            // Якщо тип збігся, він замінюється винятком, інакше знімається
+            reach(ip, next, depth);
+            reach(ip, operand, depth - 1);
+            break;
+        case END_TRY:
+        {
+            auto handler = handlerByEnd[ip];
+            if (handler == nullptr || depths[handler->startAddress] != depth)
+            {
+                fail(std::format(
+                    "Байткод \"{}\": END_TRY {} не відновлює глибину стеку TRY", codeObject->name, ip));
+                break;
+            }
+            reach(ip, next, depth);
+            break;
+        }
+        default:
+            plog::fatal << "Верифікація опкоду не реалізована: \""
+                << vm::stringEnum::enumToString(op) << "\"";
+        }
+    }
+
+    codeObject->maxStackDepth = static_cast<vm::WORD>(maxDepth);
+    return error.empty();
+}
+
+bool compiler::Verifier::verifyNested(vm::CodeObject* codeObject, bool isFunction)
+{
+    // Відкладене тіло перевіряється після компіляції, а тіло з образу - після читання,
+    // обидва при першому виклику
+    if (codeObject->deferredBody != nullptr || codeObject->imageBody != nullptr)
+    {
+        return true;
+    }
+    if (!verifyCodeObject(codeObject, isFunction))
+    {
+        return false;
+    }
+    for (auto constant : codeObject->constants)
+    {
+        if (OBJECT_IS(constant, &vm::codeObjectType)
+            && !verifyNested(static_cast<vm::CodeObject*>(constant), true))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool compiler::Verifier::verify(vm::CodeObject* codeObject)
+{
+    return verifyNested(codeObject, false);
+}
+
+bool compiler::Verifier::verifyFunction(vm::CodeObject* codeObject)
+{
+    return verifyNested(codeObject, true);
+}
+
+const std::string& compiler::Verifier::getError() const
+{
+    return error;
+}
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "code_object.hpp"
 
 using namespace vm;
@@ -10,6 +12,12 @@ static void traverse(CodeObject* codeObject)
     }
 }
 
+static u64 payloadSize(CodeObject* codeObject)
+{
+    return codeObject->code.capacity() * sizeof(WORD)
+        + codeObject->constants.capacity() * sizeof(Object*);
+}
+
 namespace vm
 {
     TypeObject codeObjectType =
@@ -20,12 +28,27 @@ namespace vm
         .alloc = DEFAULT_ALLOC(CodeObject),
         .dealloc = DEFAULT_DEALLOC(CodeObject),
         .traverse = (traverseFunction)traverse,
+        .payloadSize = (sizeFunction)payloadSize,
     };
 
     struct ExceptionHandler;
 }
 
 
+WORD vm::CodeObject::getLineno(WORD ip) const
+{
+    // Рядок записується лише для першої інструкції рядка, тому шукається найближчий
+    // запис не після ip
+    if (!borrowedLinenos.empty())
+    {
+        auto entry = std::upper_bound(borrowedLinenos.begin(), borrowedLinenos.end(), ip,
+            [](WORD ip, const LinenoEntry& entry) { return ip < entry.ip; });
+        return entry == borrowedLinenos.begin() ? 0 : std::prev(entry)->lineno;
+    }
+    auto entry = ipToLineno.upper_bound(ip);
+    return entry == ipToLineno.begin() ? 0 : std::prev(entry)->second;
+}
+
 std::optional<ExceptionHandler*> vm::CodeObject::getExceptionHandler(WORD ip)
 {
     for (auto& handler : exceptionHandlers) {
@@ -60,6 +83,26 @@ ExceptionHandler* vm::CodeObject::getHandlerByEndIp(WORD ip)
     return nullptr;
 }
 
+void vm::CodeObject::computeFrameLayout()
+{
+    frameLayout.argumentSlots = 1 + arity + static_cast<WORD>(isVariadic);
+    frameLayout.localCount = static_cast<WORD>(locals.size());
+    frameLayout.cellCount = static_cast<WORD>(cells.size());
+    frameLayout.freevarCount = static_cast<WORD>(freevars.size());
+    frameLayout.argumentCells.clear();
+    // Для CodeObject з кешу або образу це ще не перевірено верифікатором, тому пошук
+    // не виходить за межі locals
+    auto argumentsEnd = locals.begin() + std::min<size_t>(frameLayout.argumentSlots, locals.size());
+    for (WORD cellIndex = 0; cellIndex < cells.size(); ++cellIndex)
+    {
+        auto local = std::find(locals.begin(), argumentsEnd, cells[cellIndex]);
+        if (local != argumentsEnd)
+        {
+            frameLayout.argumentCells.emplace_back(cellIndex, static_cast<WORD>(local - locals.begin()));
+        }
+    }
+}
+
 CodeObject* vm::CodeObject::create(std::string name)
 {
     auto codeObject = (CodeObject*)allocObject(&codeObjectType);
@@ -3,6 +3,7 @@
 #include "exception_object.hpp"
 #include "string_object.hpp"
 #include "utils.hpp"
+#include "unicode.hpp"
 #include "code_object.hpp"
 #include "native_method_object.hpp"
 #include "argument_parser.hpp"
@@ -35,13 +36,13 @@ static Object* exceptionInit(Object* o, std::span<Object*> args, TupleObject* va
 
 static Object* exceptionAlloc()
 {
-    auto o = new ExceptionObject;
+    auto o = new (allocObjectMemory(sizeof(ExceptionObject))) ExceptionObject;
     return (Object*)o;
 }
 
 static void exceptionDealloc(Object* o)
 {
-    delete (ExceptionObject*)o;
+    ((ExceptionObject*)o)->~ExceptionObject();
 }
 
 static Object* exceptionToString(Object* a)
@@ -97,6 +98,9 @@ namespace vm
     EXCEPTION_EXTEND(ExceptionObjectType, InternalError, "ВнутрішняПомилка",
         { .toString = exceptionToString });
 
+    EXCEPTION_EXTEND(ExceptionObjectType, MemoryError, "ПомилкаПам'яті",
+        { .toString = exceptionToString });
+
     ExceptionObject P_NotImplemented{ {.objectType = &NotImplementedErrorObjectType} };
 
     std::string vm::ExceptionObject::formatStackTrace() const
@@ -115,7 +119,10 @@ namespace vm
             if (!item->functionName.empty())
                 format << " в " << item->functionName;
             format << "\n        ";
-            format << utils::trim(utils::getLineFromString(item->source->getText(), line));
+            // Текст програми з образу байткоду не перевіряється при завантаженні
+            auto sourceLine = utils::getLineFromString(item->source->getText(), line);
+            if (unicode::isValidUtf8(sourceLine))
+                format << utils::trim(sourceLine);
             format << "\n";
         }
         return format.str();
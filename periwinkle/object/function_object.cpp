@@ -12,35 +12,56 @@
 
 using namespace vm;
 
-static Frame* frameFromFunctionObject(FunctionObject* fn)
+void vm::initFunctionFrame(Frame* frame, FunctionObject* fn)
 {
-    auto currentFrame = VirtualMachine::currentVm->getFrame();
-    auto newFrame = new Frame;
-    newFrame->previous = currentFrame;
-    newFrame->codeObject = fn->code;
-    newFrame->globals = currentFrame->globals;
-    newFrame->bp = currentFrame->sp - fn->code->arity - (int)fn->code->isVariadic;
-    newFrame->freevars = newFrame->bp + fn->code->locals.size();
-    newFrame->sp = newFrame->freevars + fn->code->cells.size() + fn->code->freevars.size();
+    const auto& layout = fn->code->frameLayout;
+    frame->codeObject = fn->code;
+    frame->freevars = frame->bp + layout.localCount;
+    frame->sp = frame->freevars + layout.cellCount + layout.freevarCount - 1;
+
+    // Локальні змінні, крім аргументів, ще не визначені. В цих слотах може
+    // залишитись вміст стеку від попередніх викликів
+    std::memset(frame->bp + layout.argumentSlots, 0,
+        (layout.localCount - layout.argumentSlots) * sizeof(Object*));
 
-    for (size_t i = 0; i < fn->code->cells.size() + fn->code->freevars.size(); ++i)
+    // Комірки-аргументи отримують значення аргументу, решта комірок порожні
+    for (WORD i = 0; i < layout.cellCount; ++i)
     {
-        newFrame->freevars[i] = CellObject::create(nullptr);
+        frame->freevars[i] = CellObject::create(nullptr);
     }
-
-    for (size_t i = 0; i < fn->code->argsAsCells.size(); ++i)
+    for (auto [cellIndex, localIndex] : layout.argumentCells)
     {
-        auto idx = std::find(fn->code->locals.begin(), fn->code->locals.end(),
-            fn->code->argsAsCells[i]);
-        auto cell = (CellObject*)newFrame->freevars[i];
-        auto object = newFrame->bp[idx - fn->code->locals.begin()];
-        cell->value = object;
+        static_cast<CellObject*>(frame->freevars[cellIndex])->value = frame->bp[localIndex];
     }
 
-    for (size_t i = 0; i < fn->code->freevars.size(); ++i)
+    std::copy(fn->closure.begin(), fn->closure.end(), frame->freevars + layout.cellCount);
+}
+
+bool vm::compileDeferredFunction(FunctionObject* fn)
+{
+    // Кілька функцій можуть бути створені з одного CodeObject, тіло компілюється один раз
+    if (fn->code->deferredBody != nullptr)
+    {
+        compiler::compileDeferredBody(fn->code);
+    }
+    if (fn->code->imageBody != nullptr && !compiler::loadImageBody(fn->code))
     {
-        newFrame->freevars[fn->code->cells.size() + i] = fn->closure[i];
+        return false;
     }
+    fn->callableInfo.frameSize = fn->code->frameSize();
+    fn->callableInfo.flags &= ~CallableInfo::IS_DEFERRED;
+    return true;
+}
+
+static Frame* frameFromFunctionObject(FunctionObject* fn)
+{
+    auto currentFrame = VirtualMachine::currentVm->getFrame();
+    auto newFrame = new Frame;
+    newFrame->previous = currentFrame;
+    newFrame->globals = currentFrame->globals;
+    newFrame->stackEnd = currentFrame->stackEnd;
+    newFrame->bp = currentFrame->sp - fn->code->frameLayout.argumentSlots + 1;
+    initFunctionFrame(newFrame, fn);
     return newFrame;
 }
 
@@ -59,10 +80,20 @@ static Object* fnCall(FunctionObject* fn, std::span<Object*> args, TupleObject*
 {
     auto vm = VirtualMachine::currentVm;
     auto& sp = vm->getFrame()->sp;
+    if ((fn->callableInfo.flags & CallableInfo::IS_DEFERRED) && !compileDeferredFunction(fn))
+    {
+        return nullptr;
+    }
+    if (!checkStackSpace(sp + 1, fn->callableInfo.frameSize))
+    {
+        return nullptr;
+    }
+    // Слот викликаної функції, як при виклику з байткоду
+    *(++sp) = fn;
     if (args.size() > 0)
     {
-        std::memcpy(++sp, args.data(), args.size() * sizeof(Object*));
-        sp += args.size() - 1;
+        std::memcpy(sp + 1, args.data(), args.size() * sizeof(Object*));
+        sp += args.size();
     }
     if (fn->callableInfo.flags & CallableInfo::IS_VARIADIC)
     {
@@ -100,7 +131,8 @@ static Object* fnCall(FunctionObject* fn, std::span<Object*> args, TupleObject*
 
     Object* result = _call(fn);
     sp -= fn->callableInfo.arity
-        + (fn->callableInfo.flags & CallableInfo::IS_VARIADIC);
+        + (fn->callableInfo.flags & CallableInfo::IS_VARIADIC)
+        + 1; // викликана функція
     return result;
 }
 
@@ -152,5 +184,7 @@ FunctionObject* vm::FunctionObject::create(CodeObject* code)
     functionObject->callableInfo.flags |= code->isVariadic ? CallableInfo::IS_VARIADIC : 0;
     functionObject->callableInfo.flags |= code->defaults.size() ? CallableInfo::HAS_DEFAULTS : 0;
     functionObject->callableInfo.name = code->name;
+    functionObject->callableInfo.frameSize = code->frameSize();
+    functionObject->callableInfo.flags |= code->deferredBody || code->imageBody ? CallableInfo::IS_DEFERRED : 0;
     return functionObject;
 }
@@ -124,6 +124,11 @@ static void listTraverse(ListObject* list)
     }
 }
 
+static u64 listPayloadSize(ListObject* list)
+{
+    return list->items.capacity() * sizeof(ObjectRef);
+}
+
 static Object* listToString(Object* o)
 {
     auto listObject = (ListObject*)o;
@@ -134,7 +139,7 @@ static Object* listToString(Object* o)
     {
         if ((*it)->objectType == &stringObjectType)
         {
-            str << "\"" << utils::escapeString(((StringObject*)*it)->asUtf8()) << "\"";
+            str << "\"" << utils::escapeString(((StringObject*)it->get())->asUtf8()) << "\"";
         }
         else
         {
@@ -439,7 +444,7 @@ METHOD_TEMPLATE(listSlice)
     CHECK_INDEX(start->value, o);
 
     i64 maxCount = std::min(count->value, static_cast<i64>(o->items.size() - start->value));
-    slice->items = std::vector<Object*>{
+    slice->items = std::vector<ObjectRef>{
         o->items.begin() + start->value,
         o->items.begin() + start->value + maxCount
     };
@@ -473,9 +478,10 @@ METHOD_TEMPLATE(listSort)
         transformedItems.reserve(o->items.size());
         for (auto it = o->items.begin(); it != o->items.end(); ++it)
         {
-            auto key = keyFunction->call({it, 1});
+            Object* item = *it;
+            auto key = keyFunction->call({&item, 1});
             if (key == nullptr) return nullptr;
-            transformedItems.emplace_back(key, *it);
+            transformedItems.emplace_back(key, item);
         }
 
         try
@@ -654,6 +660,7 @@ namespace vm
         },
         .comparison = listComparison,
         .traverse = (traverseFunction)listTraverse,
+        .payloadSize = (sizeFunction)listPayloadSize,
         .attributes =
         {
             METHOD_ATTRIBUTE(listRemove),
@@ -682,6 +689,7 @@ namespace vm
         .name = "ІтераторСписку",
         .size = sizeof(ListIterObject),
         .alloc = DEFAULT_ALLOC(ListIterObject),
+        .dealloc = DEFAULT_DEALLOC(ListIterObject),
         .traverse = (traverseFunction)listIterTraverse,
         .attributes =
         {
@@ -696,7 +704,7 @@ ListObject* vm::ListObject::create()
     return listObject;
 }
 
-ListIterObject* vm::ListIterObject::create(const std::vector<Object*> iterable)
+ListIterObject* vm::ListIterObject::create(const std::vector<ObjectRef> iterable)
 {
     auto listIterObject = (ListIterObject*)allocObject(&listIterObjectType);
     listIterObject->iterable = iterable;
@@ -7,6 +7,7 @@
 #include "object.hpp"
 #include "bool_object.hpp"
 #include "exception_object.hpp"
+#include "function_object.hpp"
 #include "vm.hpp"
 #include "utils.hpp"
 #include "string_object.hpp"
@@ -18,6 +19,7 @@
 #include "periwinkle.hpp"
 #include "keyword.hpp"
 #include "plogger.hpp"
+#include "mark_stack.hpp"
 
 using namespace vm;
 
@@ -71,15 +73,24 @@ namespace vm
 
 void vm::mark(Object* o)
 {
-    if (o == nullptr || o->marked)
+    if (o == nullptr)
     {
         return;
     }
-    o->marked = true;
-    if (auto traverse = o->objectType->traverse)
+    if (auto stack = MarkStack::current)
     {
-        traverse(o);
+        stack->push(o);
+        return;
     }
+    // Виклик поза збиранням сміття
+    MarkStack stack;
+    stack.push(o);
+    stack.drain();
+}
+
+void* vm::allocObjectMemory(size_t size)
+{
+    return getCurrentState()->getGC()->allocateMemory(size);
 }
 
 Object* vm::allocObject(TypeObject* objectType)
@@ -408,64 +419,80 @@ Object* vm::Object::call(std::span<Object*> argv, NamedArgs* na)
     return _callObject(this, argv, na);
 }
 
-Object* vm::Object::stackCall(Object**& sp, u64 argc, NamedArgs* na)
+bool vm::Object::prepareStackCall(Object**& sp, u64 argc, NamedArgs* na)
 {
-    Object* result;
     auto callableInfo = GET_CALLABLE_INFO(this);
-    auto stackCallOp = GET_OPERATOR(this, stackCall);
-    if (stackCallOp != nullptr)
-    {
-        if (!validateCall(this, argc, na))
-            return nullptr;
+    if (!validateCall(this, argc, na))
+        return false;
+    // Прапорець встановлюється лише для FunctionObject
+    if ((callableInfo->flags & CallableInfo::IS_DEFERRED)
+        && !compileDeferredFunction(static_cast<FunctionObject*>(this)))
+        return false;
+    // Фрейм починається зі слота викликаного об'єкта. Перевірка виконується до
+    // додавання в стек варіативного аргументу та значень за замовчуванням
+    if (!checkStackSpace(sp - argc, callableInfo->frameSize))
+        return false;
 
-        auto defaultCount = callableInfo->flags & CallableInfo::HAS_DEFAULTS ?
-            callableInfo->defaults->parameters.size() : 0;
+    auto defaultCount = callableInfo->flags & CallableInfo::HAS_DEFAULTS ?
+        callableInfo->defaults->parameters.size() : 0;
 
-        // Варіативний аргумент
-        if (callableInfo->flags & CallableInfo::IS_VARIADIC)
+    // Варіативний аргумент
+    if (callableInfo->flags & CallableInfo::IS_VARIADIC)
+    {
+        auto va = &P_emptyTuple;
+        if (auto variadicCount = argc - (callableInfo->arity - defaultCount); variadicCount > 0)
         {
-            auto va = &P_emptyTuple;
-            if (auto variadicCount = argc - (callableInfo->arity - defaultCount); variadicCount > 0)
-            {
-                va = TupleObject::create();
-                va->items.reserve(variadicCount);
-                va->items.insert(va->items.end(), sp - variadicCount + 1, sp + 1);
-                va->items.shrink_to_fit();
-                argc -= variadicCount;
-                sp -= variadicCount;
-            }
-            *(++sp) = va;
+            va = TupleObject::create();
+            va->items.reserve(variadicCount);
+            va->items.insert(va->items.end(), sp - variadicCount + 1, sp + 1);
+            va->items.shrink_to_fit();
+            argc -= variadicCount;
+            sp -= variadicCount;
         }
+        *(++sp) = va;
+    }
 
-        if (defaultCount)
+    if (defaultCount)
+    {
+        if (na != nullptr)
         {
-            if (na != nullptr)
+            for (size_t i = 0, j = na->count; i < defaultCount; ++i)
             {
-                for (size_t i = 0, j = na->count; i < defaultCount; ++i)
+                if (j)
                 {
-                    if (j)
+                    auto it = std::find(na->indexes.begin(), na->indexes.end(), i);
+                    if (it != na->indexes.end())
                     {
-                        auto it = std::find(na->indexes.begin(), na->indexes.end(), i);
-                        if (it != na->indexes.end())
-                        {
-                            auto index = it - na->indexes.begin();
-                            *(++sp) = na->values[na->count - index - 1];
-                            j--;
-                            continue;
-                        }
+                        auto index = it - na->indexes.begin();
+                        *(++sp) = na->values[na->count - index - 1];
+                        j--;
+                        continue;
                     }
-                    *(++sp) = callableInfo->defaults->parameters[defaultCount - i - 1].second;
                 }
-            }
-            else
-            {
-                for (size_t i = 0, argLack = callableInfo->arity - argc; i < argLack; ++i)
-                    *(++sp) = callableInfo->defaults->parameters[argLack - i - 1].second;
+                *(++sp) = callableInfo->defaults->parameters[defaultCount - i - 1].second;
             }
         }
+        else
+        {
+            for (size_t i = 0, argLack = callableInfo->arity - argc; i < argLack; ++i)
+                *(++sp) = callableInfo->defaults->parameters[argLack - i - 1].second;
+        }
+    }
+    return true;
+}
+
+Object* vm::Object::stackCall(Object**& sp, u64 argc, NamedArgs* na)
+{
+    Object* result;
+    auto callableInfo = GET_CALLABLE_INFO(this);
+    auto stackCallOp = GET_OPERATOR(this, stackCall);
+    if (stackCallOp != nullptr)
+    {
+        if (!prepareStackCall(sp, argc, na))
+            return nullptr;
         result = stackCallOp(this, sp);
-        // Очищення стека
-        sp -= argc // аргументи
+        // Очищення стека. Разом з аргументами знімаються додані значення за замовчуванням
+        sp -= callableInfo->arity // аргументи
             + (callableInfo->flags & CallableInfo::IS_VARIADIC) // варіативний параметр
             + 1; // викликаний об'єкт
     }
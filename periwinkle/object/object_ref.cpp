@@ -0,0 +1,25 @@
+#include "object_ref.hpp"
+#include "object.hpp"
+
+using namespace vm;
+
+#ifdef COMPRESSED_REFERENCES
+
+std::byte* vm::compressed::heapBase = nullptr;
+std::vector<Object*> vm::compressed::externalObjects = { nullptr };
+
+u32 vm::compressed::encodeExternal(Object* o)
+{
+    if (o == nullptr)
+    {
+        return 1;
+    }
+    if (o->externalIndex == 0)
+    {
+        o->externalIndex = static_cast<u32>(externalObjects.size());
+        externalObjects.push_back(o);
+    }
+    return (o->externalIndex << 1) | 1;
+}
+
+#endif
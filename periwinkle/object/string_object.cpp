@@ -130,6 +130,11 @@ static Object* strToReal(StringObject* o)
     return RealObject::create(value);
 }
 
+static u64 strPayloadSize(StringObject* o)
+{
+    return o->value.capacity() * sizeof(char32_t);
+}
+
 static Object* strToBool(StringObject* o)
 {
     return P_BOOL(o->value.size());
@@ -781,6 +786,7 @@ namespace vm
             .getIter = (unaryFunction)strGetIter,
         },
         .comparison = strComparison,
+        .payloadSize = (sizeFunction)strPayloadSize,
         .attributes =
         {
             METHOD_ATTRIBUTE(removeEnd),
@@ -821,6 +827,7 @@ namespace vm
         .name = "ІтераторРядка",
         .size = sizeof(StringIterObject),
         .alloc = DEFAULT_ALLOC(StringIterObject),
+        .dealloc = DEFAULT_DEALLOC(StringIterObject),
         .attributes =
         {
             METHOD_ATTRIBUTE(strIterNext),
@@ -115,6 +115,11 @@ static void tupleTraverse(TupleObject* tuple)
     }
 }
 
+static u64 tuplePayloadSize(TupleObject* tuple)
+{
+    return tuple->items.capacity() * sizeof(ObjectRef);
+}
+
 static Object* tupleToString(Object* o)
 {
     auto tupleObject = static_cast<TupleObject*>(o);
@@ -125,7 +130,7 @@ static Object* tupleToString(Object* o)
     {
         if ((*it)->objectType == &stringObjectType)
         {
-            str << "\"" << utils::escapeString((static_cast<StringObject*>(*it))->asUtf8()) << "\"";
+            str << "\"" << utils::escapeString((static_cast<StringObject*>(it->get()))->asUtf8()) << "\"";
         }
         else
         {
@@ -281,7 +286,7 @@ METHOD_TEMPLATE(tupleSlice)
 
     i64 maxCount = std::min(count->value, static_cast<i64>(o->items.size() - start->value));
     auto slice = TupleObject::create();
-    slice->items = std::vector<Object*>{
+    slice->items = std::vector<ObjectRef>{
         o->items.begin() + start->value,
         o->items.begin() + start->value + maxCount
     };
@@ -335,6 +340,7 @@ namespace vm
         },
         .comparison = tupleComparison,
         .traverse = (traverseFunction)tupleTraverse,
+        .payloadSize = (sizeFunction)tuplePayloadSize,
         .attributes =
         {
             METHOD_ATTRIBUTE(tupleSize),
@@ -354,6 +360,7 @@ namespace vm
         .name = "ІтераторКортежу",
         .size = sizeof(TupleIterObject),
         .alloc = DEFAULT_ALLOC(TupleIterObject),
+        .dealloc = DEFAULT_DEALLOC(TupleIterObject),
         .traverse = (traverseFunction)tupleIterTraverse,
         .attributes =
         {
@@ -0,0 +1,297 @@
+#include <array>
+
+#include "lexer.hpp"
+
+using namespace parser;
+
+namespace
+{
+    struct KeywordEntry
+    {
+        std::string_view word;
+        TokenKind kind;
+    };
+
+    constexpr std::array<KeywordEntry, 22> keywords =
+    {{
+        {"якщо", TokenKind::K_IF}, {"або", TokenKind::K_OR}, {"інакше", TokenKind::K_ELSE},
+        {"кінець", TokenKind::K_END}, {"поки", TokenKind::K_WHILE},
+        {"пропустити", TokenKind::K_CONTINUE}, {"завершити", TokenKind::K_BREAK},
+        {"менше", TokenKind::K_LESS}, {"більше", TokenKind::K_GREATER},
+        {"рівно", TokenKind::K_EQUAL}, {"нерівно", TokenKind::K_NOT_EQUAL},
+        {"є", TokenKind::K_IS}, {"не", TokenKind::K_NOT}, {"та", TokenKind::K_AND},
+        {"функція", TokenKind::K_FUNCTION}, {"повернути", TokenKind::K_RETURN},
+        {"обійти", TokenKind::K_FOR_EACH}, {"спробувати", TokenKind::K_TRY},
+        {"обробити", TokenKind::K_CATCH}, {"як", TokenKind::K_AS},
+        {"наприкінці", TokenKind::K_FINALLY}, {"жбурнути", TokenKind::K_RAISE},
+    }};
+
+    constexpr size_t KEYWORD_TABLE_SIZE = 64;
+
+    // Всі ключові слова записані кирилицею, тому мають щонайменше 2 байти.
+    // Множники підібрані так, щоб хеші ключових слів не перетинались.
+    constexpr size_t keywordHash(std::string_view word)
+    {
+        return (word.size()
+            + static_cast<u8>(word[1]) * 3
+            + static_cast<u8>(word.back()) * 9) & (KEYWORD_TABLE_SIZE - 1);
+    }
+
+    constexpr auto makeKeywordTable()
+    {
+        std::array<KeywordEntry, KEYWORD_TABLE_SIZE> table{};
+        for (auto& entry : keywords)
+        {
+            auto& slot = table[keywordHash(entry.word)];
+            // Колізія зробить вираз неконстантним, і компіляція завершиться помилкою
+            if (!slot.word.empty()) throw "Колізія в таблиці ключових слів";
+            slot = entry;
+        }
+        return table;
+    }
+
+    constexpr auto keywordTable = makeKeywordTable();
+
+    constexpr size_t MAX_KEYWORD_SIZE = 20; // "пропустити" та "спробувати" в байтах
+
+    // Декодує символ UTF-8, в len записується його довжина в байтах
+    inline char32_t decode(std::string_view text, size_t position, size_t& len)
+    {
+        auto c = static_cast<u8>(text[position]);
+        if (c < 0x80)
+        {
+            len = 1;
+            return c;
+        }
+        if ((c & 0xE0) == 0xC0 && position + 1 < text.size())
+        {
+            len = 2;
+            return ((c & 0x1F) << 6) | (static_cast<u8>(text[position + 1]) & 0x3F);
+        }
+        // Довші послідовності не можуть бути частиною імені
+        len = 1;
+        return 0xFFFD;
+    }
+
+    // [а-щА-ЩьюяїієґЬЮЯЇІЄҐ_]
+    inline bool isIdentifierStart(char32_t c)
+    {
+        return (c >= U'а' && c <= U'щ') || (c >= U'А' && c <= U'Щ')
+            || c == U'ь' || c == U'ю' || c == U'я' || c == U'ї' || c == U'і' || c == U'є' || c == U'ґ'
+            || c == U'Ь' || c == U'Ю' || c == U'Я' || c == U'Ї' || c == U'І' || c == U'Є' || c == U'Ґ'
+            || c == U'_';
+    }
+
+    inline bool isIdentifierContinue(char32_t c)
+    {
+        return isIdentifierStart(c) || (c >= U'0' && c <= U'9') || c == U'\'';
+    }
+
+    inline bool isDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+}
+
+TokenKind parser::keywordKind(std::string_view word)
+{
+    if (word.size() < 2 || word.size() > MAX_KEYWORD_SIZE)
+        return TokenKind::IDENTIFIER;
+    const auto& entry = keywordTable[keywordHash(word)];
+    return entry.word == word ? entry.kind : TokenKind::IDENTIFIER;
+}
+
+bool parser::Lexer::skipTrivia()
+{
+    auto start = position;
+    while (position < text.size())
+    {
+        char c = text[position];
+        if (c == '\n')
+        {
+            position++;
+            lineno++;
+            lineStart = position;
+        }
+        else if (c == ' ' || c == '\t' || c == '\r')
+        {
+            position++;
+        }
+        else if (c == '!')
+        {
+            // Коментар триває до кінця рядка
+            while (position < text.size() && text[position] != '\n')
+                position++;
+        }
+        else
+        {
+            break;
+        }
+    }
+    return position != start;
+}
+
+void parser::Lexer::skipPrologue()
+{
+    if (text.starts_with("\xEF\xBB\xBF"))
+        position += 3;
+
+    if (text.substr(position).starts_with("#!"))
+    {
+        while (position < text.size() && text[position] != '\n')
+            position++;
+    }
+}
+
+void parser::Lexer::lexWord(LexToken& token)
+{
+    size_t len;
+    while (position < text.size() && isIdentifierContinue(decode(text, position, len)))
+    {
+        position += len;
+    }
+    token.kind = keywordKind(text.substr(token.start, position - token.start));
+}
+
+void parser::Lexer::lexNumber(LexToken& token)
+{
+    // Ціла частина: "0" або [1-9][0-9]*, дробова частина може бути пустою ("5.")
+    token.kind = TokenKind::INTEGER;
+    if (text[position] == '0')
+    {
+        position++;
+    }
+    else
+    {
+        while (position < text.size() && isDigit(text[position]))
+            position++;
+    }
+
+    if (position < text.size() && text[position] == '.'
+        && !text.substr(position).starts_with("..."))
+    {
+        token.kind = TokenKind::REAL;
+        position++;
+        while (position < text.size() && isDigit(text[position]))
+            position++;
+    }
+}
+
+void parser::Lexer::lexString(LexToken& token)
+{
+    position++; // "
+    while (position < text.size())
+    {
+        char c = text[position];
+        if (c == '\\' && position + 1 < text.size() && text[position + 1] == '"')
+        {
+            position += 2;
+            continue;
+        }
+        if (c == '\n')
+        {
+            lineno++;
+            lineStart = position + 1;
+        }
+        position++;
+        if (c == '"')
+        {
+            token.kind = TokenKind::STRING;
+            return;
+        }
+    }
+    token.kind = TokenKind::ERROR; // Рядок не завершений
+}
+
+void parser::Lexer::lexPunctuation(LexToken& token)
+{
+    using enum TokenKind;
+    auto rest = text.substr(position);
+    auto take = [&](size_t len, TokenKind kind)
+    {
+        position += len;
+        token.kind = kind;
+    };
+    bool withEqual = rest.size() > 1 && rest[1] == '=';
+
+    switch (rest[0])
+    {
+    case '(': take(1, LPAREN); break;
+    case ')': take(1, RPAREN); break;
+    case ',': take(1, COMMA); break;
+    case ';': take(1, SEMICOLON); break;
+    case '=': take(1, EQUAL); break;
+    case '\'': take(1, APOSTROPHE); break;
+    case '+': withEqual ? take(2, PLUS_EQUAL) : take(1, PLUS); break;
+    case '-': withEqual ? take(2, MINUS_EQUAL) : take(1, MINUS); break;
+    case '*': withEqual ? take(2, STAR_EQUAL) : take(1, STAR); break;
+    case '%': withEqual ? take(2, PERCENT_EQUAL) : take(1, PERCENT); break;
+    case '/':
+        if (rest.starts_with("//=")) take(3, SLASH_SLASH_EQUAL);
+        else if (rest.starts_with("//")) take(2, SLASH_SLASH);
+        else withEqual ? take(2, SLASH_EQUAL) : take(1, SLASH);
+        break;
+    case '.':
+        rest.starts_with("...") ? take(3, ELLIPSIS) : take(1, DOT);
+        break;
+    default:
+        take(1, ERROR);
+    }
+}
+
+LexToken parser::Lexer::next()
+{
+    LexToken token{};
+    token.spaceBefore = skipTrivia();
+    token.start = static_cast<u32>(position);
+    token.lineno = lineno;
+    token.col = static_cast<u32>(position - lineStart + 1);
+
+    if (position >= text.size())
+    {
+        token.kind = TokenKind::END;
+        token.end = token.start;
+        return token;
+    }
+
+    size_t len;
+    char c = text[position];
+    if (isDigit(c) || (c == '.' && position + 1 < text.size() && isDigit(text[position + 1])))
+        lexNumber(token);
+    else if (c == '"')
+        lexString(token);
+    else if (isIdentifierStart(decode(text, position, len)))
+        lexWord(token);
+    else
+        lexPunctuation(token);
+
+    token.end = static_cast<u32>(position);
+    return token;
+}
+
+std::vector<LexToken> parser::Lexer::tokenize()
+{
+    std::vector<LexToken> tokens;
+    // Середня довжина токена в програмах близько 4 байтів
+    tokens.reserve(text.size() / 4 + 1);
+    skipPrologue();
+    for (;;)
+    {
+        tokens.push_back(next());
+        if (tokens.back().kind == TokenKind::END || tokens.back().kind == TokenKind::ERROR)
+            break;
+    }
+    if (tokens.back().kind == TokenKind::ERROR)
+    {
+        // Парсер зупиниться на помилковому токені, тому після нього додається кінець
+        auto end = tokens.back();
+        end.kind = TokenKind::END;
+        end.start = end.end;
+        tokens.push_back(end);
+    }
+    return tokens;
+}
+
+parser::Lexer::Lexer(std::string_view text) : text(text)
+{
+}
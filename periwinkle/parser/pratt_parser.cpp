@@ -0,0 +1,645 @@
+#include <stdexcept>
+
+#include "pratt_parser.hpp"
+
+using namespace parser;
+
+namespace
+{
+    // Розбір поточної конструкції не вдався, але інша альтернатива ще може підійти
+    struct ParseFailure {};
+    // Помилку вже повідомлено, розбір припиняється
+    struct ParseAbort {};
+
+    inline bool isAssignmentOperator(TokenKind kind)
+    {
+        using enum TokenKind;
+        return kind == EQUAL || kind == PLUS_EQUAL || kind == MINUS_EQUAL || kind == STAR_EQUAL
+            || kind == SLASH_EQUAL || kind == SLASH_SLASH_EQUAL || kind == PERCENT_EQUAL;
+    }
+
+    inline bool isBlockEnd(TokenKind kind)
+    {
+        using enum TokenKind;
+        return kind == END || kind == K_END || kind == K_OR || kind == K_ELSE
+            || kind == K_CATCH || kind == K_FINALLY;
+    }
+}
+
+const LexToken& parser::PrattParser::peek(size_t offset) const
+{
+    auto index = current + offset;
+    // Останній токен завжди END
+    return index < tokens.size() ? tokens[index] : tokens.back();
+}
+
+const LexToken& parser::PrattParser::advance()
+{
+    auto& token = peek();
+    if (current < tokens.size() - 1)
+        current++;
+    return token;
+}
+
+bool parser::PrattParser::check(TokenKind kind) const
+{
+    return peek().kind == kind;
+}
+
+bool parser::PrattParser::match(TokenKind kind)
+{
+    if (!check(kind))
+        return false;
+    advance();
+    return true;
+}
+
+const LexToken& parser::PrattParser::expect(TokenKind kind)
+{
+    if (!check(kind))
+        fail();
+    return advance();
+}
+
+void parser::PrattParser::expectSpace()
+{
+    if (!peek().spaceBefore)
+        fail();
+}
+
+bool parser::PrattParser::separatedBySingleSpace(const LexToken& a, const LexToken& b) const
+{
+    return b.start == a.end + 1 && text[a.end] == ' ';
+}
+
+std::string_view parser::PrattParser::tokenText(const LexToken& token) const
+{
+    return text.substr(token.start, token.end - token.start);
+}
+
+ast::Token parser::PrattParser::makeToken(const LexToken& token) const
+{
+    return ast::Token{token.lineno, token.col, tokenText(token)};
+}
+
+ast::Token parser::PrattParser::makeToken(std::string_view text, const LexToken& token) const
+{
+    return ast::Token{token.lineno, token.col, text};
+}
+
+ast::Token parser::PrattParser::expectIdentifier()
+{
+    if (check(TokenKind::APOSTROPHE))
+        error("Ім'я не може починатись апострофом", peek().start);
+    return makeToken(expect(TokenKind::IDENTIFIER));
+}
+
+void parser::PrattParser::fail()
+{
+    furthestFailure = std::max(furthestFailure, static_cast<size_t>(peek().start));
+    throw ParseFailure{};
+}
+
+void parser::PrattParser::error(const std::string& message, size_t position)
+{
+    if (errorHandler)
+        errorHandler(message, position);
+    throw ParseAbort{};
+}
+
+ast::BlockStatement* parser::PrattParser::parseProgram()
+{
+    ast::ArenaVector<ast::Statement*> statements;
+    while (!check(TokenKind::END))
+    {
+        statements.push_back(parseStatement());
+    }
+    return new ast::BlockStatement(statements);
+}
+
+ast::BlockStatement* parser::PrattParser::parseBlock()
+{
+    ast::ArenaVector<ast::Statement*> statements;
+    while (!isBlockEnd(peek().kind))
+    {
+        auto saved = current;
+        try
+        {
+            statements.push_back(parseStatement());
+        }
+        catch (const ParseFailure&)
+        {
+            // Блок закінчується на першій інструкції, яку не вдалось розібрати,
+            // далі її місце повинно зайняти ключове слово, що закриває блок
+            current = saved;
+            break;
+        }
+    }
+    return new ast::BlockStatement(statements);
+}
+
+ast::Statement* parser::PrattParser::parseStatement()
+{
+    using enum TokenKind;
+    switch (peek().kind)
+    {
+    case K_IF:
+        return parseIfStatement();
+    case K_WHILE:
+        return parseWhileStatement();
+    case K_FOR_EACH:
+        return parseForEachStatement();
+    case K_BREAK:
+        return new ast::BreakStatement(makeToken(advance()));
+    case K_CONTINUE:
+        return new ast::ContinueStatement(makeToken(advance()));
+    case K_RETURN:
+        return parseReturnStatement();
+    case K_FUNCTION:
+        return parseFunctionDeclaration();
+    case K_TRY:
+        return parseTryCatchStatement();
+    case K_RAISE:
+        return parseRaiseStatement();
+    default:
+        return new ast::ExpressionStatement(parseExpression());
+    }
+}
+
+ast::IfStatement* parser::PrattParser::parseIfStatement()
+{
+    auto statement = parseIfChain();
+    expect(TokenKind::K_END);
+    return statement;
+}
+
+ast::IfStatement* parser::PrattParser::parseIfChain()
+{
+    auto& if_ = advance();
+    expectSpace();
+    auto condition = parseRhs();
+    auto block = parseBlock();
+
+    std::optional<ast::Statement*> elseOrIf;
+    if (check(TokenKind::K_OR) && peek(1).kind == TokenKind::K_IF
+        && separatedBySingleSpace(peek(), peek(1)))
+    {
+        auto& or_ = advance();
+        auto elseIf = parseIfChain();
+        elseIf->if_ = makeToken("або якщо", or_);
+        elseOrIf = elseIf;
+    }
+    else if (check(TokenKind::K_ELSE))
+    {
+        auto& else_ = advance();
+        expectSpace();
+        elseOrIf = new ast::ElseStatement(makeToken(else_), parseBlock());
+    }
+    return new ast::IfStatement(makeToken(if_), condition, block, elseOrIf);
+}
+
+ast::WhileStatement* parser::PrattParser::parseWhileStatement()
+{
+    auto& while_ = advance();
+    expectSpace();
+    auto condition = parseRhs();
+    auto block = parseBlock();
+    expect(TokenKind::K_END);
+    return new ast::WhileStatement(makeToken(while_), condition, block);
+}
+
+ast::ForEachStatement* parser::PrattParser::parseForEachStatement()
+{
+    auto& forEach = advance();
+    expectSpace();
+    auto expression = parseRhs();
+    expectSpace();
+    expect(TokenKind::K_AS);
+    expectSpace();
+    auto variable = expectIdentifier();
+    auto block = parseBlock();
+    expect(TokenKind::K_END);
+    return new ast::ForEachStatement(makeToken(forEach), variable, expression, block);
+}
+
+ast::ReturnStatement* parser::PrattParser::parseReturnStatement()
+{
+    auto& return_ = advance();
+    std::optional<ast::Expression*> value;
+    if (check(TokenKind::SEMICOLON) && !peek().spaceBefore)
+    {
+        advance();
+    }
+    else
+    {
+        expectSpace();
+        value = parseRhs();
+    }
+    return new ast::ReturnStatement(makeToken(return_), value);
+}
+
+ast::FunctionDeclaration* parser::PrattParser::parseFunctionDeclaration()
+{
+    using enum TokenKind;
+    advance(); // функція
+    expectSpace();
+    auto id = expectIdentifier();
+    expect(LPAREN);
+
+    ast::FunctionDeclaration::parameters_t parameters;
+    ast::FunctionDeclaration::variadicParameter_t variadicParameter;
+    ast::FunctionDeclaration::defaultParameters_t defaultParameters;
+    if (!check(RPAREN))
+    {
+        // Звичайні параметри, далі змінна кількість аргументів, далі параметри за замовчуванням
+        do
+        {
+            if (check(IDENTIFIER) && peek(1).kind == EQUAL)
+            {
+                auto name = makeToken(advance());
+                advance(); // =
+                defaultParameters.emplace_back(name, parseRhs());
+            }
+            else if (defaultParameters.empty() && !variadicParameter
+                && check(IDENTIFIER) && peek(1).kind == ELLIPSIS && !peek(1).spaceBefore)
+            {
+                variadicParameter = makeToken(advance());
+                advance(); // ...
+            }
+            else if (defaultParameters.empty() && !variadicParameter)
+            {
+                parameters.push_back(expectIdentifier());
+            }
+            else
+            {
+                fail();
+            }
+        } while (match(COMMA));
+    }
+    expect(RPAREN);
+
+    auto block = parseBlock();
+    expect(K_END);
+    return new ast::FunctionDeclaration(id, parameters, variadicParameter, defaultParameters, block);
+}
+
+ast::TryCatchStatement* parser::PrattParser::parseTryCatchStatement()
+{
+    using enum TokenKind;
+    auto& try_ = advance();
+    expectSpace();
+    auto block = parseBlock();
+    if (block->statements.empty())
+        error("Блок \"спробувати\" не може бути пустим.", peek().start);
+
+    ast::ArenaVector<ast::CatchBlock*> catchBlocks;
+    while (check(K_CATCH))
+    {
+        auto saved = current;
+        try
+        {
+            auto& catch_ = advance();
+            expectSpace();
+            auto exceptionName = expectIdentifier();
+            expectSpace();
+            auto catchBlock = new ast::CatchBlock{makeToken(catch_), exceptionName};
+            if (check(K_AS))
+            {
+                auto as = makeToken(advance());
+                expectSpace();
+                catchBlock->as = as;
+                catchBlock->variableName = expectIdentifier();
+            }
+            catchBlock->block.reset(parseBlock());
+            catchBlocks.push_back(catchBlock);
+        }
+        catch (const ParseFailure&)
+        {
+            current = saved;
+            break;
+        }
+    }
+    if (catchBlocks.empty())
+        error("В обробнику помилок повинен бути хоча б один блок \"обробити\"", peek().start);
+
+    std::optional<ast::FinallyBlock*> finallyBlock;
+    if (check(K_FINALLY))
+    {
+        auto& finally_ = advance();
+        expectSpace();
+        finallyBlock = new ast::FinallyBlock{
+            makeToken(finally_), std::unique_ptr<ast::BlockStatement>(parseBlock())};
+    }
+    expect(K_END);
+    return new ast::TryCatchStatement(makeToken(try_), block, catchBlocks, finallyBlock);
+}
+
+ast::RaiseStatement* parser::PrattParser::parseRaiseStatement()
+{
+    auto& raise = advance();
+    if (peek().spaceBefore)
+    {
+        auto saved = current;
+        try
+        {
+            return new ast::RaiseStatement(makeToken(raise), parseExpression());
+        }
+        catch (const ParseFailure&)
+        {
+            current = saved;
+        }
+    }
+    error("Після \"жбурнути\" повинний бути вираз", raise.end);
+}
+
+ast::Expression* parser::PrattParser::parseExpression()
+{
+    if (check(TokenKind::IDENTIFIER) && isAssignmentOperator(peek(1).kind))
+    {
+        auto& id = advance();
+        auto& op = advance();
+        // Як і в парсері з граматики, позицією оператора є кінець імені
+        ast::Token assignment{id.lineno, id.col + (id.end - id.start), tokenText(op)};
+        return new ast::AssignmentExpression(makeToken(id), assignment, parseRhs());
+    }
+    return parseRhs();
+}
+
+ast::Expression* parser::PrattParser::parseRhs(Precedence precedence)
+{
+    ast::Expression* left;
+    if (check(TokenKind::K_NOT))
+    {
+        if (precedence >= Precedence::INVERSION)
+            fail();
+        auto& not_ = advance();
+        expectSpace();
+        left = new ast::UnaryExpression(makeToken(not_), parseRhs(Precedence::CONJUNCTION));
+    }
+    else
+    {
+        left = parseFactor();
+    }
+
+    for (;;)
+    {
+        // "або якщо" продовжує умовну інструкцію, а не вираз
+        if (check(TokenKind::K_OR) && peek(1).kind == TokenKind::K_IF)
+            break;
+
+        size_t length;
+        auto op = binaryOperator(length);
+        if (!op || op->first <= precedence)
+            break;
+
+        auto& opToken = peek();
+        // Словесні оператори повинні бути відокремлені пробілами з обох боків
+        if (op->first <= Precedence::COMPARISON
+            && (!opToken.spaceBefore || !peek(length).spaceBefore))
+            break;
+
+        // Якщо правий операнд не розбирається, вираз закінчується перед оператором,
+        // як у граматиці (наприклад, "або" перед "якщо" належить умовній інструкції)
+        auto saved = current;
+        current += length;
+        ast::Expression* right;
+        try
+        {
+            right = parseRhs(op->first);
+        }
+        catch (const ParseFailure&)
+        {
+            current = saved;
+            break;
+        }
+        left = new ast::BinaryExpression(left, makeToken(op->second, opToken), right);
+    }
+    return left;
+}
+
+ast::Expression* parser::PrattParser::parseFactor()
+{
+    using enum TokenKind;
+    if (check(PLUS) || check(MINUS))
+    {
+        auto& sign = advance();
+        // Знак, записаний впритул до числа, є частиною числа
+        if ((check(INTEGER) || check(REAL)) && !peek().spaceBefore)
+            return parseNumber(&sign);
+        return new ast::UnaryExpression(makeToken(sign), parseFactor());
+    }
+    if (check(INTEGER) || check(REAL))
+        return parseNumber(nullptr);
+    return parsePrimary();
+}
+
+ast::Expression* parser::PrattParser::parsePrimary()
+{
+    using enum TokenKind;
+    ast::Expression* expression;
+    auto& token = peek();
+    switch (token.kind)
+    {
+    case IDENTIFIER:
+    {
+        advance();
+        auto name = tokenText(token);
+        if (name == "істина" || name == "хиба")
+            expression = new ast::LiteralExpression(
+                makeToken(name, token), ast::LiteralExpression::Type::BOOLEAN, name == "істина");
+        else if (name == "ніц")
+            expression = new ast::LiteralExpression(
+                makeToken(name, token), ast::LiteralExpression::Type::NULL_, {});
+        else
+            expression = new ast::VariableExpression(makeToken(name, token));
+        break;
+    }
+    case STRING:
+        expression = parseStrings();
+        break;
+    case LPAREN:
+    {
+        advance();
+        // Всередині дужок пробіли біля самих дужок не дозволені
+        if (peek().spaceBefore)
+            fail();
+        auto inner = parseRhs();
+        if (peek().spaceBefore)
+            fail();
+        expect(RPAREN);
+        expression = new ast::ParenthesizedExpression(inner);
+        break;
+    }
+    case APOSTROPHE:
+        error("Ім'я не може починатись апострофом", token.start);
+    default:
+        fail();
+    }
+
+    for (;;)
+    {
+        if (match(DOT))
+            expression = new ast::AttributeExpression(expression, expectIdentifier());
+        else if (check(LPAREN))
+            expression = parseCall(expression);
+        else
+            break;
+    }
+    return expression;
+}
+
+ast::Expression* parser::PrattParser::parseNumber(const LexToken* sign)
+{
+    auto& number = advance();
+    auto& position = sign ? *sign : number;
+    auto numText = text.substr(position.start, number.end - position.start);
+    auto num = std::string(numText);
+    if (number.kind == TokenKind::REAL)
+    {
+        try
+        {
+            return new ast::LiteralExpression(
+                makeToken(numText, position), ast::LiteralExpression::Type::REAL, std::stod(num));
+        }
+        catch (const std::out_of_range&)
+        {
+            error("Число не входить в діапазон можливих значень дійсного числа", number.end);
+        }
+    }
+    try
+    {
+        return new ast::LiteralExpression(
+            makeToken(numText, position), ast::LiteralExpression::Type::NUMBER, std::stoll(num));
+    }
+    catch (const std::out_of_range&)
+    {
+        error("Число не входить в діапазон можливих значень числа", number.end);
+    }
+}
+
+ast::Expression* parser::PrattParser::parseStrings()
+{
+    auto& first = peek();
+    const LexToken* last = &first;
+    ast::LiteralExpression::stringType strings;
+    while (check(TokenKind::STRING))
+    {
+        last = &advance();
+        auto body = text.substr(last->start + 1, last->end - last->start - 2);
+        strings.push_back(new ast::LiteralString{makeToken(*last), body});
+    }
+    auto literal = text.substr(first.start, last->end - first.start);
+    return new ast::LiteralExpression(
+        makeToken(literal, first), ast::LiteralExpression::Type::STRING, strings);
+}
+
+ast::CallExpression* parser::PrattParser::parseCall(ast::Expression* callable)
+{
+    using enum TokenKind;
+    advance(); // (
+    ast::CallExpression::arguments_t arguments;
+    ast::CallExpression::namedArguments_t namedArguments;
+    if (!check(RPAREN))
+    {
+        // Іменовані аргументи можуть йти тільки після позиційних
+        do
+        {
+            if (check(IDENTIFIER) && peek(1).kind == EQUAL)
+            {
+                auto name = makeToken(advance());
+                advance(); // =
+                namedArguments.emplace_back(name, parseRhs());
+            }
+            else if (namedArguments.empty())
+            {
+                arguments.push_back(parseRhs());
+            }
+            else
+            {
+                fail();
+            }
+        } while (match(COMMA));
+    }
+    expect(RPAREN);
+    return new ast::CallExpression(callable, arguments, namedArguments);
+}
+
+std::optional<std::pair<parser::PrattParser::Precedence, std::string_view>>
+parser::PrattParser::binaryOperator(size_t& length) const
+{
+    using enum TokenKind;
+    length = 1;
+    auto& token = peek();
+    switch (token.kind)
+    {
+    case K_OR:
+        return std::pair{Precedence::DISJUNCTION, "або"};
+    case K_AND:
+        return std::pair{Precedence::CONJUNCTION, "та"};
+    case K_IS:
+        return std::pair{Precedence::COMPARISON, "є"};
+    case K_NOT:
+        if (peek(1).kind == K_IS && separatedBySingleSpace(token, peek(1)))
+        {
+            length = 2;
+            return std::pair{Precedence::COMPARISON, "не є"};
+        }
+        return std::nullopt;
+    case K_EQUAL:
+        return std::pair{Precedence::COMPARISON, "рівно"};
+    case K_NOT_EQUAL:
+        return std::pair{Precedence::COMPARISON, "нерівно"};
+    case K_LESS:
+    case K_GREATER:
+    {
+        bool orEqual = peek(1).kind == K_EQUAL && separatedBySingleSpace(token, peek(1));
+        length = orEqual ? 2 : 1;
+        if (token.kind == K_LESS)
+            return std::pair{Precedence::COMPARISON, orEqual ? "менше рівно" : "менше"};
+        return std::pair{Precedence::COMPARISON, orEqual ? "більше рівно" : "більше"};
+    }
+    case PLUS:
+    case MINUS:
+        return std::pair{Precedence::SUM, tokenText(token)};
+    case STAR:
+    case SLASH:
+    case SLASH_SLASH:
+    case PERCENT:
+        return std::pair{Precedence::TERM, tokenText(token)};
+    default:
+        return std::nullopt;
+    }
+}
+
+void parser::PrattParser::setErrorHandler(error_handler_t handler)
+{
+    errorHandler = handler;
+}
+
+std::optional<ast::BlockStatement*> parser::PrattParser::parse()
+{
+    try
+    {
+        auto program = parseProgram();
+        return program;
+    }
+    catch (const ParseFailure&)
+    {
+        if (errorHandler)
+            errorHandler("Неправильний синтаксис.", furthestFailure);
+    }
+    catch (const ParseAbort&)
+    {
+    }
+    return std::nullopt;
+}
+
+parser::PrattParser::PrattParser(std::string_view text)
+    : text(text), tokens(Lexer(text).tokenize())
+{
+    if (tokens.size() > 1 && tokens[tokens.size() - 2].kind == TokenKind::ERROR)
+    {
+        // Помилковий токен не може бути розібраний жодним правилом
+        furthestFailure = tokens[tokens.size() - 2].start;
+    }
+}
@@ -1,21 +1,47 @@
-#include <array>
+#include <algorithm>
+#include <iostream>
+#include <optional>
+#include <vector>
 #include <functional>
 #include <format>
 
 #include "periwinkle.hpp"
 #include "vm.hpp"
+#include "code_object.hpp"
+#ifdef GENERATED_PARSER
 #include "parser.hpp"
+#else
+#include "pratt_parser.hpp"
+#endif
+#include "arena.hpp"
 #include "compiler.hpp"
+#include "bytecode_cache.hpp"
+#include "bytecode_image.hpp"
 #include "utils.hpp"
 #include "pconfig.hpp"
 #include "string_object.hpp"
 #include "plogger.hpp"
 #include "builtins.hpp"
+#include "heap_dump.hpp"
+#include "platform.hpp"
 
 using namespace periwinkle;
 
 static Periwinkle* _currentState = nullptr;
 
+#ifdef GENERATED_PARSER
+using ProgramParser = PParser::Parser;
+#else
+using ProgramParser = parser::PrattParser;
+#endif
+
+// Перший блок арени розрахований на AST, області видимості та стан компілятора програми
+// розміру source, щоб для більшості програм не виділяти наступні блоки
+static size_t arenaSize(ProgramSource* source)
+{
+    return std::max<size_t>(64 * 1024, source->getText().size() * 8);
+}
+
 int periwinkle::Periwinkle::getVersionAsInt()
 {
     return PERIWINKLE_VERSION_MAJOR * 10000 + PERIWINKLE_VERSION_MINOR * 100 + PERIWINKLE_VERSION_PATCH;
@@ -26,27 +52,113 @@ int periwinkle::Periwinkle::majorVersion() { return PERIWINKLE_VERSION_MAJOR; }
 int periwinkle::Periwinkle::minorVersion() { return PERIWINKLE_VERSION_MINOR; }
 int periwinkle::Periwinkle::patchVersion() { return PERIWINKLE_VERSION_PATCH; }
 
-vm::Object* periwinkle::Periwinkle::execute()
+vm::Frame* periwinkle::Periwinkle::compileSource(bool lazy)
 {
-    plog::passert(static_cast<int>(vm::OpCode::COUNT) <= 256) << "Перевищена максимальна кількість опкодів";
     using namespace std::placeholders;
-    PParser::Parser parser(source->getText());
+    // AST і все, що компілятор створює на час компіляції, звільняється разом з ареною.
+    // В режимі лінивої компіляції AST потрібне для тіл функцій, які компілюються під час
+    // виконання, тому арена і компілятор живуть до знищення інтерпретатора
+    auto arena = new ast::Arena(arenaSize(source));
+    ast::ArenaScope arenaScope(arena);
+    ProgramParser parser(source->getText());
     parser.setErrorHandler(std::bind(
         static_cast<void(*)(ProgramSource*, std::string, size_t)>(utils::throwSyntaxError),
             source, _1, _2
         )
     );
-    auto ast = parser.parse();
+    decltype(parser.parse()) ast;
+    {
+        PhaseScope phase(getPhaseTimer(), "розбір");
+        ast = parser.parse();
+    }
     if (!ast.has_value()) { exit(1); }
     auto astValue = ast.value();
-    compiler::Compiler comp(astValue, source);
-    std::array<vm::Object*, 512> stack{};
-    auto frame = comp.compile();
-    delete astValue;
-    frame->sp = &stack[0];
+    auto comp = new compiler::Compiler(astValue, source, lazy ? arena : nullptr);
+    auto frame = comp->compile();
+    if (lazy)
+    {
+        deleteDeferredCompiler();
+        deferredCompiler = comp;
+        deferredArena = arena;
+    }
+    else
+    {
+        delete comp;
+        delete arena;
+    }
+    return frame;
+}
+
+void periwinkle::Periwinkle::deleteDeferredCompiler()
+{
+    // Контейнери компілятора розміщені в арені, тому він знищується першим
+    delete deferredCompiler;
+    delete deferredArena;
+    deferredCompiler = nullptr;
+    deferredArena = nullptr;
+}
+
+vm::Object* periwinkle::Periwinkle::execute()
+{
+    plog::passert(static_cast<int>(vm::OpCode::COUNT) <= 256) << "Перевищена максимальна кількість опкодів";
+    vm::Frame* frame = nullptr;
+    if (image != nullptr)
+    {
+        vm::CodeObject* codeObject;
+        {
+            PhaseScope phase(getPhaseTimer(), "завантаження образу");
+            codeObject = image->load(source);
+        }
+        if (codeObject == nullptr)
+        {
+            setException(&vm::InternalErrorObjectType, "Образ програми пошкоджений");
+            return nullptr;
+        }
+        frame = new vm::Frame;
+        frame->codeObject = codeObject;
+        frame->globals = new vm::Frame::object_map_t;
+    }
+    std::optional<compiler::BytecodeCache> cache;
+    if (frame == nullptr && useBytecodeCache && source->hasFile())
+    {
+        cache.emplace(source, cacheDirectory);
+        vm::CodeObject* codeObject;
+        {
+            PhaseScope phase(getPhaseTimer(), "читання кешу");
+            codeObject = cache->load();
+        }
+        if (codeObject != nullptr)
+        {
+            frame = new vm::Frame;
+            frame->codeObject = codeObject;
+            frame->globals = new vm::Frame::object_map_t;
+        }
+    }
+    if (frame == nullptr)
+    {
+        frame = compileSource(lazyCompilation);
+        // Програма з невідкомпільованими тілами функцій не записується в кеш
+        if (cache && !lazyCompilation)
+        {
+            PhaseScope phase(getPhaseTimer(), "запис кешу");
+            cache->store(frame->codeObject);
+        }
+    }
+    std::vector<vm::Object*> stack(vm::VM_STACK_SIZE);
+    // Слот 0 кореневого фрейму не використовується, як слот функції у фреймах функцій.
+    // Інші локальні слоти створює оптимізатор для значень, винесених з циклів
+    auto localCount = std::max<vm::WORD>(frame->codeObject->frameLayout.localCount, 1);
     frame->bp = &stack[0];
+    frame->sp = frame->bp + localCount - 1;
+    frame->stackEnd = stack.data() + stack.size();
     vm::VirtualMachine virtualMachine(frame);
-    auto result = virtualMachine.execute();
+    vm::Object* result = nullptr;
+    if (vm::checkStackSpace(frame->bp, localCount + frame->codeObject->maxStackDepth))
+    {
+        PhaseScope phase(getPhaseTimer(), "виконання");
+        result = virtualMachine.execute();
+    }
+    vm::VirtualMachine::currentVm = nullptr;
     delete frame;
     return result;
 }
@@ -94,13 +206,61 @@ vm::GC* periwinkle::Periwinkle::getGC()
     return gc;
 }
 
+vm::GCStats periwinkle::Periwinkle::getGCStats() const
+{
+    return gc->getStats();
+}
+
+void periwinkle::Periwinkle::setGCPolicy(const vm::GCPolicy& policy)
+{
+    gc->setPolicy(policy);
+}
+
+vm::GCPolicy periwinkle::Periwinkle::getGCPolicy() const
+{
+    return gc->getPolicy();
+}
+
+bool periwinkle::Periwinkle::dumpHeap(const std::filesystem::path& path)
+{
+    auto vm = vm::VirtualMachine::currentVm;
+    return gc->dumpHeap(vm ? vm->getFrame() : nullptr, path);
+}
+
+void periwinkle::Periwinkle::freezeHeap()
+{
+    auto vm = vm::VirtualMachine::currentVm;
+    gc->freeze(vm ? vm->getFrame() : nullptr);
+}
+
+void periwinkle::Periwinkle::enableArena()
+{
+    gc->enableArena();
+}
+
+void periwinkle::Periwinkle::setBytecodeCache(bool enabled, const std::filesystem::path& directory)
+{
+    useBytecodeCache = enabled;
+    cacheDirectory = directory;
+}
+
+bool periwinkle::Periwinkle::writeImage(const std::filesystem::path& path)
+{
+    auto frame = compileSource(false);
+    bool written = compiler::writeBytecodeImage(frame->codeObject, source, path);
+    delete frame;
+    return written;
+}
+
 #ifdef DEV_TOOLS
 
 #include "disassembler.hpp"
 
 void periwinkle::Periwinkle::printDisassemble()
 {
-    PParser::Parser parser(source->getText());
+    ast::Arena arena(arenaSize(source));
+    ast::ArenaScope arenaScope(&arena);
+    ProgramParser parser(source->getText());
     auto ast = parser.parse();
     if (!ast.has_value()) { exit(1); }
     compiler::Compiler comp(ast.value(), source);
@@ -109,18 +269,48 @@ void periwinkle::Periwinkle::printDisassemble()
 }
 #endif
 
+void periwinkle::Periwinkle::enablePhaseReport(std::function<void(const PhaseReport&)> handler)
+{
+    phaseReportHandler = std::move(handler);
+}
+
+const PhaseReport& periwinkle::Periwinkle::getPhaseReport() const
+{
+    return phaseTimer->getReport();
+}
+
+PhaseTimer* periwinkle::Periwinkle::getPhaseTimer()
+{
+    return phaseReportHandler ? phaseTimer : nullptr;
+}
+
 periwinkle::Periwinkle::Periwinkle(const std::string& code)
     : source(new ProgramSource(code))
 {
     _currentState = this;
     gc = new vm::GC();
+    phaseTimer = new PhaseTimer(gc);
 }
 
 periwinkle::Periwinkle::Periwinkle(const std::filesystem::path& path)
-    : source(new ProgramSource(path))
 {
     _currentState = this;
     gc = new vm::GC();
+    phaseTimer = new PhaseTimer(gc);
+    PhaseScope phase(phaseTimer, "завантаження");
+    if (!compiler::BytecodeImage::isImage(path))
+    {
+        source = new ProgramSource(path);
+        return;
+    }
+    image = compiler::BytecodeImage::open(path);
+    if (image == nullptr)
+    {
+        std::cerr << "Неможливо відкрити образ програми \"" << path.string()
+            << "\", можливо, його записано іншою версією інтерпретатора." << std::endl;
+        exit(1);
+    }
+    source = new ProgramSource(std::string(image->getSourceText()), std::string(image->getSourceName()));
 }
 
 periwinkle::Periwinkle::Periwinkle(const ProgramSource& source)
@@ -128,18 +318,37 @@ periwinkle::Periwinkle::Periwinkle(const ProgramSource& source)
 {
     _currentState = this;
     gc = new vm::GC();
+    phaseTimer = new PhaseTimer(gc);
+}
+
+void periwinkle::Periwinkle::setLazyCompilation(bool enabled)
+{
+    lazyCompilation = enabled;
 }
 
 periwinkle::Periwinkle::~Periwinkle()
 {
+    deleteDeferredCompiler();
     delete source;
-    gc->clean();
+    {
+        PhaseScope phase(getPhaseTimer(), "прибирання купи");
+        gc->clean();
+    }
+    if (phaseReportHandler)
+    {
+        phaseReportHandler(phaseTimer->getReport());
+    }
+    delete phaseTimer;
     delete gc;
+    // Завантажені CodeObject позичають байткод з образу, тому він звільняється після них
+    delete image;
 }
 
 void periwinkle::initialize()
 {
     vm::initBuiltins();
+    // Сигнал SIGUSR1 запитує знімок купи, він буде записаний між інструкціями
+    platform::setUserSignalHandler(vm::requestHeapDump);
 }
 
 void periwinkle::finalize()
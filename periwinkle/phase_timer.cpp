@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <format>
+
+#include "phase_timer.hpp"
+#include "gc.hpp"
+#include "platform.hpp"
+#include "plogger.hpp"
+
+using namespace periwinkle;
+
+std::string periwinkle::PhaseReport::format() const
+{
+    std::string result = std::format("{:<24}{:>12}{:>14}{:>12}{:>14}{:>12}{:>12}\n",
+        "Етап", "Час, мс", "Пік RSS, МБ", "Створено", "Створено, КБ", "Безсмертні", "Живі");
+    u64 totalUs = 0;
+    u64 totalObjects = 0;
+    u64 totalBytes = 0;
+    u64 totalPermanent = 0;
+    u64 peakRss = 0;
+    for (auto& phase : phases)
+    {
+        result += std::format("{:<24}{:>12.3f}{:>14.1f}{:>12}{:>14.1f}{:>12}{:>12}\n",
+            phase.name, phase.durationUs / 1000.0, phase.peakRssBytes / (1024.0 * 1024.0),
+            phase.allocatedObjects, phase.allocatedBytes / 1024.0, phase.permanentObjects,
+            phase.liveObjects);
+        totalUs += phase.durationUs;
+        totalObjects += phase.allocatedObjects;
+        totalBytes += phase.allocatedBytes;
+        totalPermanent += phase.permanentObjects;
+        peakRss = std::max(peakRss, phase.peakRssBytes);
+    }
+    result += std::format("{:<24}{:>12.3f}{:>14.1f}{:>12}{:>14.1f}{:>12}\n",
+        "Всього", totalUs / 1000.0, peakRss / (1024.0 * 1024.0),
+        totalObjects, totalBytes / 1024.0, totalPermanent);
+    return result;
+}
+
+void periwinkle::PhaseTimer::begin(const char* name)
+{
+    plog::passert(!running) << "Етапи запуску не можуть бути вкладеними";
+    auto counters = gc->getCounters();
+    current = PhaseStats{};
+    current.name = name;
+    // Тут зберігаються значення на початку етапу, end замінює їх різницею
+    current.allocatedObjects = counters.allocatedObjects;
+    current.allocatedBytes = counters.allocatedBytes;
+    current.permanentObjects = counters.permanentObjects;
+    running = true;
+    start = std::chrono::steady_clock::now();
+}
+
+void periwinkle::PhaseTimer::end()
+{
+    auto finish = std::chrono::steady_clock::now();
+    plog::passert(running) << "Етап запуску не був початий";
+    auto counters = gc->getCounters();
+    current.durationUs = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+    current.peakRssBytes = platform::peakResidentBytes();
+    current.allocatedObjects = counters.allocatedObjects - current.allocatedObjects;
+    current.allocatedBytes = counters.allocatedBytes - current.allocatedBytes;
+    // Після GC::clean безсмертних об'єктів менше, ніж на початку етапу
+    current.permanentObjects = counters.permanentObjects >= current.permanentObjects ?
+        counters.permanentObjects - current.permanentObjects : 0;
+    current.liveObjects = counters.liveObjects;
+    report.phases.push_back(std::move(current));
+    running = false;
+}
+
+const PhaseReport& periwinkle::PhaseTimer::getReport() const
+{
+    return report;
+}
+
+periwinkle::PhaseTimer::PhaseTimer(vm::GC* gc)
+    : gc(gc)
+{
+}
+
+periwinkle::PhaseScope::PhaseScope(PhaseTimer* timer, const char* name)
+    : timer(timer)
+{
+    if (timer != nullptr)
+    {
+        timer->begin(name);
+    }
+}
+
+periwinkle::PhaseScope::~PhaseScope()
+{
+    if (timer != nullptr)
+    {
+        timer->end();
+    }
+}
@@ -1,4 +1,10 @@
 #include <iostream>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "platform.hpp"
 
@@ -10,3 +16,94 @@ std::string platform::readline()
     std::getline(std::cin, line);
     return line;
 }
+
+int platform::processId()
+{
+    return static_cast<int>(getpid());
+}
+
+size_t platform::peakResidentBytes()
+{
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+    // ru_maxrss в кілобайтах
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+}
+
+static void (*userSignalHandler)() = nullptr;
+
+void platform::setUserSignalHandler(void (*handler)())
+{
+    userSignalHandler = handler;
+    struct sigaction action = {};
+    action.sa_handler = [](int) { userSignalHandler(); };
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, nullptr);
+}
+
+void* platform::reserveMemory(size_t size)
+{
+    // Сторінки без MAP_NORESERVE враховувались би в overcommit одразу при резервуванні.
+    // Доступ дозволений одразу, щоб не розбивати відображення викликами mprotect
+    auto address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return address == MAP_FAILED ? nullptr : address;
+}
+
+bool platform::commitMemory(void* address, size_t size)
+{
+    // Фізична пам'ять виділяється при першому зверненні
+    return true;
+}
+
+void platform::decommitMemory(void* address, size_t size, bool lazy)
+{
+#ifdef MADV_FREE
+    if (lazy && madvise(address, size, MADV_FREE) == 0)
+    {
+        return;
+    }
+#endif
+    madvise(address, size, MADV_DONTNEED);
+}
+
+void platform::releaseMemory(void* address, size_t size)
+{
+    munmap(address, size);
+}
+
+bool platform::adviseHugePages(void* address, size_t size)
+{
+#ifdef MADV_HUGEPAGE
+    return madvise(address, size, MADV_HUGEPAGE) == 0;
+#else
+    return false;
+#endif
+}
+
+const void* platform::mapFile(const std::filesystem::path& path, size_t& size)
+{
+    auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    struct stat status;
+    void* address = MAP_FAILED;
+    if (fstat(fd, &status) == 0 && status.st_size > 0)
+    {
+        size = static_cast<size_t>(status.st_size);
+        address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    // Відображення залишається дійсним після закриття файлу
+    close(fd);
+    return address == MAP_FAILED ? nullptr : address;
+}
+
+void platform::unmapFile(const void* address, size_t size)
+{
+    munmap(const_cast<void*>(address), size);
+}
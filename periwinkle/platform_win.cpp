@@ -1,4 +1,5 @@
 #include <Windows.h>
+#include <psapi.h>
 
 #include "platform.hpp"
 #include "unicode.hpp"
@@ -29,3 +30,86 @@ std::string platform::readline()
 
     return unicode::toUtf8(line);
 }
+
+int platform::processId()
+{
+    return static_cast<int>(GetCurrentProcessId());
+}
+
+size_t platform::peakResidentBytes()
+{
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+}
+
+void platform::setUserSignalHandler(void (*handler)())
+{
+}
+
+void* platform::reserveMemory(size_t size)
+{
+    return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+bool platform::commitMemory(void* address, size_t size)
+{
+    return VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+}
+
+void platform::decommitMemory(void* address, size_t size, bool lazy)
+{
+    if (lazy)
+    {
+        VirtualAlloc(address, size, MEM_RESET, PAGE_READWRITE);
+    }
+    else
+    {
+        VirtualFree(address, size, MEM_DECOMMIT);
+    }
+}
+
+void platform::releaseMemory(void* address, size_t size)
+{
+    VirtualFree(address, 0, MEM_RELEASE);
+}
+
+bool platform::adviseHugePages(void* address, size_t size)
+{
+    // Великі сторінки в Windows потребують привілею SeLockMemoryPrivilege
+    // і виділяються лише разом з резервуванням
+    return false;
+}
+
+const void* platform::mapFile(const std::filesystem::path& path, size_t& size)
+{
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return nullptr;
+    }
+    LARGE_INTEGER fileSize;
+    const void* address = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr)
+        {
+            size = static_cast<size_t>(fileSize.QuadPart);
+            address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            // Відображення залишається дійсним після закриття дескрипторів
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+    return address;
+}
+
+void platform::unmapFile(const void* address, size_t size)
+{
+    UnmapViewOfFile(address);
+}
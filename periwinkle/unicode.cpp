@@ -233,6 +233,27 @@ size_t unicode::utf8Size(std::string_view str)
     return q;
 }
 
+bool unicode::isValidUtf8(std::string_view str)
+{
+    for (size_t i = 0; i < str.length();)
+    {
+        int length = getUtf8CharLen(str[i]);
+        if (length < 0 || str.length() - i < static_cast<size_t>(length))
+        {
+            return false;
+        }
+        for (int j = 1; j < length; ++j)
+        {
+            if ((static_cast<unsigned char>(str[i + j]) & 0xC0) != 0x80)
+            {
+                return false;
+            }
+        }
+        i += length;
+    }
+    return true;
+}
+
 size_t unicode::utf16Size(std::u16string_view str)
 {
     size_t i, q;
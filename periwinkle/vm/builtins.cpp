@@ -1,3 +1,4 @@
+#include <format>
 #include <span>
 #include <numeric>
 
@@ -15,6 +16,7 @@
 #include "argument_parser.hpp"
 #include "unicode.hpp"
 #include "platform.hpp"
+#include "periwinkle.hpp"
 
 #define BUILTIN_FUNCTION_IMPLEMENTATION(func, name, arity, variadic, defaults) \
     static const char* func##__functionName = name;                            \
@@ -41,7 +43,7 @@ static DefaultParameters readLineDefaults = {{ {"підказка", &P_emptyStr}
 static DefaultParameters printDefaults = {{ {"роздільник", &strWithSpace} }};
 
 static std::u32string joinObjectString(
-    const std::u32string& sep, std::span<Object*> objects)
+    const std::u32string& sep, std::span<const ObjectRef> objects)
 {
     if (objects.size())
     {
@@ -107,6 +109,90 @@ BUILTIN_FUNCTION_TEMPLATE(getIteratorNative)
 BUILTIN_FUNCTION_IMPLEMENTATION(getIteratorNative, "ітератор", 1, false, nullptr)
 
 
+static TupleObject* makePair(std::string_view name, Object* value)
+{
+    auto pair = TupleObject::create();
+    pair->items = { StringObject::create(name), value };
+    return pair;
+}
+
+// Повертає список пар (назва, значення), бо словника в мові поки немає
+BUILTIN_FUNCTION_TEMPLATE(gcStatsNative)
+{
+    auto stats = getCurrentState()->getGCStats();
+    auto types = ListObject::create();
+    for (auto& [name, count] : stats.liveObjectsByType)
+    {
+        types->items.push_back(makePair(name, IntObject::create(count)));
+    }
+
+    auto result = ListObject::create();
+    result->items = {
+        makePair("зібрань", IntObject::create(stats.collections)),
+        makePair("загальнаПауза", IntObject::create(stats.totalPauseUs)),
+        makePair("пауза50", IntObject::create(stats.pausePercentileUs(0.5))),
+        makePair("пауза90", IntObject::create(stats.pausePercentileUs(0.9))),
+        makePair("пауза99", IntObject::create(stats.pausePercentileUs(0.99))),
+        makePair("максимальнаПауза", IntObject::create(stats.maxPauseUs)),
+        makePair("виділено", IntObject::create(stats.allocatedBytes)),
+        makePair("звільнено", IntObject::create(stats.reclaimedBytes)),
+        makePair("купа", IntObject::create(stats.heapBytes)),
+        makePair("сторінки", IntObject::create(stats.pageBytes)),
+        makePair("утримано", IntObject::create(stats.retainedBytes)),
+        makePair("поріг", IntObject::create(stats.threshold)),
+        makePair("об'єктів", IntObject::create(stats.liveObjects)),
+        makePair("постійнихОб'єктів", IntObject::create(stats.permanentObjects)),
+        makePair("переповненьСтекуПозначення", IntObject::create(stats.markStackOverflows)),
+        makePair("типи", types),
+    };
+    return result;
+}
+BUILTIN_FUNCTION_IMPLEMENTATION(gcStatsNative, "статистикаПам'яті", 0, false, nullptr)
+
+
+// Аргументи виклику вже зняті зі стеку, тому збирання відкладається до кінця інструкції
+BUILTIN_FUNCTION_TEMPLATE(gcCollectNative)
+{
+    getCurrentState()->getGC()->requestCollection();
+    return &P_null;
+}
+BUILTIN_FUNCTION_IMPLEMENTATION(gcCollectNative, "зібратиСміття", 0, false, nullptr)
+
+
+BUILTIN_FUNCTION_TEMPLATE(heapDumpNative)
+{
+    StringObject* path;
+    ArgParser argParser{
+        {&path, stringObjectType, "шлях"},
+    };
+    if (!argParser.parse(args)) return nullptr;
+    if (!getCurrentState()->dumpHeap(std::filesystem::path(path->asUtf8())))
+    {
+        getCurrentState()->setException(&ValueErrorObjectType,
+            std::format("Не вдалося записати знімок купи у файл \"{}\"", path->asUtf8()));
+        return nullptr;
+    }
+    return &P_null;
+}
+BUILTIN_FUNCTION_IMPLEMENTATION(heapDumpNative, "знімокПам'яті", 1, false, nullptr)
+
+
+BUILTIN_FUNCTION_TEMPLATE(gcDisableNative)
+{
+    getCurrentState()->getGC()->disable();
+    return &P_null;
+}
+BUILTIN_FUNCTION_IMPLEMENTATION(gcDisableNative, "вимкнутиЗбирач", 0, false, nullptr)
+
+
+BUILTIN_FUNCTION_TEMPLATE(gcEnableNative)
+{
+    getCurrentState()->getGC()->enable();
+    return &P_null;
+}
+BUILTIN_FUNCTION_IMPLEMENTATION(gcEnableNative, "увімкнутиЗбирач", 0, false, nullptr)
+
+
 static builtin_t builtin;
 
 void vm::initBuiltins()
@@ -118,6 +204,11 @@ void vm::initBuiltins()
             BUILTIN_FUNCTION(printLnNative),
             BUILTIN_FUNCTION(readLineNative),
             BUILTIN_FUNCTION(getIteratorNative),
+            BUILTIN_FUNCTION(gcStatsNative),
+            BUILTIN_FUNCTION(gcCollectNative),
+            BUILTIN_FUNCTION(heapDumpNative),
+            BUILTIN_FUNCTION(gcDisableNative),
+            BUILTIN_FUNCTION(gcEnableNative),
 
             BUILTIN_TYPE(objectObjectType),
             BUILTIN_TYPE(intObjectType),
@@ -136,6 +227,7 @@ void vm::initBuiltins()
             BUILTIN_TYPE(DivisionByZeroErrorObjectType),
             BUILTIN_TYPE(ValueErrorObjectType),
             BUILTIN_TYPE(InternalErrorObjectType),
+            BUILTIN_TYPE(MemoryErrorObjectType),
 
             BUILTIN_OBJECT("КінецьІтерації", P_endIter),
         });
@@ -1,6 +1,19 @@
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <iostream>
 #include <span>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 
 #include "gc.hpp"
+#include "heap_dump.hpp"
+#include "exception_object.hpp"
 #include "native_method_object.hpp"
 #include "builtins.hpp"
 #include "plogger.hpp"
@@ -8,45 +21,117 @@
 
 using namespace vm;
 
-void vm::GC::mark(Frame* frame)
+void vm::GC::collectRoots(Frame* frame)
 {
-    Frame* rootFrame = frame;
-    while (rootFrame->previous != nullptr)
-    {
-        rootFrame = rootFrame->previous;
-    }
-    // Обхід стеку
-    for (auto o : std::span{ rootFrame->bp, frame->sp + 1 })
+    roots.clear();
+    if (frame != nullptr)
     {
-        vm::mark(o);
-    }
+        Frame* rootFrame = frame;
+        while (rootFrame->previous != nullptr)
+        {
+            rootFrame = rootFrame->previous;
+        }
+        // Обхід стеку
+        for (auto o : std::span{ rootFrame->bp, frame->sp + 1 })
+        {
+            roots.push_back(o);
+        }
 
-    // Обхід глобальних змінних
-    Frame* _frame = frame;
-    while (_frame != nullptr)
-    {
-        for (auto it = _frame->globals->cbegin(); it != _frame->globals->cend(); ++it)
+        // Обхід глобальних змінних
+        Frame* _frame = frame;
+        while (_frame != nullptr)
         {
-            vm::mark(it->second);
+            for (auto it = _frame->globals->cbegin(); it != _frame->globals->cend(); ++it)
+            {
+                roots.push_back(it->second);
+            }
+            _frame = _frame->previous;
         }
-        _frame = _frame->previous;
-    }
 
-    // Обхід кореневого CodeObject
-    vm::mark(reinterpret_cast<Object*>(rootFrame->codeObject));
+        // Обхід кореневого CodeObject
+        roots.push_back(reinterpret_cast<Object*>(rootFrame->codeObject));
+    }
 
     // Обхід вбудованих об'єктів
     auto builtins = getBuiltin();
     for (auto it = builtins->begin(); it != builtins->end(); ++it)
     {
-        vm::mark(it->second);
+        roots.push_back(it->second);
     }
 
     // Клас Periwinkle зберігає посилання на об'єкт помилки
-    vm::mark(getCurrentState()->exceptionOccurred());
+    roots.push_back(getCurrentState()->exceptionOccurred());
+
+    // Заморожені об'єкти завжди вважаються позначеними, тому їх вміст додається до коренів
+    for (auto o : frozen)
+    {
+        collectReferences(o, roots);
+    }
+}
+
+void vm::GC::mark(Frame* frame)
+{
+    heap.clearMarks();
+    collectRoots(frame);
+    bool overflowed;
+    if (parallelMarker && objectCount >= PARALLEL_MARK_MIN_OBJECTS)
+    {
+        overflowed = parallelMarker->mark(roots);
+    }
+    else
+    {
+        for (auto o : roots)
+        {
+            if (o != nullptr)
+            {
+                markStack.push(o);
+            }
+        }
+        markStack.drain();
+        overflowed = markStack.hasOverflowed();
+    }
+    if (overflowed)
+    {
+        stats.markStackOverflows++;
+        rescanMarked();
+    }
+}
+
+void vm::GC::rescanMarked()
+{
+    // Об'єкти, які не вмістились в стек, досяжні з вже позначених об'єктів.
+    // Статичні об'єкти, крім коренів, в списку objects відсутні, але вони
+    // не посилаються на об'єкти з купи.
+    auto rescan = [this](Object* o) {
+        if (o != nullptr && isMarked(o) && o->objectType->traverse)
+        {
+            o->objectType->traverse(o);
+            markStack.drain();
+        }
+    };
+    MarkStack::current = &markStack;
+    do
+    {
+        markStack.clearOverflow();
+        for (auto o : roots)
+        {
+            // Корінь міг сам не вміститись в стек
+            if (o != nullptr && !isMarked(o))
+            {
+                markStack.push(o);
+                markStack.drain();
+            }
+            rescan(o);
+        }
+        for (auto o : objects)
+        {
+            rescan(o);
+        }
+    } while (markStack.hasOverflowed());
+    MarkStack::current = nullptr;
 }
 
-static inline void finalizeAndDeleteObject(Object* o)
+static void finalizeObject(Object* o)
 {
     if (auto finalizer = o->objectType->destructor)
     {
@@ -59,49 +144,483 @@ static inline void finalizeAndDeleteObject(Object* o)
     }
 }
 
-void vm::GC::sweep()
+void vm::GC::releaseObject(Object* o)
+{
+    stats.reclaimedBytes += o->objectType->size;
+    allocated -= o->objectType->size;
+    objectCount--;
+    finalizeObject(o);
+    heap.free(o);
+}
+
+void vm::GC::sweepStep(size_t count)
 {
-    objects.remove_if([this](Object* o) {
-        if (o->marked == false)
+    while (count-- != 0 && !unswept.empty())
+    {
+        auto o = unswept.front();
+        if (isMarked(o))
         {
-            allocated -= o->objectType->size;
-            finalizeAndDeleteObject(o);
-            return true;
+            // Живий об'єкт переноситься до вже прибраних без перевиділення вузла
+            objects.splice_after(objects.before_begin(), unswept, unswept.before_begin());
         }
         else
         {
-            o->marked = false;
-            return false;
+            unswept.pop_front();
+            releaseObject(o);
         }
-    });
+    }
+    if (unswept.empty())
+    {
+        threshold = nextThreshold();
+        heap.trim(policy.retainedBytes, policy.lazyReturn);
+    }
+}
+
+void vm::GC::sweep()
+{
+    sweepStep(SIZE_MAX);
+}
+
+void vm::GC::recordCollection(std::chrono::steady_clock::duration pause)
+{
+    auto pauseUs = static_cast<u64>(
+        std::chrono::duration_cast<std::chrono::microseconds>(pause).count());
+    stats.collections++;
+    stats.totalPauseUs += pauseUs;
+    stats.maxPauseUs = std::max(stats.maxPauseUs, pauseUs);
+    auto bucket = std::min<size_t>(std::bit_width(pauseUs), GCStats::PAUSE_BUCKETS - 1);
+    stats.pauseHistogram[bucket]++;
+
+    if (logCollections)
+    {
+        std::cerr << std::format(
+            "ЗС #{}: пауза {} мкс, звільнено {} Б, купа {} Б, поріг {} Б, об'єктів {}\n",
+            stats.collections, pauseUs, stats.reclaimedBytes - reclaimedAtLastLog,
+            allocated, threshold, objectCount);
+        reclaimedAtLastLog = stats.reclaimedBytes;
+    }
+}
+
+u64 vm::GC::nextThreshold() const
+{
+    auto target = std::max(static_cast<u64>(static_cast<double>(allocated) * policy.growthFactor),
+        policy.minHeap);
+    if (policy.maxHeap != 0)
+    {
+        target = std::min(target, policy.maxHeap);
+    }
+    // Поріг завжди вищий за обсяг живих об'єктів, інакше збирання запускалось би після кожної інструкції
+    target = std::max(target, allocated);
+    return GC_THRESHOLD * (target / GC_THRESHOLD + 1);
 }
 
-void vm::GC::gc(Frame* frame)
+bool vm::GC::checkHardLimit()
 {
-    if (allocated > threshold)
+    if (policy.hardLimit == 0 || allocated <= policy.hardLimit)
+    {
+        hardLimitReported = false;
+        return true;
+    }
+    if (hardLimitReported)
+    {
+        return true;
+    }
+    hardLimitReported = true;
+    getCurrentState()->setException(&MemoryErrorObjectType,
+        std::format("Розмір купи {} Б перевищує встановлену межу {} Б", allocated, policy.hardLimit));
+    return false;
+}
+
+void vm::GC::collect(Frame* frame)
+{
+    auto start = std::chrono::steady_clock::now();
+    if (!unswept.empty())
+    {
+        sweep();
+    }
+    mark(frame);
+    unswept.swap(objects);
+    if (policy.lazySweep)
+    {
+        // Поки прибирання не завершене, справжній обсяг живих об'єктів невідомий
+        threshold = allocated + GC_THRESHOLD;
+    }
+    else
+    {
+        sweep();
+    }
+    recordCollection(std::chrono::steady_clock::now() - start);
+}
+
+bool vm::GC::gc(Frame* frame)
+{
+    if (takeHeapDumpRequest())
+    {
+        auto path = nextHeapDumpPath();
+        if (dumpHeap(frame, path))
+        {
+            std::cerr << std::format("Знімок купи записано у файл \"{}\"\n", path.string());
+        }
+        else
+        {
+            std::cerr << std::format("Не вдалося записати знімок купи у файл \"{}\"\n", path.string());
+        }
+    }
+    if (arena)
+    {
+        collectionRequested = false;
+        return checkHardLimit();
+    }
+    bool overLimit = policy.hardLimit != 0 && allocated > policy.hardLimit && !hardLimitReported;
+    if (collectionRequested || overLimit)
     {
-        mark(frame);
+        // Перед помилкою про перевищення межі купа очищується, навіть якщо збирач вимкнений
+        collectionRequested = false;
+        collect(frame);
         sweep();
-        threshold = GC_THRESHOLD * (allocated / GC_THRESHOLD + 1);
     }
+    else if (allocated > threshold && disabledDepth == 0)
+    {
+        if (!unswept.empty())
+        {
+            // Попереднє прибирання ще не завершене
+            sweep();
+        }
+        if (allocated > threshold)
+        {
+            collect(frame);
+        }
+    }
+    return checkHardLimit();
 }
 
 void vm::GC::addObject(Object* o)
 {
     plog::passert(o->objectType->size != 0) << "Потрібно вказати в TypeObject поле size";
+    if (immortalAllocation)
+    {
+        immortals.push_back(o);
+        return;
+    }
+    if (!unswept.empty())
+    {
+        sweepStep(LAZY_SWEEP_STEP);
+    }
     allocated += o->objectType->size;
+    stats.allocatedBytes += o->objectType->size;
+    stats.allocatedObjects++;
+    objectCount++;
+    if (arena)
+    {
+        // Об'єкти арени не звільняються поодинці, тому не позначаються
+        if (o->objectType->destructor || o->objectType->dealloc)
+        {
+            objects.push_front(o);
+        }
+        return;
+    }
+    o->collectable = true;
     objects.push_front(o);
 }
 
+void* vm::GC::allocateMemory(size_t size)
+{
+    return heap.allocate(size, immortalAllocation);
+}
+
+bool vm::GC::setImmortalAllocation(bool enabled)
+{
+    return std::exchange(immortalAllocation, enabled);
+}
+
+bool vm::GC::dumpHeap(Frame* frame, const std::filesystem::path& path)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+    collectRoots(frame);
+    writeHeapDump(file, roots);
+    return static_cast<bool>(file);
+}
+
+void vm::GC::requestCollection()
+{
+    collectionRequested = true;
+}
+
+void vm::GC::disable()
+{
+    disabledDepth++;
+}
+
+void vm::GC::enable()
+{
+    if (disabledDepth != 0)
+    {
+        disabledDepth--;
+    }
+}
+
+bool vm::GC::isEnabled() const
+{
+    return disabledDepth == 0;
+}
+
+// Потоки понад кількість ядер лише чекають один на одного. Якщо кількість ядер
+// невідома, кількість потоків не обмежується
+static size_t clampMarkThreads(size_t count)
+{
+    auto cores = std::thread::hardware_concurrency();
+    return cores != 0 ? std::min<size_t>(count, cores) : count;
+}
+
+void vm::GC::setPolicy(const GCPolicy& newPolicy)
+{
+    policy = newPolicy;
+    policy.markThreads = clampMarkThreads(policy.markThreads);
+    if (policy.markStackLimit == 0)
+    {
+        policy.markStackLimit = markStack.getLimit();
+    }
+    heap.setHugePageThreshold(policy.hugePageThreshold);
+    // Потоки позначення перезапускаються лише при зміні їх кількості або розміру їх стеків
+    if (getMarkThreads() != std::max<u64>(policy.markThreads, 1) || markStack.getLimit() != policy.markStackLimit)
+    {
+        markStack.setLimit(policy.markStackLimit);
+        setMarkThreads(policy.markThreads);
+    }
+    setLazySweep(policy.lazySweep);
+    threshold = stats.collections == 0
+        ? std::max(policy.initialHeap, policy.minHeap)
+        : nextThreshold();
+}
+
+const GCPolicy& vm::GC::getPolicy() const
+{
+    return policy;
+}
+
+static void readEnvironment(const char* name, u64& value)
+{
+    if (auto text = std::getenv(name))
+    {
+        char* end;
+        auto parsed = std::strtoull(text, &end, 10);
+        if (*text != '\0' && *end == '\0')
+        {
+            value = parsed;
+        }
+    }
+}
+
+static void readEnvironment(const char* name, double& value)
+{
+    if (auto text = std::getenv(name))
+    {
+        char* end;
+        auto parsed = std::strtod(text, &end);
+        if (*text != '\0' && *end == '\0' && parsed >= 1.0)
+        {
+            value = parsed;
+        }
+    }
+}
+
+static void readEnvironment(const char* name, bool& value)
+{
+    if (auto text = std::getenv(name))
+    {
+        std::string_view flag = text;
+        if (flag == "0" || flag == "1")
+        {
+            value = flag == "1";
+        }
+    }
+}
+
+GCPolicy vm::GCPolicy::fromEnvironment()
+{
+    // Некоректні значення ігноруються
+    GCPolicy policy;
+    readEnvironment("PERIWINKLE_GC_INITIAL_HEAP", policy.initialHeap);
+    readEnvironment("PERIWINKLE_GC_GROWTH", policy.growthFactor);
+    readEnvironment("PERIWINKLE_GC_MIN_HEAP", policy.minHeap);
+    readEnvironment("PERIWINKLE_GC_MAX_HEAP", policy.maxHeap);
+    readEnvironment("PERIWINKLE_GC_HARD_LIMIT", policy.hardLimit);
+    readEnvironment("PERIWINKLE_GC_RETAIN", policy.retainedBytes);
+    readEnvironment("PERIWINKLE_GC_HUGE_PAGES", policy.hugePageThreshold);
+    readEnvironment("PERIWINKLE_GC_LAZY_RETURN", policy.lazyReturn);
+    readEnvironment("PERIWINKLE_GC_MARK_THREADS", policy.markThreads);
+    readEnvironment("PERIWINKLE_GC_MARK_STACK", policy.markStackLimit);
+    readEnvironment("PERIWINKLE_GC_LAZY_SWEEP", policy.lazySweep);
+    return policy;
+}
+
+Heap& vm::GC::getHeap()
+{
+    return heap;
+}
+
+void vm::GC::freeze(Frame* frame)
+{
+    // Без фрейму невідомо, які об'єкти досяжні, тому заморожуються всі
+    if (frame != nullptr)
+    {
+        collect(frame);
+    }
+    sweep();
+    for (auto o : objects)
+    {
+        o->collectable = false;
+    }
+    frozen.splice_after(frozen.before_begin(), objects);
+    heap.freeze();
+    // Заморожені об'єкти більше не впливають на поріг збирання
+    frozenCount += objectCount;
+    allocated = 0;
+    objectCount = 0;
+    threshold = nextThreshold();
+}
+
 void vm::GC::clean()
 {
-    for (auto& object : objects)
+    for (auto list : { &unswept, &objects, &frozen })
     {
-        finalizeAndDeleteObject(object);
-    };
-    objects.clear();
+        for (auto o : *list)
+        {
+            finalizeObject(o);
+        };
+        list->clear();
+    }
+    for (auto o : immortals)
+    {
+        finalizeObject(o);
+    }
+    immortals.clear();
+    // Пам'ять всіх об'єктів звільняється разом зі сторінками
+    heap.releaseAll();
+    allocated = 0;
+    objectCount = 0;
+    frozenCount = 0;
+}
+
+void vm::GC::enableArena()
+{
+    // Об'єкти арени збирач вважає завжди позначеними і не обходить їх вміст,
+    // тому до них не можуть додаватись посилання на звичайні об'єкти
+    plog::passert(objects.empty() && unswept.empty()) << "Режим арени вмикається до створення об'єктів";
+    arena = true;
+}
+
+bool vm::GC::isArena() const
+{
+    return arena;
+}
+
+void vm::GC::setLazySweep(bool enabled)
+{
+    if (!enabled && !unswept.empty())
+    {
+        sweep();
+    }
+    policy.lazySweep = enabled;
+}
+
+bool vm::GC::isLazySweep() const
+{
+    return policy.lazySweep;
+}
+
+void vm::GC::setMarkThreads(size_t count)
+{
+    count = clampMarkThreads(count);
+    delete parallelMarker;
+    parallelMarker = count > 1 ? new ParallelMarker(count, markStack.getLimit()) : nullptr;
+    policy.markThreads = count;
+}
+
+size_t vm::GC::getMarkThreads() const
+{
+    return parallelMarker ? parallelMarker->threadCount() : 1;
+}
+
+GCStats vm::GC::getCounters() const
+{
+    auto result = stats;
+    result.heapBytes = allocated;
+    result.pageBytes = heap.pageBytes();
+    result.retainedBytes = heap.retainedBytes();
+    result.threshold = threshold;
+    result.liveObjects = objectCount;
+    result.permanentObjects = frozenCount + immortals.size();
+    return result;
+}
+
+GCStats vm::GC::getStats() const
+{
+    auto result = getCounters();
+
+    std::unordered_map<const TypeObject*, u64> byType;
+    for (auto list : { &objects, &unswept, &frozen })
+    {
+        for (auto o : *list)
+        {
+            byType[o->objectType]++;
+        }
+    }
+    for (auto o : immortals)
+    {
+        byType[o->objectType]++;
+    }
+    for (auto& [type, count] : byType)
+    {
+        result.liveObjectsByType[type->name] += count;
+    }
+    return result;
+}
+
+vm::ImmortalScope::ImmortalScope(GC* gc)
+    :
+    gc(gc),
+    previous(gc->setImmortalAllocation(true))
+{
+}
+
+vm::ImmortalScope::~ImmortalScope()
+{
+    gc->setImmortalAllocation(previous);
+}
+
+u64 vm::GCStats::pausePercentileUs(double p) const
+{
+    if (collections == 0)
+    {
+        return 0;
+    }
+    auto rank = static_cast<u64>(p * collections);
+    u64 seen = 0;
+    for (size_t i = 0; i < PAUSE_BUCKETS; ++i)
+    {
+        seen += pauseHistogram[i];
+        if (seen > rank || seen == collections)
+        {
+            // В кошику i паузи з bit_width, рівним i, тобто менші за 2^i. Останній кошик
+            // приймає і довші паузи, тому межа обмежується найдовшою паузою
+            return std::min((u64(1) << i) - 1, maxPauseUs);
+        }
+    }
+    return maxPauseUs;
 }
 
 vm::GC::GC()
 {
+    logCollections = std::getenv("PERIWINKLE_GC_LOG") != nullptr;
+    setPolicy(GCPolicy::fromEnvironment());
+}
+
+vm::GC::~GC()
+{
+    delete parallelMarker;
 }
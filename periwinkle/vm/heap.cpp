@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <map>
+#include <new>
+
+#include "heap.hpp"
+#include "platform.hpp"
+#include "plogger.hpp"
+
+using namespace vm;
+
+// Клас для об'єктів, більших за HEAP_MAX_CELL_SIZE
+constexpr const size_t LARGE_SIZE_CLASS = SIZE_MAX;
+constexpr const size_t REGION_RESERVATION_SIZE = HEAP_REGION_SIZE + HEAP_REGION_ALIGNMENT;
+
+static std::byte* alignUp(std::byte* address, size_t alignment)
+{
+    auto value = reinterpret_cast<uintptr_t>(address);
+    return address + ((alignment - value % alignment) % alignment);
+}
+
+#ifdef COMPRESSED_REFERENCES
+
+// Всі купи процесу отримують пам'ять з одного діапазону compressed::heapBase,
+// щоб посилання на об'єкти могли зберігатись як 32-бітні зміщення
+static size_t compressedSpaceUsed = 0;
+// Звільнені частини діапазону за розміром, їх фізична пам'ять вже повернута системі
+static std::multimap<size_t, std::byte*> compressedFreeSpans;
+
+static void reserveCompressedSpace()
+{
+    if (compressed::heapBase != nullptr)
+    {
+        return;
+    }
+    auto reservation = static_cast<std::byte*>(platform::reserveMemory(COMPRESSED_HEAP_SIZE + HEAP_REGION_ALIGNMENT));
+    plog::passert(reservation != nullptr) << "Не вдалося зарезервувати діапазон адрес для купи";
+    compressed::heapBase = alignUp(reservation, HEAP_REGION_ALIGNMENT);
+}
+
+static std::byte* reserveSpan(size_t size)
+{
+    auto it = compressedFreeSpans.lower_bound(size);
+    if (it != compressedFreeSpans.end())
+    {
+        auto [spanSize, memory] = *it;
+        compressedFreeSpans.erase(it);
+        if (spanSize > size)
+        {
+            compressedFreeSpans.emplace(spanSize - size, memory + size);
+        }
+        return memory;
+    }
+    if (compressedSpaceUsed + size > COMPRESSED_HEAP_SIZE)
+    {
+        return nullptr;
+    }
+    auto memory = compressed::heapBase + compressedSpaceUsed;
+    compressedSpaceUsed += size;
+    return memory;
+}
+
+static void releaseSpan(std::byte* memory, size_t size)
+{
+    platform::decommitMemory(memory, size, false);
+    compressedFreeSpans.emplace(size, memory);
+}
+
+#else
+
+static std::byte* reserveSpan(size_t size)
+{
+    return static_cast<std::byte*>(platform::reserveMemory(size));
+}
+
+static void releaseSpan(std::byte* memory, size_t size)
+{
+    platform::releaseMemory(memory, size);
+}
+
+#endif
+
+std::byte* vm::Heap::acquirePageMemory()
+{
+    // Пам'ять, яка ще не повернута системі, не потребує page fault при першому записі
+    if (!retainedPages.empty())
+    {
+        auto memory = retainedPages.back();
+        retainedPages.pop_back();
+        return memory;
+    }
+    std::byte* memory;
+    if (!returnedPages.empty())
+    {
+        memory = returnedPages.back();
+        returnedPages.pop_back();
+    }
+    else
+    {
+        if (regions.empty() || regions.back().bumpIndex == HEAP_REGION_SIZE / HEAP_PAGE_SIZE)
+        {
+            auto reservation = reserveSpan(REGION_RESERVATION_SIZE);
+            if (reservation == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            regions.push_back({ reservation, alignUp(reservation, HEAP_REGION_ALIGNMENT), 0 });
+            if (hugePages)
+            {
+                useHugePages(regions.back());
+            }
+        }
+        auto& region = regions.back();
+        memory = region.start + region.bumpIndex++ * HEAP_PAGE_SIZE;
+    }
+    if (!platform::commitMemory(memory, HEAP_PAGE_SIZE))
+    {
+        returnedPages.push_back(memory);
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+std::byte* vm::Heap::acquireLargeMemory(size_t size, std::byte*& reservation)
+{
+    // Резервування з запасом, щоб вирівняти сторінку на HEAP_PAGE_SIZE
+    reservation = reserveSpan(size + HEAP_PAGE_SIZE);
+    if (reservation == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    auto memory = alignUp(reservation, HEAP_PAGE_SIZE);
+    if (!platform::commitMemory(memory, size))
+    {
+        releaseSpan(reservation, size + HEAP_PAGE_SIZE);
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void vm::Heap::useHugePages(const Region& region)
+{
+    platform::adviseHugePages(region.start, HEAP_REGION_SIZE);
+}
+
+HeapPage* vm::Heap::createPage(size_t sizeClass, size_t cellSize, size_t memorySize, bool permanent)
+{
+    std::byte* reservation = nullptr;
+    auto memory = sizeClass == LARGE_SIZE_CLASS
+        ? acquireLargeMemory(memorySize, reservation)
+        : acquirePageMemory();
+    auto page = new HeapPage;
+    page->permanent = permanent;
+    page->memory = memory;
+    page->reservation = reservation;
+    page->memorySize = memorySize;
+    page->cellSize = cellSize;
+    page->cellCount = sizeClass == LARGE_SIZE_CLASS ? 1 : (memorySize - sizeof(HeapPageHeader)) / cellSize;
+    page->sizeClass = sizeClass;
+    page->markBits.resize((page->cellCount + 63) / 64);
+    page->index = pages.size();
+    new (page->memory) HeapPageHeader{ page };
+    pages.push_back(page);
+    usedBytes += memorySize;
+    if (hugePageThreshold != 0 && !hugePages && usedBytes > hugePageThreshold)
+    {
+        hugePages = true;
+        for (const auto& region : regions)
+        {
+            useHugePages(region);
+        }
+    }
+    return page;
+}
+
+void vm::Heap::releasePage(HeapPage* page)
+{
+    if (page->available)
+    {
+        auto& available = sizeClasses[page->sizeClass].available;
+        available.erase(std::find(available.begin(), available.end(), page));
+    }
+    pages.back()->index = page->index;
+    pages[page->index] = pages.back();
+    pages.pop_back();
+    usedBytes -= page->memorySize;
+    if (page->reservation != nullptr)
+    {
+        // Велика сторінка не використовується повторно, тому її пам'ять одразу повертається системі
+        releaseSpan(page->reservation, page->memorySize + HEAP_PAGE_SIZE);
+    }
+    else
+    {
+        retainedPages.push_back(page->memory);
+    }
+    delete page;
+}
+
+void* vm::Heap::allocate(size_t size, bool permanent)
+{
+    HeapPage* page;
+    if (size > HEAP_MAX_CELL_SIZE)
+    {
+        auto memorySize = (sizeof(HeapPageHeader) + size + HEAP_PAGE_SIZE - 1) / HEAP_PAGE_SIZE * HEAP_PAGE_SIZE;
+        page = createPage(LARGE_SIZE_CLASS, size, memorySize, permanent);
+    }
+    else
+    {
+        auto classIndex = std::max<size_t>((size + HEAP_CELL_ALIGNMENT - 1) / HEAP_CELL_ALIGNMENT, 1);
+        auto& sizeClass = (permanent ? permanentSizeClasses : sizeClasses)[classIndex];
+        page = sizeClass.current;
+        if (page == nullptr || page->isFull())
+        {
+            if (!sizeClass.available.empty())
+            {
+                page = sizeClass.available.back();
+                sizeClass.available.pop_back();
+                page->available = false;
+            }
+            else
+            {
+                page = createPage(classIndex, classIndex * HEAP_CELL_ALIGNMENT, HEAP_PAGE_SIZE, permanent);
+            }
+            sizeClass.current = page;
+        }
+    }
+
+    size_t cell;
+    if (!page->freeCells.empty())
+    {
+        cell = page->freeCells.back();
+        page->freeCells.pop_back();
+    }
+    else
+    {
+        cell = page->bumpIndex++;
+    }
+    page->liveCount++;
+    return page->memory + sizeof(HeapPageHeader) + cell * page->cellSize;
+}
+
+void vm::Heap::free(void* memory)
+{
+    auto o = static_cast<Object*>(memory);
+    auto page = pageOf(o);
+    plog::passert(!page->permanent) << "Звільнення об'єкта з постійної сторінки";
+    page->liveCount--;
+    if (page->sizeClass == LARGE_SIZE_CLASS)
+    {
+        releasePage(page);
+        return;
+    }
+    auto& sizeClass = sizeClasses[page->sizeClass];
+    if (page->liveCount == 0 && page != sizeClass.current)
+    {
+        releasePage(page);
+        return;
+    }
+    page->freeCells.push_back(static_cast<u32>(page->cellIndex(o)));
+    if (!page->available && page != sizeClass.current)
+    {
+        page->available = true;
+        sizeClass.available.push_back(page);
+    }
+}
+
+void vm::Heap::resetSizeClasses()
+{
+    for (auto classes : { &sizeClasses, &permanentSizeClasses })
+    {
+        for (auto& sizeClass : *classes)
+        {
+            sizeClass.current = nullptr;
+            sizeClass.available.clear();
+        }
+    }
+}
+
+void vm::Heap::clearMarks()
+{
+    for (auto page : pages)
+    {
+        if (!page->permanent)
+        {
+            std::fill(page->markBits.begin(), page->markBits.end(), 0);
+        }
+    }
+}
+
+void vm::Heap::freeze()
+{
+    for (auto page : pages)
+    {
+        page->permanent = true;
+        page->available = false;
+    }
+    resetSizeClasses();
+}
+
+void vm::Heap::releaseAll()
+{
+    for (auto page : pages)
+    {
+        if (page->reservation != nullptr)
+        {
+            releaseSpan(page->reservation, page->memorySize + HEAP_PAGE_SIZE);
+        }
+        delete page;
+    }
+    pages.clear();
+    for (const auto& region : regions)
+    {
+        releaseSpan(region.reservation, REGION_RESERVATION_SIZE);
+    }
+    regions.clear();
+    retainedPages.clear();
+    returnedPages.clear();
+    usedBytes = 0;
+    hugePages = false;
+    resetSizeClasses();
+}
+
+void vm::Heap::trim(size_t retainBytes, bool lazy)
+{
+    auto retainCount = retainBytes / HEAP_PAGE_SIZE;
+    if (retainedPages.size() <= retainCount)
+    {
+        return;
+    }
+    // Повертаються сторінки, звільнені найраніше. Сусідні сторінки повертаються одним викликом
+    std::vector<std::byte*> released(retainedPages.begin(), retainedPages.end() - retainCount);
+    retainedPages.erase(retainedPages.begin(), retainedPages.end() - retainCount);
+    std::sort(released.begin(), released.end());
+    size_t rangeStart = 0;
+    for (size_t i = 1; i <= released.size(); ++i)
+    {
+        if (i == released.size() || released[i] != released[i - 1] + HEAP_PAGE_SIZE)
+        {
+            platform::decommitMemory(released[rangeStart], (i - rangeStart) * HEAP_PAGE_SIZE, lazy);
+            rangeStart = i;
+        }
+    }
+    returnedPages.insert(returnedPages.end(), released.begin(), released.end());
+}
+
+void vm::Heap::setHugePageThreshold(size_t bytes)
+{
+    hugePageThreshold = bytes;
+}
+
+size_t vm::Heap::pageBytes() const
+{
+    return usedBytes;
+}
+
+size_t vm::Heap::retainedBytes() const
+{
+    return retainedPages.size() * HEAP_PAGE_SIZE;
+}
+
+vm::Heap::Heap()
+    : sizeClasses(HEAP_MAX_CELL_SIZE / HEAP_CELL_ALIGNMENT + 1),
+    permanentSizeClasses(sizeClasses.size())
+{
+#ifdef COMPRESSED_REFERENCES
+    reserveCompressedSpace();
+#endif
+}
+
+vm::Heap::~Heap()
+{
+    releaseAll();
+}
@@ -0,0 +1,107 @@
+#include <atomic>
+#include <format>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "heap_dump.hpp"
+#include "mark_stack.hpp"
+#include "platform.hpp"
+
+using namespace vm;
+
+static std::atomic<bool> heapDumpRequested = false;
+static u64 heapDumpCounter = 0;
+
+static void writeJsonString(std::ostream& out, const std::string& s)
+{
+    out << '"';
+    for (unsigned char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out << '\\' << c;
+        }
+        else if (c < 0x20)
+        {
+            out << std::format("\\u{:04x}", c);
+        }
+        else
+        {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+void vm::writeHeapDump(std::ostream& out, const std::vector<Object*>& roots)
+{
+    // Обхід в ширину, порядок обходу визначає індекси об'єктів
+    std::unordered_map<Object*, u64> indexes;
+    std::vector<Object*> order;
+    auto visit = [&](Object* o) {
+        auto [it, inserted] = indexes.try_emplace(o, order.size());
+        if (inserted)
+        {
+            order.push_back(o);
+        }
+        return it->second;
+    };
+
+    out << "{\"roots\":[";
+    bool first = true;
+    std::unordered_set<Object*> seenRoots;
+    for (auto o : roots)
+    {
+        if (o == nullptr || !seenRoots.insert(o).second)
+        {
+            continue;
+        }
+        out << (first ? "" : ",") << visit(o);
+        first = false;
+    }
+    out << "],\n\"objects\":[\n";
+
+    std::vector<Object*> references;
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        auto o = order[i];
+        auto type = o->objectType;
+        references.clear();
+        collectReferences(o, references);
+
+        out << (i ? ",\n" : "") << "{\"type\":";
+        writeJsonString(out, type->name);
+        out << ",\"size\":" << type->size
+            << ",\"payload\":" << (type->payloadSize ? type->payloadSize(o) : 0)
+            << ",\"permanent\":" << (o->collectable ? "false" : "true")
+            << ",\"refs\":[";
+        bool firstReference = true;
+        for (auto reference : references)
+        {
+            if (reference == nullptr)
+            {
+                continue;
+            }
+            out << (firstReference ? "" : ",") << visit(reference);
+            firstReference = false;
+        }
+        out << "]}";
+    }
+    out << "\n]}\n";
+}
+
+void vm::requestHeapDump()
+{
+    heapDumpRequested.store(true, std::memory_order_relaxed);
+}
+
+bool vm::takeHeapDumpRequest()
+{
+    return heapDumpRequested.load(std::memory_order_relaxed)
+        && heapDumpRequested.exchange(false, std::memory_order_relaxed);
+}
+
+std::filesystem::path vm::nextHeapDumpPath()
+{
+    return std::format("periwinkle-{}-{}.heap.json", platform::processId(), ++heapDumpCounter);
+}
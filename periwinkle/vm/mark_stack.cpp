@@ -0,0 +1,57 @@
+#include "mark_stack.hpp"
+
+using namespace vm;
+
+thread_local MarkStack* vm::MarkStack::current = nullptr;
+
+bool vm::MarkStack::compact()
+{
+    std::erase_if(items, [](Object* o) {
+        return isMarkedAtomic(o);
+    });
+    return items.size() < limit;
+}
+
+void vm::MarkStack::takeBottom(size_t count, std::deque<Object*>& out)
+{
+    out.insert(out.end(), items.begin(), items.begin() + count);
+    items.erase(items.begin(), items.begin() + count);
+}
+
+void vm::MarkStack::drain()
+{
+    auto previous = current;
+    current = this;
+    while (!items.empty())
+    {
+        auto o = pop();
+        if (!setMarked(o))
+        {
+            continue;
+        }
+        if (auto traverse = o->objectType->traverse)
+        {
+            traverse(o);
+        }
+    }
+    current = previous;
+}
+
+void vm::collectReferences(Object* o, std::vector<Object*>& out)
+{
+    auto traverse = o->objectType->traverse;
+    if (traverse == nullptr)
+    {
+        return;
+    }
+    // Функція traverse передає об'єкти в vm::mark, яка додає їх в поточний стек
+    MarkStack references;
+    auto previous = MarkStack::current;
+    MarkStack::current = &references;
+    traverse(o);
+    MarkStack::current = previous;
+    while (!references.empty())
+    {
+        out.push_back(references.pop());
+    }
+}
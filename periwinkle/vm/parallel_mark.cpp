@@ -0,0 +1,228 @@
+#include "parallel_mark.hpp"
+
+using namespace vm;
+
+// Якщо в локальному стеку більше об'єктів, частина з них стає доступною іншим потокам
+constexpr const size_t SHARE_THRESHOLD = 64;
+
+void vm::MarkWorker::share()
+{
+    // Віддаються найстаріші об'єкти, вони зазвичай ведуть до більших підграфів
+    std::lock_guard lock(sharedMutex);
+    local.takeBottom(local.size() / 2, shared);
+    sharedSize.store(shared.size(), std::memory_order_release);
+}
+
+void vm::MarkWorker::setStackLimit(size_t limit)
+{
+    local.setLimit(limit);
+}
+
+void vm::MarkWorker::push(Object* o)
+{
+    local.push(o);
+}
+
+void vm::MarkWorker::drain()
+{
+    MarkStack::current = &local;
+    while (!local.empty())
+    {
+        auto o = local.pop();
+        if (!setMarkedAtomic(o))
+        {
+            continue;
+        }
+        if (auto traverse = o->objectType->traverse)
+        {
+            traverse(o);
+        }
+        if (local.size() > SHARE_THRESHOLD && sharedSize.load(std::memory_order_relaxed) == 0)
+        {
+            share();
+        }
+    }
+    MarkStack::current = nullptr;
+}
+
+bool vm::MarkWorker::stealInto(MarkWorker& thief)
+{
+    if (sharedSize.load(std::memory_order_acquire) == 0)
+    {
+        return false;
+    }
+    std::lock_guard lock(sharedMutex);
+    if (shared.empty())
+    {
+        return false;
+    }
+    auto count = (shared.size() + 1) / 2;
+    for (auto it = shared.begin(); it != shared.begin() + count; ++it)
+    {
+        thief.local.push(*it);
+    }
+    shared.erase(shared.begin(), shared.begin() + count);
+    sharedSize.store(shared.size(), std::memory_order_release);
+    return true;
+}
+
+bool vm::MarkWorker::hasSharedWork() const
+{
+    return sharedSize.load(std::memory_order_acquire) != 0;
+}
+
+bool vm::MarkWorker::takeOverflow()
+{
+    bool overflowed = local.hasOverflowed();
+    local.clearOverflow();
+    return overflowed;
+}
+
+bool vm::ParallelMarker::steal(size_t index)
+{
+    // Спочатку забирається власна спільна черга, потім черги сусідів по колу
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        auto& victim = workers[(index + i) % workers.size()];
+        if (victim.stealInto(workers[index]))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool vm::ParallelMarker::hasSharedWork() const
+{
+    for (auto& worker : workers)
+    {
+        if (worker.hasSharedWork())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void vm::ParallelMarker::run(size_t index)
+{
+    auto& worker = workers[index];
+    for (;;)
+    {
+        worker.drain();
+        if (steal(index))
+        {
+            continue;
+        }
+
+        // Позначення завершене, коли всі потоки не мають роботи одночасно
+        idle.fetch_add(1, std::memory_order_acq_rel);
+        bool finish = false;
+        for (;;)
+        {
+            if (idle.load(std::memory_order_acquire) == workers.size())
+            {
+                finish = true;
+                break;
+            }
+            if (hasSharedWork())
+            {
+                idle.fetch_sub(1, std::memory_order_acq_rel);
+                break;
+            }
+            std::this_thread::yield();
+        }
+        if (finish)
+        {
+            break;
+        }
+    }
+}
+
+void vm::ParallelMarker::workerLoop(size_t index)
+{
+    u64 seenGeneration = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock lock(mutex);
+            wakeUp.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping)
+            {
+                return;
+            }
+            seenGeneration = generation;
+        }
+        run(index);
+        {
+            std::lock_guard lock(mutex);
+            if (++finished == workers.size())
+            {
+                done.notify_one();
+            }
+        }
+    }
+}
+
+bool vm::ParallelMarker::mark(const std::vector<Object*>& roots)
+{
+    for (size_t i = 0; i < roots.size(); ++i)
+    {
+        if (roots[i] != nullptr)
+        {
+            workers[i % workers.size()].push(roots[i]);
+        }
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        idle.store(0, std::memory_order_relaxed);
+        finished = 0;
+        generation++;
+    }
+    wakeUp.notify_all();
+
+    run(0);
+
+    std::unique_lock lock(mutex);
+    finished++;
+    done.wait(lock, [&] { return finished == workers.size(); });
+
+    bool overflowed = false;
+    for (auto& worker : workers)
+    {
+        overflowed |= worker.takeOverflow();
+    }
+    return overflowed;
+}
+
+size_t vm::ParallelMarker::threadCount() const
+{
+    return workers.size();
+}
+
+vm::ParallelMarker::ParallelMarker(size_t threadCount, size_t stackLimit)
+    : workers(threadCount)
+{
+    for (auto& worker : workers)
+    {
+        worker.setStackLimit(stackLimit);
+    }
+    for (size_t i = 1; i < threadCount; ++i)
+    {
+        threads.emplace_back(&ParallelMarker::workerLoop, this, i);
+    }
+}
+
+vm::ParallelMarker::~ParallelMarker()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
@@ -1,4 +1,6 @@
+#include <cstring>
 #include <format>
+#include <memory>
 
 #include "vm.hpp"
 #include "int_object.hpp"
@@ -25,9 +27,9 @@ using namespace vm;
 #define PUSH(object) *(++sp) = object
 #define PEEK() *sp
 #define POP() *sp--
-#define JUMP() ip = &code->code[operand]
-#define IP_OFFSET() (ip - &code->code[0] - 1)
-#define SET_IP(new_ip) ip = &code->code[(new_ip)]
+#define JUMP() ip = codeStart + operand
+#define IP_OFFSET() (ip - codeStart - 1)
+#define SET_IP(new_ip) ip = codeStart + (new_ip)
 #define NEXT_OPCODE()         \
     opcode = READ();          \
     a = opcode & OPCODE_MASK; \
@@ -35,22 +37,23 @@ using namespace vm;
 
 constexpr auto NAME_NOT_DEFINED = "Ім'я \"{}\" не знайдено";
 
-i64 VirtualMachine::getLineno(WORD* ip) const
+i64 VirtualMachine::getLineno(const WORD* ip) const
 {
-    while (!frame->codeObject->ipToLineno.contains(ip - frame->codeObject->code.data()))
-    {
-        ip--;
-    }
-    return static_cast<i64>(frame->codeObject->ipToLineno[ip - frame->codeObject->code.data()]);
+    auto codeObject = frame->codeObject;
+    return static_cast<i64>(codeObject->getLineno(static_cast<WORD>(ip - codeObject->instructions())));
 }
 
 Object* VirtualMachine::execute()
 {
     using enum OpCode;
-    const auto code = frame->codeObject;
-    const auto& names = code->names;
+    // Змінюються, коли TAIL_CALL замінює вміст фрейму
+    auto code = frame->codeObject;
+    auto names = &code->names;
+    auto codeStart = code->instructions();
     auto builtin = getBuiltin();
     auto gc = getCurrentState()->getGC();
+    // Глибини стеку в CodeObject відраховуються від початкової вершини стеку фрейму
+    auto stackBase = sp;
     WORD opcode, a, operand;
 
     for (;;)
@@ -197,6 +200,49 @@ Object* VirtualMachine::execute()
             auto returnValue = POP();
             return returnValue;
         }
+        case TAIL_CALL:
+        case TAIL_CALL_NA:
+        {
+            auto argc = operand;
+            auto callable = *(sp - argc);
+            std::unique_ptr<NamedArgs> namedArgs;
+            if ((OpCode)a == TAIL_CALL_NA)
+            {
+                auto namedArgNames = (StringVectorObject*)code->constants[READ()];
+                auto namedArgCount = namedArgNames->value.size();
+                namedArgs = std::make_unique<NamedArgs>();
+                namedArgs->names = namedArgNames->value;
+                namedArgs->count = namedArgCount;
+                namedArgs->values.reserve(namedArgCount);
+                for (size_t i = 0; i < namedArgCount; ++i)
+                {
+                    namedArgs->values.push_back(*(sp--));
+                }
+                argc -= namedArgCount;
+            }
+            if (callable->objectType != &functionObjectType)
+            {
+                // Інші об'єкти викликаються як CALL, результат виклику повертається з фрейму
+                auto result = callable->stackCall(sp, argc, namedArgs.get());
+                if (!result) goto error;
+                return result;
+            }
+
+            auto function = static_cast<FunctionObject*>(callable);
+            // Значення іменованих аргументів переносяться в стек до заміни фрейму
+            if (!function->prepareStackCall(sp, argc, namedArgs.get())) goto error;
+            // Функція та аргументи займають місце фрейму, що завершується, тому глибина
+            // хвостової рекурсії не обмежена ні стеком віртуальної машини, ні стеком C++
+            auto argumentSlots = function->code->frameLayout.argumentSlots;
+            std::memmove(bp, sp - argumentSlots + 1, argumentSlots * sizeof(Object*));
+            initFunctionFrame(frame, function);
+            code = frame->codeObject;
+            names = &code->names;
+            codeStart = code->instructions();
+            stackBase = sp;
+            SET_IP(0);
+            break;
+        }
         case FOR_EACH:
         {
             auto iterator = PEEK();
@@ -231,7 +277,7 @@ Object* VirtualMachine::execute()
         }
         case LOAD_GLOBAL:
         {
-            auto& name = names[operand];
+            auto& name = (*names)[operand];
             if (frame->globals->contains(name))
             {
                 if (Object* v; (v = (*frame->globals)[name]) != nullptr)
@@ -253,15 +299,35 @@ Object* VirtualMachine::execute()
             }
             break;
         }
+        case LOAD_GLOBAL_OR_NULL:
+        {
+            // Значення, винесене з циклу. Якщо змінна не визначена, помилку викине
+            // LOAD_LOCAL в циклі, де змінна використовується
+            auto& name = (*names)[operand];
+            Object* v = nullptr;
+            if (auto global = frame->globals->find(name); global != frame->globals->end())
+            {
+                v = global->second;
+            }
+            if (v == nullptr)
+            {
+                if (auto object = builtin->find(name); object != builtin->end())
+                {
+                    v = object->second;
+                }
+            }
+            PUSH(v);
+            break;
+        }
         case STORE_GLOBAL:
         {
-            auto& name = names[operand];
+            auto& name = (*names)[operand];
             (*frame->globals)[name] = POP();
             break;
         }
         case DELETE_GLOBAL:
         {
-            auto& name = names[operand];
+            auto& name = (*names)[operand];
             if ((*frame->globals)[name] != nullptr)
             {
                 (*frame->globals)[name] = nullptr;
@@ -289,6 +355,11 @@ Object* VirtualMachine::execute()
             }
             break;
         }
+        case LOAD_LOCAL_FAST:
+        {
+            PUSH(bp[operand]);
+            break;
+        }
         case STORE_LOCAL:
         {
             bp[operand] = POP();
@@ -330,7 +401,7 @@ Object* VirtualMachine::execute()
         case GET_ATTR:
         {
             auto object = POP();
-            auto& name = names[operand];
+            auto& name = (*names)[operand];
             auto value = object->getAttr(name);
             if (value == nullptr)
             {
@@ -345,7 +416,7 @@ Object* VirtualMachine::execute()
         case LOAD_METHOD:
         {
             auto object = POP();
-            auto& name = names[operand];
+            auto& name = (*names)[operand];
             auto function = object->getAttr(name);
             if (function == nullptr)
             {
@@ -440,10 +511,10 @@ Object* VirtualMachine::execute()
                 functionObject->closure.push_back((CellObject*)POP());
             }
 
-            if (code->defaults.empty() == false)
+            if (codeObject->defaults.empty() == false)
             {
                 functionObject->callableInfo.defaults = new DefaultParameters;
-                functionObject->callableInfo.defaults->parameters.reserve(code->defaults.size());
+                functionObject->callableInfo.defaults->parameters.reserve(codeObject->defaults.size());
                 for (std::string_view parameterName : codeObject->defaults)
                     functionObject->callableInfo.defaults->parameters.emplace_back(parameterName, POP());
             }
@@ -453,7 +524,7 @@ Object* VirtualMachine::execute()
         }
         case TRY:
         {
-            code->getHandlerByStartIp(IP_OFFSET())->stackTop = sp;
+            // Глибина стеку для відновлення відома з верифікації
             break;
         }
         case CATCH:
@@ -463,12 +534,14 @@ Object* VirtualMachine::execute()
             auto currentException = getCurrentState()->exceptionOccurred();
             if (isInstance(currentException, *exceptionType))
             {
-                PUSH(currentException);
+                // Тип винятку на стеку замінюється винятком
+                *sp = currentException;
                 getCurrentState()->exceptionClear();
             }
             else
             {
-                ip = &code->code[endIp];
+                --sp;
+                ip = codeStart + endIp;
             }
             break;
         }
@@ -476,8 +549,7 @@ Object* VirtualMachine::execute()
         {
         OP_END_TRY:
             auto handler = code->getHandlerByEndIp(IP_OFFSET());
-            sp = handler->stackTop;
-            handler->stackTop = nullptr;
+            sp = stackBase + handler->stackDepth;
             if (getCurrentState()->exceptionOccurred()) goto error;
             break;
         }
@@ -497,7 +569,7 @@ Object* VirtualMachine::execute()
         default:
             plog::fatal << "Опкод не реалізовано: \"" << stringEnum::enumToString((OpCode)a) << "\"";
         }
-        gc->gc(frame);
+        if (!gc->gc(frame)) goto error;
     }
 
     error:
@@ -509,6 +581,8 @@ Object* VirtualMachine::execute()
         {
             if (!exception->lineno) exception->lineno = lineno;
             auto handler = excHandler.value();
+            // Обробники починаються зі стеком, який був на початку блоку "спробувати"
+            sp = stackBase + handler->stackDepth;
             // Якщо в блоці "спробувати"
             if (offset < handler->firstHandlerAddress)
             {
@@ -546,10 +620,20 @@ Frame* vm::VirtualMachine::getFrame() const
 
 VirtualMachine* vm::VirtualMachine::currentVm = nullptr;
 
+bool vm::checkStackSpace(Object** base, size_t size)
+{
+    if (base + size > VirtualMachine::currentVm->getFrame()->stackEnd)
+    {
+        getCurrentState()->setException(&MemoryErrorObjectType, "Переповнення стеку викликів");
+        return false;
+    }
+    return true;
+}
+
 vm::VirtualMachine::VirtualMachine(Frame* frame)
     :
     frame(frame),
-    ip(&frame->codeObject->code[0]),
+    ip(frame->codeObject->instructions()),
     sp(frame->sp),
     bp(frame->bp),
     freevars(frame->freevars)
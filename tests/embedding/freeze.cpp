@@ -0,0 +1,80 @@
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "periwinkle.hpp"
+
+// Перевірка Periwinkle::freezeHeap: заморожені об'єкти переходять в постійне покоління,
+// не прибираються наступними збираннями і залишаються доступними для знімка купи
+
+static const std::string PROGRAM = R"(дані = Список()
+і = 0
+поки і менше 1000
+    дані.додати(Список())
+    і += 1
+кінець
+! Сміття, щоб збирач запускався під час виконання
+і = 0
+поки і менше 100000
+    сміття = Список()
+    і += 1
+кінець
+)";
+
+static int failures = 0;
+
+static void check(bool condition, const std::string& message)
+{
+    if (!condition)
+    {
+        std::cerr << "Помилка: " << message << std::endl;
+        failures++;
+    }
+}
+
+static u64 listCount(const vm::GCStats& stats)
+{
+    auto it = stats.liveObjectsByType.find("Список");
+    return it == stats.liveObjectsByType.end() ? 0 : it->second;
+}
+
+int main()
+{
+    periwinkle::initialize();
+    {
+        periwinkle::Periwinkle periwinkle(PROGRAM);
+        periwinkle.execute();
+        check(periwinkle.exceptionOccurred() == nullptr, "перший запуск програми завершився помилкою");
+
+        auto beforeFreeze = periwinkle.getGCStats();
+        periwinkle.freezeHeap();
+        auto afterFreeze = periwinkle.getGCStats();
+        // Поза виконанням невідомо, які об'єкти досяжні, тому заморожуються всі
+        check(afterFreeze.permanentObjects == beforeFreeze.permanentObjects + beforeFreeze.liveObjects,
+            "не всі живі об'єкти перенесені в постійне покоління");
+        check(afterFreeze.liveObjects == 0 && afterFreeze.heapBytes == 0,
+            "заморожені об'єкти враховуються в порозі збирання");
+        check(listCount(afterFreeze) >= 1001, "заморожені списки не враховані в статистиці за типами");
+
+        periwinkle.execute();
+        check(periwinkle.exceptionOccurred() == nullptr, "другий запуск програми завершився помилкою");
+        auto afterRun = periwinkle.getGCStats();
+        check(afterRun.collections > afterFreeze.collections, "під час другого запуску не було збирань");
+        // Повторна компіляція додає безсмертні константи, тому постійних об'єктів може стати більше
+        check(afterRun.permanentObjects >= afterFreeze.permanentObjects,
+            "збирання звільнило заморожені об'єкти");
+        check(listCount(afterRun) >= listCount(afterFreeze), "збирання звільнило заморожені списки");
+
+        // Знімок обходить і заморожені об'єкти
+        auto dumpPath = std::filesystem::temp_directory_path() / "periwinkle_freeze_test.json";
+        check(periwinkle.dumpHeap(dumpPath), "не вдалося записати знімок купи після заморожування");
+        std::filesystem::remove(dumpPath);
+    }
+    periwinkle::finalize();
+
+    if (failures == 0)
+    {
+        std::cout << "Заморожування купи: успішно" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
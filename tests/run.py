@@ -0,0 +1,181 @@
+"""
+Запуск тестових програм.
+
+Кожна програма <назва>.бр з теки tests запускається в кількох режимах, і в кожному її
+вивід (stdout та stderr разом) повинен збігатися з файлом <назва>.вивід поруч з нею.
+Програма копіюється в тимчасову теку і запускається з неї, тому файли, які вона
+записує, та кеш не залишаються в теці tests.
+
+Режими:
+    звичайний - запуск без кешу;
+    кеш       - перший запуск записує кеш, другий читає його, третій - після пошкодження
+                одного байта кешу, який повинен бути відкинутий;
+    образ     - програма записується в образ і запускається з нього, після чого один байт
+                образу пошкоджується. Тіла функцій перевіряються лише при першому виклику,
+                а текст програми та дані констант не перевіряються, тому пошкодження може
+                залишитись непоміченим, але запуск не повинен завершитись аварійно;
+    ліниво    - запуск без кешу з компіляцією тіл функцій при першому виклику.
+
+На початку програми можуть бути коментарі:
+    ! параметри: <параметри барвінка для всіх режимів>
+    ! режими: <режими, в яких запускається програма, через пробіл>
+    ! знімок купи: <файл знімка, який записує програма і який повинен прочитати
+                   tools/heap_dump/summarize.py>
+
+Використання: python run.py <барвінок> [програми або теки]
+"""
+
+import argparse
+import pathlib
+import shutil
+import subprocess
+import sys
+import tempfile
+
+
+TESTS = pathlib.Path(__file__).resolve().parent
+SUMMARIZE = TESTS.parent / "tools" / "heap_dump" / "summarize.py"
+TIMEOUT = 120
+
+
+def collect(paths):
+    programs = []
+    for path in map(pathlib.Path, paths):
+        if path.is_dir():
+            programs.extend(sorted(path.rglob("*.бр")))
+        else:
+            programs.append(path)
+    return programs
+
+
+def directives(text):
+    result = {}
+    for line in text.splitlines():
+        if not line.startswith("!"):
+            break
+        key, separator, value = line[1:].partition(":")
+        if separator:
+            result[key.strip()] = value.split()
+    return result
+
+
+def run_process(interpreter, arguments, directory):
+    return subprocess.run(
+        [interpreter, *arguments], cwd=directory,
+        stdout=subprocess.PIPE, stderr=subprocess.STDOUT, timeout=TIMEOUT,
+    )
+
+
+def run(interpreter, arguments, directory):
+    return run_process(interpreter, arguments, directory).stdout.decode("utf-8", "replace")
+
+
+def corrupt(path):
+    data = bytearray(path.read_bytes())
+    data[len(data) // 2] ^= 0xFF
+    path.write_bytes(data)
+
+
+def plain_mode(interpreter, program, parameters, directory):
+    return [("", run(interpreter, [*parameters, "--без-кешу", program.name], directory))]
+
+
+def lazy_mode(interpreter, program, parameters, directory):
+    return [("", run(interpreter, [*parameters, "--без-кешу", "--ліниво", program.name], directory))]
+
+
+def cache_mode(interpreter, program, parameters, directory):
+    arguments = [*parameters, "--тека-кешу", "кеш", program.name]
+    outputs = [
+        ("запис кешу", run(interpreter, arguments, directory)),
+        ("читання кешу", run(interpreter, arguments, directory)),
+    ]
+    # В теці кешу до імені файлу додається хеш шляху до програми
+    caches = list((directory / "кеш").glob(program.name + ".*.бк"))
+    # Програма з помилкою компіляції не записує кеш
+    if caches:
+        corrupt(caches[0])
+        outputs.append(("пошкоджений кеш", run(interpreter, arguments, directory)))
+    return outputs
+
+
+def image_mode(interpreter, program, parameters, directory):
+    image = program.stem + ".образ"
+    output = run(interpreter, [*parameters, "--образ", image, program.name], directory)
+    # Помилка компіляції виводиться під час запису образу
+    if output:
+        return [("запис образу", output)]
+    outputs = [("запуск образу", run(interpreter, [*parameters, image], directory))]
+    corrupt(directory / image)
+    result = run_process(interpreter, [*parameters, image], directory)
+    # Від'ємний код - завершення сигналом
+    if result.returncode < 0:
+        outputs.append(("пошкоджений образ", f"завершення сигналом {-result.returncode}"))
+    return outputs
+
+
+def check_heap_dump(path):
+    if not path.exists():
+        return "файл знімка не записаний"
+    result = subprocess.run(
+        [sys.executable, str(SUMMARIZE), str(path)],
+        stdout=subprocess.PIPE, stderr=subprocess.STDOUT, timeout=TIMEOUT,
+    )
+    if result.returncode != 0:
+        return result.stdout.decode("utf-8", "replace")
+    return None
+
+
+MODES = {
+    "звичайний": plain_mode,
+    "кеш": cache_mode,
+    "образ": image_mode,
+    "ліниво": lazy_mode,
+}
+
+
+def check(interpreter, program):
+    expected = program.with_suffix(".вивід").read_text(encoding="utf-8")
+    options = directives(program.read_text(encoding="utf-8"))
+    parameters = options.get("параметри", [])
+    heap_dump = options.get("знімок купи")
+    failures = []
+    for mode in options.get("режими", MODES):
+        with tempfile.TemporaryDirectory() as directory:
+            directory = pathlib.Path(directory)
+            shutil.copy(program, directory / program.name)
+            for step, output in MODES[mode](interpreter, program, parameters, directory):
+                if output != expected:
+                    failures.append((f"{mode}, {step}" if step else mode, output))
+            if heap_dump:
+                error = check_heap_dump(directory / heap_dump[0])
+                if error:
+                    failures.append((f"{mode}, знімок купи", error))
+    return expected, failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Запуск тестових програм")
+    parser.add_argument("interpreter", help="шлях до виконуваного файлу барвінка")
+    parser.add_argument("paths", nargs="*", default=[str(TESTS)], help="програми або теки")
+    args = parser.parse_args()
+    interpreter = str(pathlib.Path(args.interpreter).resolve())
+
+    programs = collect(args.paths)
+    failed = 0
+    for program in programs:
+        expected, failures = check(interpreter, program)
+        if not failures:
+            continue
+        failed += 1
+        for mode, output in failures:
+            print(f"Не збігається: {program} ({mode})")
+            print("  Очікувалось:\n    " + expected.replace("\n", "\n    "))
+            print("  Отримано:\n    " + output.replace("\n", "\n    "))
+
+    print(f"Програм: {len(programs)}, з помилками: {failed}")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
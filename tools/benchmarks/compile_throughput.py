@@ -0,0 +1,83 @@
+"""
+Вимірювання швидкості компіляції Барвінка на великому згенерованому коді.
+
+Скрипт генерує програму з заданою кількістю рядків: глобальні присвоєння з різними
+іменами та константами і функції з локальними змінними, циклами та замиканнями.
+Функції не викликаються, тому час запуску майже повністю складається з розбору
+та компіляції. З результату віднімається час запуску порожньої програми.
+
+Використання: python compile_throughput.py <шлях до барвінка> [--lines N] [--runs N]
+"""
+
+import argparse
+import os
+import statistics
+import subprocess
+import tempfile
+import time
+
+
+FUNCTION_TEMPLATE = """функція ф{i}(а, б, в=0)
+    обійти а як е
+        б = б + е * {i} + {i}.5
+    кінець
+    функція вн{i}()
+        повернути б + в
+    кінець
+    якщо б більше {i}
+        повернути "рядок{i}" + вн{i}()
+    кінець
+    повернути б
+кінець
+"""
+FUNCTION_LINES = FUNCTION_TEMPLATE.count("\n")
+
+
+def generate(lines):
+    # Половина рядків - глобальні присвоєння, половина - функції
+    parts = []
+    for i in range(lines // 2):
+        parts.append(f"г{i} = {i} + {i % 100}.25\n")
+    for i in range((lines - lines // 2) // FUNCTION_LINES):
+        parts.append(FUNCTION_TEMPLATE.format(i=i))
+    return "".join(parts)
+
+
+def measure(interpreter, path, runs):
+    times = []
+    for _ in range(runs):
+        start = time.perf_counter()
+        subprocess.run([interpreter, path], check=True, stdout=subprocess.DEVNULL)
+        times.append(time.perf_counter() - start)
+    return statistics.median(times)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Швидкість компіляції Барвінка")
+    parser.add_argument("interpreter", help="шлях до виконуваного файлу барвінка")
+    parser.add_argument("--lines", type=int, default=100_000, help="кількість рядків програми")
+    parser.add_argument("--runs", type=int, default=5, help="кількість запусків, береться медіана")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as directory:
+        source = generate(args.lines)
+        program = os.path.join(directory, "великий.бр")
+        empty = os.path.join(directory, "порожній.бр")
+        with open(program, "w", encoding="utf-8") as f:
+            f.write(source)
+        with open(empty, "w", encoding="utf-8") as f:
+            f.write("ніц\n")
+
+        startup = measure(args.interpreter, empty, args.runs)
+        total = measure(args.interpreter, program, args.runs)
+
+    line_count = source.count("\n")
+    compile_time = max(total - startup, 1e-9)
+    print(f"рядків: {line_count}")
+    print(f"запуск порожньої програми: {startup * 1000:.1f} мс")
+    print(f"компіляція: {compile_time * 1000:.1f} мс")
+    print(f"швидкість: {line_count / compile_time:,.0f} рядків/с")
+
+
+if __name__ == "__main__":
+    main()
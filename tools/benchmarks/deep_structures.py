@@ -0,0 +1,130 @@
+"""
+Вимірювання позначення збирачем сміття глибоких та широких структур.
+
+Скрипт запускає дві програми: одна будує список, вкладений сам у себе на задану глибину,
+друга - список із заданою кількістю вкладених списків. Після побудови кожна програма
+кілька разів запитує збирання сміття, поки вся структура жива. Позначення йде через
+явний стек, тому глибина вкладення не впливає на стек процесу. Для кожної програми
+виводиться час виконання, максимальна пам'ять процесу, кількість збирань та найдовша
+пауза з журналу збирача (PERIWINKLE_GC_LOG).
+
+Використання: python deep_structures.py <шлях до барвінка> [--size N] [--collections N] [--runs N]
+                                                      [--mark-threads N] [--growth X]
+"""
+
+import argparse
+import os
+import re
+import resource
+import statistics
+import subprocess
+import tempfile
+import time
+
+
+DEEP_PROGRAM = """корінь = Список()
+вузол = корінь
+і = 0
+поки і менше {size}
+    наступний = Список()
+    вузол.додати(наступний)
+    вузол.додати(і)
+    вузол = наступний
+    і += 1
+кінець
+і = 0
+поки і менше {collections}
+    зібратиСміття()
+    і += 1
+кінець
+! Обхід структури, щоб вона залишалась живою до кінця збирань
+сума = 0
+вузол = корінь
+поки вузол.розмір() більше 0
+    сума += вузол.отримати(1)
+    вузол = вузол.отримати(0)
+кінець
+друкр(сума)
+"""
+
+WIDE_PROGRAM = """корінь = Список()
+і = 0
+поки і менше {size}
+    елемент = Список()
+    елемент.додати(і)
+    корінь.додати(елемент)
+    і += 1
+кінець
+і = 0
+поки і менше {collections}
+    зібратиСміття()
+    і += 1
+кінець
+друкр(корінь.розмір())
+"""
+
+PAUSE = re.compile(r"пауза (\d+) мкс")
+
+
+def run(interpreter, path, env):
+    # Максимальна пам'ять дочірніх процесів накопичується, тому кожен запуск
+    # виконується в окремому процесі-посереднику
+    pid = os.fork()
+    if pid == 0:
+        with open(os.devnull, "w") as devnull, open(path + ".log", "w") as log:
+            code = subprocess.run([interpreter, path], stdout=devnull, stderr=log, env=env).returncode
+        maxrss = resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss
+        with open(path + ".rss", "w") as f:
+            f.write(str(maxrss))
+        os._exit(code)
+    start = time.perf_counter()
+    _, status = os.waitpid(pid, 0)
+    elapsed = time.perf_counter() - start
+    if os.waitstatus_to_exitcode(status) != 0:
+        raise RuntimeError(f"програма {path} завершилась з помилкою")
+    with open(path + ".rss") as f:
+        maxrss = int(f.read())
+    with open(path + ".log", encoding="utf-8") as f:
+        pauses = [int(match.group(1)) for match in PAUSE.finditer(f.read())]
+    return elapsed, maxrss, pauses
+
+
+def measure(interpreter, path, runs, env):
+    results = [run(interpreter, path, env) for _ in range(runs)]
+    elapsed = statistics.median(r[0] for r in results)
+    maxrss = max(r[1] for r in results)
+    collections = statistics.median(len(r[2]) for r in results)
+    max_pause = max((max(r[2]) for r in results if r[2]), default=0)
+    return elapsed, maxrss, collections, max_pause
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Позначення глибоких та широких структур")
+    parser.add_argument("interpreter", help="шлях до виконуваного файлу барвінка")
+    parser.add_argument("--size", type=int, default=100_000, help="глибина вкладення та ширина списку")
+    parser.add_argument("--collections", type=int, default=10, help="кількість запитаних збирань")
+    parser.add_argument("--runs", type=int, default=3, help="кількість запусків, береться медіана")
+    parser.add_argument("--mark-threads", type=int, default=1, help="кількість потоків позначення")
+    # З коефіцієнтом за замовчуванням (1.0) поріг росте лише на крок, тому під час побудови
+    # структура позначається тисячі разів і час виконання зростає квадратично
+    parser.add_argument("--growth", type=float, default=2.0, help="коефіцієнт зростання купи після збирання")
+    args = parser.parse_args()
+
+    env = dict(os.environ)
+    env["PERIWINKLE_GC_LOG"] = "1"
+    env["PERIWINKLE_GC_MARK_THREADS"] = str(args.mark_threads)
+    env["PERIWINKLE_GC_GROWTH"] = str(args.growth)
+
+    with tempfile.TemporaryDirectory() as directory:
+        for name, template in (("глибока", DEEP_PROGRAM), ("широка", WIDE_PROGRAM)):
+            program = os.path.join(directory, f"{name}.бр")
+            with open(program, "w", encoding="utf-8") as f:
+                f.write(template.format(size=args.size, collections=args.collections))
+            elapsed, maxrss, collections, max_pause = measure(args.interpreter, program, args.runs, env)
+            print(f"{name} структура, розмір {args.size}: {elapsed * 1000:.1f} мс, "
+                  f"пам'ять {maxrss / 1024:.1f} МіБ, збирань {collections:.0f}, "
+                  f"найдовша пауза {max_pause / 1000:.1f} мс")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,90 @@
+"""
+Вимірювання хвостових викликів Барвінка на глибокій рекурсії.
+
+Скрипт запускає програму, в якій функції з акумулятором викликають себе та одна одну
+в "повернути" задану кількість разів. Хвостові виклики виконуються в тому ж фреймі,
+тому пам'ять процесу не залежить від глибини рекурсії: виводиться час виконання
+та максимальний розмір резидентної пам'яті для кожної глибини.
+
+Використання: python tail_call.py <шлях до барвінка> [--depth N] [--runs N]
+"""
+
+import argparse
+import os
+import resource
+import statistics
+import subprocess
+import tempfile
+import time
+
+
+PROGRAM = """функція сума(н, акумулятор)
+    якщо н рівно 0
+        повернути акумулятор
+    кінець
+    повернути сума(н - 1, акумулятор + н)
+кінець
+
+функція парне(н)
+    якщо н рівно 0
+        повернути істина
+    кінець
+    повернути непарне(н - 1)
+кінець
+
+функція непарне(н)
+    якщо н рівно 0
+        повернути хиба
+    кінець
+    повернути парне(н - 1)
+кінець
+
+друкр(сума({depth}, 0))
+друкр(парне({depth}))
+"""
+
+
+def run(interpreter, path):
+    # Максимальна пам'ять дочірніх процесів накопичується, тому кожен запуск
+    # виконується в окремому процесі-посереднику
+    pid = os.fork()
+    if pid == 0:
+        with open(os.devnull, "w") as devnull:
+            code = subprocess.run([interpreter, path], stdout=devnull).returncode
+        maxrss = resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss
+        with open(path + ".rss", "w") as f:
+            f.write(str(maxrss))
+        os._exit(code)
+    start = time.perf_counter()
+    _, status = os.waitpid(pid, 0)
+    elapsed = time.perf_counter() - start
+    if os.waitstatus_to_exitcode(status) != 0:
+        raise RuntimeError(f"програма {path} завершилась з помилкою")
+    with open(path + ".rss") as f:
+        return elapsed, int(f.read())
+
+
+def measure(interpreter, path, runs):
+    results = [run(interpreter, path) for _ in range(runs)]
+    return statistics.median(r[0] for r in results), max(r[1] for r in results)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Хвостові виклики Барвінка")
+    parser.add_argument("interpreter", help="шлях до виконуваного файлу барвінка")
+    parser.add_argument("--depth", type=int, default=1_000_000, help="глибина рекурсії")
+    parser.add_argument("--runs", type=int, default=3, help="кількість запусків, береться медіана")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as directory:
+        # Пам'ять на меншій глибині для порівняння
+        for depth in (args.depth // 100, args.depth):
+            program = os.path.join(directory, f"рекурсія{depth}.бр")
+            with open(program, "w", encoding="utf-8") as f:
+                f.write(PROGRAM.format(depth=depth))
+            elapsed, maxrss = measure(args.interpreter, program, args.runs)
+            print(f"глибина {depth}: {elapsed * 1000:.1f} мс, пам'ять {maxrss / 1024:.1f} МіБ")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,154 @@
+"""
+Підсумок знімка купи Барвінка.
+
+Знімок створюється функцією "знімокПам'яті(шлях)", методом Periwinkle::dumpHeap
+або сигналом SIGUSR1. Скрипт будує дерево домінаторів графа об'єктів і виводить
+для кожного типу кількість об'єктів, їх власний розмір та утримуваний розмір -
+пам'ять, яка звільниться, якщо зникнуть всі об'єкти цього типу.
+
+Використання: python summarize.py <знімок.heap.json> [--top N]
+"""
+
+import argparse
+import json
+from collections import defaultdict
+from dataclasses import dataclass
+
+
+@dataclass
+class TypeSummary:
+    count: int = 0
+    shallow: int = 0
+    retained: int = 0
+
+
+def load(path):
+    with open(path, encoding="utf-8") as f:
+        dump = json.load(f)
+    objects = dump["objects"]
+    types = [o["type"] for o in objects]
+    sizes = [o["size"] + o["payload"] for o in objects]
+    refs = [o["refs"] for o in objects]
+    return dump["roots"], types, sizes, refs
+
+
+def reverse_postorder(root, successors):
+    # Обхід без рекурсії, бо ланцюжки об'єктів можуть бути дуже довгими
+    visited = [False] * len(successors)
+    order = []
+    visited[root] = True
+    stack = [(root, 0)]
+    while stack:
+        node, i = stack[-1]
+        if i < len(successors[node]):
+            stack[-1] = (node, i + 1)
+            child = successors[node][i]
+            if not visited[child]:
+                visited[child] = True
+                stack.append((child, 0))
+        else:
+            stack.pop()
+            order.append(node)
+    order.reverse()
+    return order
+
+
+def dominators(root, successors):
+    # Алгоритм Купера, Харві та Кеннеді "A Simple, Fast Dominance Algorithm"
+    order = reverse_postorder(root, successors)
+    position = {node: i for i, node in enumerate(order)}
+    predecessors = defaultdict(list)
+    for node in order:
+        for child in successors[node]:
+            predecessors[child].append(node)
+
+    idom = {root: root}
+
+    def intersect(a, b):
+        while a != b:
+            while position[a] > position[b]:
+                a = idom[a]
+            while position[b] > position[a]:
+                b = idom[b]
+        return a
+
+    changed = True
+    while changed:
+        changed = False
+        for node in order[1:]:
+            new_idom = None
+            for p in predecessors[node]:
+                if p in idom:
+                    new_idom = p if new_idom is None else intersect(p, new_idom)
+            if idom.get(node) != new_idom:
+                idom[node] = new_idom
+                changed = True
+    return order, idom
+
+
+def summarize(roots, types, sizes, refs):
+    # Вершина з індексом len(types) - уявний корінь, що посилається на всі корені
+    root = len(types)
+    successors = refs + [roots]
+    order, idom = dominators(root, successors)
+
+    retained = sizes + [0]
+    for node in reversed(order[1:]):
+        retained[idom[node]] += retained[node]
+
+    children = defaultdict(list)
+    for node in order[1:]:
+        children[idom[node]].append(node)
+
+    # Утримуваний розмір типу - сума утримуваних розмірів його об'єктів,
+    # над якими в дереві домінаторів немає об'єкта того ж типу
+    summary = defaultdict(TypeSummary)
+    active = defaultdict(int)
+    stack = [(root, False)]
+    while stack:
+        node, leaving = stack.pop()
+        if node == root:
+            if not leaving:
+                stack.append((root, True))
+                stack.extend((child, False) for child in children[root])
+            continue
+        type_name = types[node]
+        if leaving:
+            active[type_name] -= 1
+            continue
+        entry = summary[type_name]
+        entry.count += 1
+        entry.shallow += sizes[node]
+        if active[type_name] == 0:
+            entry.retained += retained[node]
+        active[type_name] += 1
+        stack.append((node, True))
+        stack.extend((child, False) for child in children[node])
+    return summary, retained, order
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Підсумок знімка купи Барвінка")
+    parser.add_argument("dump", help="файл знімка купи")
+    parser.add_argument("--top", type=int, default=10, help="кількість найбільших об'єктів для виводу")
+    args = parser.parse_args()
+
+    roots, types, sizes, refs = load(args.dump)
+    summary, retained, order = summarize(roots, types, sizes, refs)
+
+    print(f"Об'єктів: {len(types)}, коренів: {len(roots)}, розмір: {sum(sizes)} Б")
+    print()
+    print(f"{'Тип':<24} {'Кількість':>10} {'Власний, Б':>12} {'Утримуваний, Б':>16}")
+    for type_name, entry in sorted(summary.items(), key=lambda item: -item[1].retained):
+        print(f"{type_name:<24} {entry.count:>10} {entry.shallow:>12} {entry.retained:>16}")
+
+    if args.top > 0:
+        print()
+        print("Найбільші за утримуваним розміром об'єкти:")
+        largest = sorted(order[1:], key=lambda node: -retained[node])[:args.top]
+        for node in largest:
+            print(f"  #{node:<8} {types[node]:<24} {retained[node]:>12} Б")
+
+
+if __name__ == "__main__":
+    main()
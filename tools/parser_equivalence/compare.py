@@ -0,0 +1,101 @@
+"""
+Перевірка еквівалентності рукописного парсера та парсера, згенерованого з граматики.
+
+Потрібні дві збірки Барвінка в режимі Debug (з опцією "-а"): звичайна (рукописний парсер)
+та зібрана з -DPERIWINKLE_GENERATED_PARSER=ON. Для кожного файлу з корпусу скрипт порівнює
+згенерований код для віртуальної машини, який залежить від усіх вузлів AST та їх
+позицій, а для програм з помилками - повідомлення про синтаксичну помилку.
+З опцією --mutations для кожного файлу додатково перевіряються програми, в яких
+видалено випадковий фрагмент, щоб порівняти повідомлення про помилки.
+
+Без файлів перевіряється корпус з теки corpus поруч зі скриптом: програми з граничними
+випадками лексера (числа "1." та ".5", "нерівно", "менше рівно", дужки, сусідні рядки),
+а в corpus/errors - програми, розбір яких повинен завершитись однаковою помилкою.
+
+Використання: python compare.py <барвінок> <барвінок з генерованим парсером> [файли або теки]
+              [--mutations N] [--seed N]
+"""
+
+import argparse
+import os
+import pathlib
+import random
+import re
+import subprocess
+import sys
+import tempfile
+
+
+CORPUS = pathlib.Path(__file__).resolve().parent / "corpus"
+
+def collect(paths):
+    files = []
+    for path in map(pathlib.Path, paths):
+        if path.is_dir():
+            files.extend(sorted(path.rglob("*.бр")))
+        else:
+            files.append(path)
+    return files
+
+
+def disassemble(interpreter, path):
+    result = subprocess.run(
+        [interpreter, "--без-кешу", "-а", str(path)],
+        stdout=subprocess.PIPE, stderr=subprocess.STDOUT, timeout=60,
+    )
+    # Адреси CodeObject різні в кожному запуску
+    return result.returncode, re.sub(rb"0x[0-9a-f]+", b"0x", result.stdout)
+
+
+def mutate(text, rng):
+    # Видаляє від 1 до 3 символів у випадковому місці
+    if not text:
+        return text
+    start = rng.randrange(len(text))
+    return text[:start] + text[start + rng.randint(1, 3):]
+
+
+def compare(interpreters, path):
+    outputs = [disassemble(interpreter, path) for interpreter in interpreters]
+    return outputs[0] == outputs[1], outputs
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("interpreter")
+    parser.add_argument("generated")
+    parser.add_argument("paths", nargs="*", default=[str(CORPUS)])
+    parser.add_argument("--mutations", type=int, default=0)
+    parser.add_argument("--seed", type=int, default=0)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    interpreters = (args.interpreter, args.generated)
+    checked = 0
+    failures = 0
+    with tempfile.TemporaryDirectory() as directory:
+        for path in collect(args.paths):
+            cases = [(path, str(path))]
+            text = path.read_text(encoding="utf-8")
+            for i in range(args.mutations):
+                mutated = pathlib.Path(directory, f"{path.stem}_{i}.бр")
+                mutated.write_text(mutate(text, rng), encoding="utf-8")
+                cases.append((mutated, f"{path} (зміна {i})"))
+
+            for case, name in cases:
+                checked += 1
+                equal, outputs = compare(interpreters, case)
+                if equal:
+                    continue
+                failures += 1
+                print(f"Відрізняється: {name}")
+                for interpreter, (code, output) in zip(interpreters, outputs):
+                    print(f"  {os.path.basename(interpreter)}: код {code}")
+                    print("    " + output.decode("utf-8", "replace")[:2000].replace("\n", "\n    "))
+
+    print(f"Перевірено програм: {checked}, відмінностей: {failures}")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())